@@ -37,6 +37,9 @@
 #include <stdbool.h>
 
 #include <limits.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 #include <ruby.h>
 
 #include "rbffi.h"
@@ -297,6 +300,116 @@ rbffi_bool_new(uint8_t value)
 
 NUM_OP(bool, unsigned char, rbffi_bool_value, rbffi_bool_new, NOSWAP);
 
+/*
+ * Copy count elements of size bytes from src to dst, reversing the byte order
+ * of each.  With SSE2, 16 bytes are done at a time.
+ */
+static void
+memory_swap_copy(char* dst, const char* src, long count, int size)
+{
+    long i = 0, n = count * size;
+    int j;
+
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+
+        /* Reverse the 16-bit words of each element, then the bytes of each word */
+        if (size == 4) {
+            v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+        } else if (size == 8) {
+            v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1b), 0x1b);
+        }
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *) (dst + i), v);
+    }
+#endif
+
+    for (; i < n; i += size) {
+        char tmp[8];
+        memcpy(tmp, src + i, size);
+        for (j = 0; j < size; ++j) {
+            dst[i + j] = tmp[size - 1 - j];
+        }
+    }
+}
+
+/*
+ * Bulk copies of numeric arrays between memory and binary strings in native
+ * byte order, as used by String#pack and String#unpack, without creating a
+ * Ruby object per element.  Integers are byte swapped in memory with a
+ * non-native #order, like the other integer accessors.
+ */
+#define PACKED_OP(name, type, swaps) \
+static VALUE memory_put_packed_array_of_##name(VALUE self, VALUE offset, VALUE str); \
+static VALUE \
+memory_put_packed_array_of_##name(VALUE self, VALUE offset, VALUE str) \
+{ \
+    long off = NUM2LONG(offset); \
+    AbstractMemory* memory = MEMORY(self); \
+    long len; \
+    StringValue(str); \
+    len = RSTRING_LEN(str); \
+    if (len % sizeof(type) != 0) { \
+        rb_raise(rb_eArgError, "string length %ld is not a multiple of %d", len, (int) sizeof(type)); \
+    } \
+    if (likely(len > 0)) checkWrite(memory); \
+    checkBounds(memory, off, len); \
+    if ((swaps) && sizeof(type) > 1 && unlikely((memory->flags & MEM_SWAP) != 0)) { \
+        memory_swap_copy(memory->address + off, RSTRING_PTR(str), len / sizeof(type), sizeof(type)); \
+    } else { \
+        memmove(memory->address + off, RSTRING_PTR(str), len); \
+    } \
+    RB_GC_GUARD(str); \
+    return self; \
+} \
+static VALUE memory_write_packed_array_of_##name(VALUE self, VALUE str); \
+static VALUE \
+memory_write_packed_array_of_##name(VALUE self, VALUE str) \
+{ \
+    return memory_put_packed_array_of_##name(self, INT2FIX(0), str); \
+} \
+static VALUE memory_get_packed_array_of_##name(VALUE self, VALUE offset, VALUE length); \
+static VALUE \
+memory_get_packed_array_of_##name(VALUE self, VALUE offset, VALUE length) \
+{ \
+    long count = NUM2LONG(length); \
+    long off = NUM2LONG(offset); \
+    AbstractMemory* memory = MEMORY(self); \
+    VALUE retVal; \
+    if (unlikely(count < 0 || count > LONG_MAX / (long) sizeof(type))) { \
+        rb_raise(rb_eIndexError, "Memory access offset=%ld count=%ld is out of bounds", off, count); \
+    } \
+    if (likely(count > 0)) checkRead(memory); \
+    checkBounds(memory, off, count * sizeof(type)); \
+    retVal = rb_str_new(NULL, count * sizeof(type)); \
+    if ((swaps) && sizeof(type) > 1 && unlikely((memory->flags & MEM_SWAP) != 0)) { \
+        memory_swap_copy(RSTRING_PTR(retVal), memory->address + off, count, sizeof(type)); \
+    } else { \
+        memcpy(RSTRING_PTR(retVal), memory->address + off, count * sizeof(type)); \
+    } \
+    return retVal; \
+} \
+static VALUE memory_read_packed_array_of_##name(VALUE self, VALUE length); \
+static VALUE \
+memory_read_packed_array_of_##name(VALUE self, VALUE length) \
+{ \
+    return memory_get_packed_array_of_##name(self, INT2FIX(0), length); \
+}
+
+PACKED_OP(int8, int8_t, true);
+PACKED_OP(uint8, uint8_t, true);
+PACKED_OP(int16, int16_t, true);
+PACKED_OP(uint16, uint16_t, true);
+PACKED_OP(int32, int32_t, true);
+PACKED_OP(uint32, uint32_t, true);
+PACKED_OP(int64, int64_t, true);
+PACKED_OP(uint64, uint64_t, true);
+PACKED_OP(long, long, true);
+PACKED_OP(ulong, unsigned long, true);
+PACKED_OP(float32, float, false);
+PACKED_OP(float64, double, false);
+
 
 /*
  * call-seq: memory.clear
@@ -769,7 +882,14 @@ rbffi_AbstractMemory_Init(VALUE moduleFFI)
      * * read_array_of_int<i>size</i>(length)
      * * write_array_of_uint<i>size</i>(ary)
      * * read_array_of_uint<i>size</i>(length)
+     * * put_packed_array_of_int<i>size</i>(offset, str)
+     * * get_packed_array_of_int<i>size</i>(offset, length)
+     * * write_packed_array_of_int<i>size</i>(str)
+     * * read_packed_array_of_int<i>size</i>(length)
+     * * and the same for uint<i>size</i>
      * where _size_ is 8, 16, 32 or 64. Same methods exist for long type.
+     * The packed methods copy elements to and from a binary string, in the native byte order
+     * used by String#pack and String#unpack, rather than an array.
      *
      * Aliases exist : _char_ for _int8_, _short_ for _int16_, _int_ for _int32_ and <i>long_long</i> for _int64_.
      *
@@ -813,6 +933,26 @@ rbffi_AbstractMemory_Init(VALUE moduleFFI)
     INT(int64);
     INT(long);
 
+#undef PACKED
+#define PACKED(type) \
+    rb_define_method(classMemory, "put_packed_array_of_" #type, memory_put_packed_array_of_##type, 2); \
+    rb_define_method(classMemory, "get_packed_array_of_" #type, memory_get_packed_array_of_##type, 2); \
+    rb_define_method(classMemory, "write_packed_array_of_" #type, memory_write_packed_array_of_##type, 1); \
+    rb_define_method(classMemory, "read_packed_array_of_" #type, memory_read_packed_array_of_##type, 1);
+
+    PACKED(int8);
+    PACKED(uint8);
+    PACKED(int16);
+    PACKED(uint16);
+    PACKED(int32);
+    PACKED(uint32);
+    PACKED(int64);
+    PACKED(uint64);
+    PACKED(long);
+    PACKED(ulong);
+    PACKED(float32);
+    PACKED(float64);
+
 #define ALIAS(name, old) \
     rb_define_alias(classMemory, "put_" #name, "put_" #old); \
     rb_define_alias(classMemory, "get_" #name, "get_" #old); \
@@ -829,7 +969,15 @@ rbffi_AbstractMemory_Init(VALUE moduleFFI)
     rb_define_alias(classMemory, "write_array_of_" #name, "write_array_of_" #old); \
     rb_define_alias(classMemory, "read_array_of_" #name, "read_array_of_" #old); \
     rb_define_alias(classMemory, "write_array_of_u" #name, "write_array_of_u" #old); \
-    rb_define_alias(classMemory, "read_array_of_u" #name, "read_array_of_u" #old);
+    rb_define_alias(classMemory, "read_array_of_u" #name, "read_array_of_u" #old); \
+    rb_define_alias(classMemory, "put_packed_array_of_" #name, "put_packed_array_of_" #old); \
+    rb_define_alias(classMemory, "get_packed_array_of_" #name, "get_packed_array_of_" #old); \
+    rb_define_alias(classMemory, "write_packed_array_of_" #name, "write_packed_array_of_" #old); \
+    rb_define_alias(classMemory, "read_packed_array_of_" #name, "read_packed_array_of_" #old); \
+    rb_define_alias(classMemory, "put_packed_array_of_u" #name, "put_packed_array_of_u" #old); \
+    rb_define_alias(classMemory, "get_packed_array_of_u" #name, "get_packed_array_of_u" #old); \
+    rb_define_alias(classMemory, "write_packed_array_of_u" #name, "write_packed_array_of_u" #old); \
+    rb_define_alias(classMemory, "read_packed_array_of_u" #name, "read_packed_array_of_u" #old);
 
     ALIAS(char, int8);
     ALIAS(short, int16);
@@ -1000,6 +1148,14 @@ rbffi_AbstractMemory_Init(VALUE moduleFFI)
     rb_define_method(classMemory, "read_array_of_double", memory_read_array_of_float64, 1);
     rb_define_alias(classMemory, "put_array_of_double", "put_array_of_float64");
     rb_define_alias(classMemory, "get_array_of_double", "get_array_of_float64");
+    rb_define_alias(classMemory, "put_packed_array_of_float", "put_packed_array_of_float32");
+    rb_define_alias(classMemory, "get_packed_array_of_float", "get_packed_array_of_float32");
+    rb_define_alias(classMemory, "write_packed_array_of_float", "write_packed_array_of_float32");
+    rb_define_alias(classMemory, "read_packed_array_of_float", "read_packed_array_of_float32");
+    rb_define_alias(classMemory, "put_packed_array_of_double", "put_packed_array_of_float64");
+    rb_define_alias(classMemory, "get_packed_array_of_double", "get_packed_array_of_float64");
+    rb_define_alias(classMemory, "write_packed_array_of_double", "write_packed_array_of_float64");
+    rb_define_alias(classMemory, "read_packed_array_of_double", "read_packed_array_of_float64");
     /*
      * Document-method: put_pointer
      * call-seq: memory.put_pointer(offset, value)
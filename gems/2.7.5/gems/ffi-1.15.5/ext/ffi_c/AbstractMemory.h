@@ -51,6 +51,8 @@ extern "C" {
 #define MEM_CODE 0x04
 #define MEM_SWAP 0x08
 #define MEM_EMBED 0x10
+#define MEM_ARENA 0x20 /* owned by a MemoryPointer.scope arena */
+#define MEM_BORROW 0x40 /* borrowed from a string by a Pointer.borrow block */
 
 typedef struct AbstractMemory_ AbstractMemory;
 
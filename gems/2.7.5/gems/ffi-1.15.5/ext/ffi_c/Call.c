@@ -37,6 +37,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <time.h>
 #include <ruby.h>
 #include <ruby/thread.h>
 #if defined(HAVE_NATIVETHREAD) && !defined(_WIN32)
@@ -82,7 +83,7 @@
 #endif
 
 static void* callback_param(VALUE proc, VALUE cbinfo);
-static inline void* getPointer(VALUE value, int type);
+static inline void* getPointer(VALUE* value, int type);
 
 static ID id_to_ptr, id_map_symbol, id_to_native;
 
@@ -304,7 +305,7 @@ rbffi_SetupCallParams(int argc, VALUE* argv, int paramCount, Type** paramTypes,
             case NATIVE_BUFFER_IN:
             case NATIVE_BUFFER_OUT:
             case NATIVE_BUFFER_INOUT:
-                param->ptr = getPointer(argv[argidx++], type);
+                param->ptr = getPointer(&argv[argidx++], type);
                 ADJ(param, ADDRESS);
                 break;
 
@@ -320,7 +321,7 @@ rbffi_SetupCallParams(int argc, VALUE* argv, int paramCount, Type** paramTypes,
                 break;
 
             case NATIVE_STRUCT:
-                ffiValues[i] = getPointer(argv[argidx++], type);
+                ffiValues[i] = getPointer(&argv[argidx++], type);
                 break;
 
             default:
@@ -329,11 +330,115 @@ rbffi_SetupCallParams(int argc, VALUE* argv, int paramCount, Type** paramTypes,
     }
 }
 
+/*
+ * Blocking functions declared with blocking: :adaptive whose calls take less
+ * than this many nanoseconds on average are called without releasing the
+ * GVL, as releasing and reacquiring it would take longer than the call.
+ */
+#define ADAPTIVE_BLOCKING_NANOS (10000)
+
+static inline uint64_t
+monotonic_nanos(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+bool rbffi_blocking_timing = false;
+
+/*
+ * Whether the calls of a blocking function are timed.  Those of adaptive
+ * functions always are, as the timings decide whether to release the GVL;
+ * others only while FFI::Function.blocking_timing is set, as reading the
+ * clock twice costs about as much as a short call.
+ */
+static inline bool
+time_blocking_call(FunctionType* fnInfo)
+{
+#ifdef CLOCK_MONOTONIC
+    return fnInfo->adaptiveBlocking || rbffi_blocking_timing;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Whether the next call of a blocking function should release the GVL.
+ * Adaptive functions release it on their first call, and afterwards only
+ * while their calls have been taking long.  Without a clock to tell, they
+ * always do.
+ */
+static inline bool
+release_gvl(FunctionType* fnInfo)
+{
+#ifdef CLOCK_MONOTONIC
+    return !fnInfo->adaptiveBlocking || fnInfo->blockingStats.timed == 0
+        || fnInfo->blockingStats.nanos >= ADAPTIVE_BLOCKING_NANOS;
+#else
+    return true;
+#endif
+}
+
+/*
+ * Add count calls of a blocking function to its statistics.  If they were
+ * timed, nanos is how long they took on average, and goes into the moving
+ * average as one call would.
+ */
+void
+rbffi_record_blocking_calls(rbffi_blocking_stats_t* stats, unsigned long long count, bool released,
+        bool timed, uint64_t nanos)
+{
+    if (count == 0) {
+        return;
+    }
+    stats->calls += count;
+    if (released) {
+        stats->released += count;
+    }
+    if (timed) {
+        if (stats->timed == 0) {
+            stats->nanos = nanos;
+        } else {
+            stats->nanos = stats->nanos - stats->nanos / 8 + nanos / 8;
+        }
+        stats->timed += count;
+    }
+}
+
+/*
+ * The statistics as FFI::Function#blocking_stats returns them.
+ */
+VALUE
+rbffi_blocking_stats_hash(const rbffi_blocking_stats_t* stats)
+{
+    VALUE hash = rb_hash_new();
+
+    rb_hash_aset(hash, ID2SYM(rb_intern("calls")), ULL2NUM(stats->calls));
+    rb_hash_aset(hash, ID2SYM(rb_intern("released")), ULL2NUM(stats->released));
+    rb_hash_aset(hash, ID2SYM(rb_intern("average_ns")), stats->timed > 0 ? ULL2NUM(stats->nanos) : Qnil);
+
+    return hash;
+}
+
 static void *
 call_blocking_function(void* data)
 {
     rbffi_blocking_call_t* b = (rbffi_blocking_call_t *) data;
-    ffi_call(&b->cif, FFI_FN(b->function), b->retval, b->ffiValues);
+
+    if (b->timed) {
+        uint64_t start = monotonic_nanos();
+
+        ffi_call(b->cif, FFI_FN(b->function), b->retval, b->ffiValues);
+        b->nanos = monotonic_nanos() - start;
+    } else {
+        ffi_call(b->cif, FFI_FN(b->function), b->retval, b->ffiValues);
+    }
 
     return NULL;
 }
@@ -367,26 +472,35 @@ rbffi_CallFunction(int argc, VALUE* argv, void* function, FunctionType* fnInfo)
 
     if (unlikely(fnInfo->blocking)) {
         rbffi_blocking_call_t* bc;
+        bool release = release_gvl(fnInfo);
 
         /* allocate information passed to the blocking function on the stack */
         ffiValues = ALLOCA_N(void *, fnInfo->parameterCount);
         params = ALLOCA_N(FFIStorage, fnInfo->parameterCount);
         bc = ALLOCA_N(rbffi_blocking_call_t, 1);
         bc->retval = retval;
-        bc->cif = fnInfo->ffi_cif;
+        bc->cif = &fnInfo->ffi_cif;
         bc->function = function;
         bc->ffiValues = ffiValues;
         bc->params = params;
         bc->frame = &frame;
+        bc->timed = time_blocking_call(fnInfo);
+        bc->nanos = 0;
 
         rbffi_SetupCallParams(argc, argv,
             fnInfo->parameterCount, fnInfo->parameterTypes, params, ffiValues,
             fnInfo->callbackParameters, fnInfo->callbackCount, fnInfo->rbEnums);
 
         rbffi_frame_push(&frame);
-        rb_rescue2(rbffi_do_blocking_call, (VALUE) bc, rbffi_save_frame_exception, (VALUE) &frame, rb_eException, (VALUE) 0);
+        if (likely(release)) {
+            rb_rescue2(rbffi_do_blocking_call, (VALUE) bc, rbffi_save_frame_exception, (VALUE) &frame, rb_eException, (VALUE) 0);
+        } else {
+            call_blocking_function(bc);
+        }
         rbffi_frame_pop(&frame);
 
+        rbffi_record_blocking_calls(&fnInfo->blockingStats, 1, release, bc->timed, bc->nanos);
+
     } else {
 
         ffiValues = ALLOCA_N(void *, fnInfo->parameterCount);
@@ -415,9 +529,176 @@ rbffi_CallFunction(int argc, VALUE* argv, void* function, FunctionType* fnInfo)
     return rbReturnValue;
 }
 
+/*
+ * A batch of calls prepared by rbffi_CallFunctionMany: call i takes its
+ * arguments from ffiValues[i * paramCount] and returns into
+ * retvals[i * retvalSize].
+ */
+typedef struct CallMany_ {
+    rbffi_frame_t* frame;
+    void* function;
+    ffi_cif* cif;
+    void** ffiValues;
+    char* retvals;
+    size_t retvalSize;
+    int paramCount;
+    long count;
+    long made; /* Calls made */
+    bool timed;
+    uint64_t nanos; /* How long they took together, if timed */
+} CallMany;
+
+static void*
+call_many(void* data)
+{
+    CallMany* m = (CallMany *) data;
+    uint64_t start = m->timed ? monotonic_nanos() : 0;
+    long i;
+
+    /* Stop at the first call whose callback raised */
+    for (i = 0; i < m->count && !RTEST(m->frame->exc); ++i) {
+        ffi_call(m->cif, FFI_FN(m->function), m->retvals + i * m->retvalSize,
+            m->ffiValues + i * m->paramCount);
+    }
+    m->made = i;
+    if (m->timed) {
+        m->nanos = monotonic_nanos() - start;
+    }
+
+    return NULL;
+}
+
+static VALUE
+call_many_blocking(VALUE data)
+{
+    rb_thread_call_without_gvl(call_many, (void *) data, (rb_unblock_function_t *) -1, NULL);
+
+    return Qnil;
+}
+
+VALUE
+rbffi_CallFunctionMany(VALUE rbArgs, VALUE rbResult, void* function, FunctionType* fnInfo)
+{
+    CallMany m;
+    FFIStorage* params;
+    AbstractMemory* result = NULL;
+    VALUE* argv;
+    VALUE rbReturnValue, keep, vparams, vffiValues, vretvals;
+    ffi_type* rtype = fnInfo->ffi_cif.rtype;
+    size_t align, size = fnInfo->returnType->nativeType == NATIVE_VOID ? 0 : rtype->size, offset = 0;
+    rbffi_frame_t frame = { 0 };
+    long i;
+
+    Check_Type(rbArgs, T_ARRAY);
+
+    m.count = RARRAY_LEN(rbArgs);
+    m.paramCount = fnInfo->parameterCount;
+    m.function = function;
+    m.cif = &fnInfo->ffi_cif;
+    m.frame = &frame;
+    m.made = 0;
+    m.timed = fnInfo->blocking && time_blocking_call(fnInfo);
+    m.nanos = 0;
+
+    /* Each return value gets a slot big enough for what ffi_call writes */
+    align = MAX(rtype->alignment, FFI_SIZEOF_ARG);
+    m.retvalSize = (MAX(rtype->size, FFI_SIZEOF_ARG) + align - 1) / align * align;
+
+    if (rbResult != Qnil) {
+        result = rbffi_AbstractMemory_Cast(rbResult, rbffi_AbstractMemoryClass);
+        checkWrite(result);
+        if (m.count > 0 && size > 0) {
+            checkBounds(result, 0, m.count * size);
+        }
+#ifdef WORDS_BIGENDIAN
+        /* Integers narrower than a register are returned in the low end of one */
+        if (size < sizeof(ffi_arg) && rtype->type != FFI_TYPE_FLOAT && rtype->type != FFI_TYPE_STRUCT) {
+            offset = sizeof(ffi_arg) - size;
+        }
+#endif
+    }
+
+    params = ALLOCV_N(FFIStorage, vparams, m.count * m.paramCount);
+    m.ffiValues = ALLOCV_N(void *, vffiValues, m.count * m.paramCount);
+    m.retvals = ALLOCV_N(char, vretvals, m.count * m.retvalSize);
+    argv = ALLOCA_N(VALUE, m.paramCount);
+    keep = rb_ary_new_capa(m.count * m.paramCount);
+
+    /* Convert every argument list before making any of the calls */
+    for (i = 0; i < m.count; ++i) {
+        VALUE rbCallArgs = rb_ary_entry(rbArgs, i);
+        int argc;
+
+        Check_Type(rbCallArgs, T_ARRAY);
+        argc = (int) RARRAY_LEN(rbCallArgs);
+        if (argc > m.paramCount) {
+            rb_raise(rb_eArgError, "wrong number of arguments (%d for %d)", argc, m.paramCount);
+        }
+        MEMCPY(argv, RARRAY_CONST_PTR(rbCallArgs), VALUE, argc);
+
+        rbffi_SetupCallParams(argc, argv,
+            m.paramCount, fnInfo->parameterTypes, params + i * m.paramCount, m.ffiValues + i * m.paramCount,
+            fnInfo->callbackParameters, fnInfo->callbackCount, fnInfo->rbEnums);
+
+        /*
+         * Converted arguments (including what #to_native and #to_ptr returned, which
+         * rbffi_SetupCallParams leaves in argv) must outlive the calls, as the native
+         * values may point into them
+         */
+        rb_ary_cat(keep, argv, argc);
+    }
+
+    rbffi_frame_push(&frame);
+    if (unlikely(fnInfo->blocking)) {
+        /* The whole batch runs without the GVL, whatever the function's mode */
+        rb_rescue2(call_many_blocking, (VALUE) &m, rbffi_save_frame_exception, (VALUE) &frame, rb_eException, (VALUE) 0);
+        rbffi_record_blocking_calls(&fnInfo->blockingStats, m.made, true, m.timed,
+            m.made > 0 ? m.nanos / m.made : 0);
+    } else {
+        call_many(&m);
+    }
+    rbffi_frame_pop(&frame);
+
+    if (unlikely(!fnInfo->ignoreErrno)) {
+        rbffi_save_errno();
+    }
+
+    if (RTEST(frame.exc) && frame.exc != Qnil) {
+        rb_exc_raise(frame.exc);
+    }
+
+    if (result != NULL) {
+        for (i = 0; i < m.count; ++i) {
+            memcpy(result->address + i * size, m.retvals + i * m.retvalSize + offset, size);
+        }
+        rbReturnValue = rbResult;
+
+    } else {
+        rbReturnValue = rb_ary_new_capa(m.count);
+        for (i = 0; i < m.count; ++i) {
+            rb_ary_push(rbReturnValue,
+                rbffi_NativeValue_ToRuby(fnInfo->returnType, fnInfo->rbReturnType, m.retvals + i * m.retvalSize));
+        }
+    }
+
+    ALLOCV_END(vparams);
+    ALLOCV_END(vffiValues);
+    ALLOCV_END(vretvals);
+    RB_GC_GUARD(keep);
+    RB_GC_GUARD(fnInfo->rbReturnType);
+
+    return rbReturnValue;
+}
+
+/*
+ * Where +value+ is converted with #to_ptr, it is replaced by the result, so
+ * that whoever holds the arguments also keeps the memory they point to.
+ */
 static inline void*
-getPointer(VALUE value, int type)
+getPointer(VALUE* rbValue, int type)
 {
+    VALUE value = *rbValue;
+
     if (likely(type == T_DATA && rb_obj_is_kind_of(value, rbffi_AbstractMemoryClass))) {
 
         return ((AbstractMemory *) DATA_PTR(value))->address;
@@ -439,6 +720,7 @@ getPointer(VALUE value, int type)
 
         VALUE ptr = rb_funcall2(value, id_to_ptr, 0, NULL);
         if (rb_obj_is_kind_of(ptr, rbffi_AbstractMemoryClass) && TYPE(ptr) == T_DATA) {
+            *rbValue = ptr;
             return ((AbstractMemory *) DATA_PTR(ptr))->address;
         }
         rb_raise(rb_eArgError, "to_ptr returned an invalid pointer");
@@ -448,9 +730,171 @@ getPointer(VALUE value, int type)
     return NULL;
 }
 
+#ifdef BYPASS_FFI
+
+/* Maximum number of parameters a function can have to be called directly. */
+#define DIRECT_MAX_ARITY (6)
+
+/*
+ * The native type a parameter or return value is passed as.
+ */
+static inline NativeType
+direct_type(Type* type)
+{
+    return type->nativeType == NATIVE_MAPPED ? ((MappedType *) type)->type->nativeType : type->nativeType;
+}
+
+/*
+ * Whether values of this type are passed and returned in one integer
+ * register (or stack slot) and so can be passed to the function as-is.
+ */
+static bool
+direct_type_ok(Type* type)
+{
+    switch (direct_type(type)) {
+        case NATIVE_INT8:
+        case NATIVE_UINT8:
+        case NATIVE_INT16:
+        case NATIVE_UINT16:
+        case NATIVE_INT32:
+        case NATIVE_UINT32:
+        case NATIVE_INT64:
+        case NATIVE_UINT64:
+        case NATIVE_LONG:
+        case NATIVE_ULONG:
+        case NATIVE_BOOL:
+        case NATIVE_STRING:
+        case NATIVE_POINTER:
+        case NATIVE_BUFFER_IN:
+        case NATIVE_BUFFER_OUT:
+        case NATIVE_BUFFER_INOUT:
+        case NATIVE_FUNCTION:
+            return type->ffiType->size <= sizeof(ffi_sarg);
+
+        default:
+            return false;
+    }
+}
+
+/*
+ * Widen a parameter converted by rbffi_SetupCallParams to a whole register,
+ * sign or zero extending it as the C caller would.
+ */
+static inline ffi_sarg
+direct_arg(Type* type, FFIStorage* param)
+{
+    switch (direct_type(type)) {
+        case NATIVE_INT8:
+        case NATIVE_BOOL:
+            return param->s8;
+        case NATIVE_UINT8:
+            return param->u8;
+        case NATIVE_INT16:
+            return param->s16;
+        case NATIVE_UINT16:
+            return param->u16;
+        case NATIVE_INT32:
+            return param->s32;
+        case NATIVE_UINT32:
+            return param->u32;
+        case NATIVE_LONG:
+            return *(ffi_sarg *) param;
+        case NATIVE_ULONG:
+            return *(ffi_arg *) param;
+        case NATIVE_INT64:
+            return (ffi_sarg) param->i64;
+        case NATIVE_UINT64:
+            return (ffi_sarg) param->u64;
+        default:
+            return (ffi_sarg) (uintptr_t) param->ptr;
+    }
+}
+
+/*
+ * Invoker for functions whose parameters and return value all fit in an
+ * integer register: the arguments are converted as usual, but the function
+ * is called straight through a pointer of the right arity rather than by
+ * ffi_call.  The return value lands in a register-sized slot, which is what
+ * rbffi_NativeValue_ToRuby expects from libffi too.
+ */
+static VALUE
+direct_call(int argc, VALUE* argv, void* function, FunctionType* fnInfo)
+{
+    FFIStorage params[DIRECT_MAX_ARITY];
+    void* ffiValues[DIRECT_MAX_ARITY];
+    ffi_sarg a[DIRECT_MAX_ARITY], retval = 0;
+    VALUE rbReturnValue;
+    rbffi_frame_t frame = { 0 };
+    int i;
+
+    rbffi_SetupCallParams(argc, argv,
+        fnInfo->parameterCount, fnInfo->parameterTypes, params, ffiValues,
+        fnInfo->callbackParameters, fnInfo->callbackCount, fnInfo->rbEnums);
+
+    for (i = 0; i < fnInfo->parameterCount; ++i) {
+        a[i] = direct_arg(fnInfo->parameterTypes[i], ffiValues[i]);
+    }
+
+    rbffi_frame_push(&frame);
+    switch (fnInfo->parameterCount) {
+        case 0:
+            retval = ((ffi_sarg (*)(void)) function)();
+            break;
+        case 1:
+            retval = ((ffi_sarg (*)(ffi_sarg)) function)(a[0]);
+            break;
+        case 2:
+            retval = ((ffi_sarg (*)(ffi_sarg, ffi_sarg)) function)(a[0], a[1]);
+            break;
+        case 3:
+            retval = ((ffi_sarg (*)(ffi_sarg, ffi_sarg, ffi_sarg)) function)(a[0], a[1], a[2]);
+            break;
+        case 4:
+            retval = ((ffi_sarg (*)(ffi_sarg, ffi_sarg, ffi_sarg, ffi_sarg)) function)(a[0], a[1], a[2], a[3]);
+            break;
+        case 5:
+            retval = ((ffi_sarg (*)(ffi_sarg, ffi_sarg, ffi_sarg, ffi_sarg, ffi_sarg)) function)(a[0], a[1], a[2], a[3], a[4]);
+            break;
+        case 6:
+            retval = ((ffi_sarg (*)(ffi_sarg, ffi_sarg, ffi_sarg, ffi_sarg, ffi_sarg, ffi_sarg)) function)(a[0], a[1], a[2], a[3], a[4], a[5]);
+            break;
+    }
+    rbffi_frame_pop(&frame);
+
+    if (unlikely(!fnInfo->ignoreErrno)) {
+        rbffi_save_errno();
+    }
+
+    if (RTEST(frame.exc) && frame.exc != Qnil) {
+        rb_exc_raise(frame.exc);
+    }
+
+    RB_GC_GUARD(rbReturnValue) = rbffi_NativeValue_ToRuby(fnInfo->returnType, fnInfo->rbReturnType, &retval);
+    RB_GC_GUARD(fnInfo->rbReturnType);
+
+    return rbReturnValue;
+}
+
+#endif /* BYPASS_FFI */
+
 Invoker
 rbffi_GetInvoker(FunctionType *fnInfo)
 {
+#ifdef BYPASS_FFI
+    bool direct = !fnInfo->blocking && !fnInfo->hasStruct && fnInfo->abi == FFI_DEFAULT_ABI
+        && fnInfo->parameterCount <= DIRECT_MAX_ARITY
+        && (direct_type(fnInfo->returnType) == NATIVE_VOID || direct_type_ok(fnInfo->returnType));
+    int i;
+
+    for (i = 0; direct && i < fnInfo->parameterCount; ++i) {
+        direct = direct_type_ok(fnInfo->parameterTypes[i]);
+    }
+
+    if (direct) {
+        return direct_call;
+    }
+#endif
+
     return rbffi_CallFunction;
 }
 
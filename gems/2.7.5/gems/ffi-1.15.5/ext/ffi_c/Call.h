@@ -79,6 +79,7 @@ extern void rbffi_SetupCallParams(int argc, VALUE* argv, int paramCount, Type**
 
 struct FunctionType_;
 extern VALUE rbffi_CallFunction(int argc, VALUE* argv, void* function, struct FunctionType_* fnInfo);
+extern VALUE rbffi_CallFunctionMany(VALUE rbArgs, VALUE rbResult, void* function, struct FunctionType_* fnInfo);
 
 typedef VALUE (*Invoker)(int argc, VALUE* argv, void* function, struct FunctionType_* fnInfo);
 
@@ -90,14 +91,30 @@ extern int rbffi_GetSignedIntValue(VALUE value, int type, int minValue, int maxV
 typedef struct rbffi_blocking_call {
     rbffi_frame_t* frame;
     void* function;
-    ffi_cif cif;
+    ffi_cif* cif;
     void **ffiValues;
     void* retval;
     void* params;
+    bool timed; /* Whether to measure nanos */
+    uint64_t nanos; /* How long the function ran for */
 } rbffi_blocking_call_t;
 
+/* Statistics of the calls of a blocking function */
+typedef struct rbffi_blocking_stats {
+    unsigned long long calls;
+    unsigned long long released; /* Calls made without the GVL */
+    unsigned long long timed; /* Calls whose duration was measured */
+    uint64_t nanos; /* Moving average of the duration of the last 8 or so timed calls */
+} rbffi_blocking_stats_t;
+
+/* Whether blocking calls are timed even if not adaptive; see FFI::Function.blocking_timing */
+extern bool rbffi_blocking_timing;
+
 VALUE rbffi_do_blocking_call(VALUE data);
 VALUE rbffi_save_frame_exception(VALUE data, VALUE exc);
+void rbffi_record_blocking_calls(rbffi_blocking_stats_t* stats, unsigned long long count, bool released,
+        bool timed, uint64_t nanos);
+VALUE rbffi_blocking_stats_hash(const rbffi_blocking_stats_t* stats);
 
 #ifdef	__cplusplus
 }
@@ -33,6 +33,9 @@
 #if defined(__CYGWIN__) || !defined(_WIN32)
 #  include <sys/mman.h>
 #endif
+#if defined(__linux__)
+#  include <sys/syscall.h>
+#endif
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -62,9 +65,27 @@
 #  define roundup(x, y)   ((((x)+((y)-1))/(y))*(y))
 #endif
 
+/* Most pages of trampolines allocated at once; each block is twice the last */
+#define MAX_BLOCK_PAGES (16)
+
+#if defined(__linux__) && defined(SYS_memfd_create) && !USE_FFI_ALLOC
+#  define USE_DUAL_MAPPING 1
+#  include <pthread.h>
+#  ifndef MFD_CLOEXEC
+#    define MFD_CLOEXEC (1U)
+#  endif
+#  ifndef MAP_NORESERVE
+#    define MAP_NORESERVE (0)
+#  endif
+#endif
+
 typedef struct Memory {
     void* code;
     void* data;
+    size_t size;
+    int fd; /* The file the code is mapped from, or -1 if it has pages of its own */
+    off_t offset; /* Where in fd */
+    unsigned long epoch;
     struct Memory* next;
 } Memory;
 
@@ -75,13 +96,15 @@ struct ClosurePool_ {
     struct Memory* blocks; /* Keeps track of all the allocated memory for this pool */
     Closure* list;
     long refcnt;
+    int blockPages; /* Size of the next block */
 };
 
 static long pageSize;
 
-static void* allocatePage(void);
-static bool freePage(void *);
-static bool protectPage(void *);
+static bool allocateCode(Memory* block);
+static void* writableCode(Memory* block);
+static bool finishCode(Memory* block, void* writable);
+static void releaseCode(Memory* block);
 
 ClosurePool*
 rbffi_ClosurePool_New(int closureSize,
@@ -95,6 +118,7 @@ rbffi_ClosurePool_New(int closureSize,
     pool->ctx = ctx;
     pool->prep = prep;
     pool->refcnt = 1;
+    pool->blockPages = 1;
 
     return pool;
 }
@@ -107,7 +131,7 @@ cleanup_closure_pool(ClosurePool* pool)
     for (memory = pool->blocks; memory != NULL; ) {
         Memory* next = memory->next;
 #if !USE_FFI_ALLOC
-        freePage(memory->code);
+        releaseCode(memory);
 #else
         ffi_closure_free(memory->code);
 #endif
@@ -129,6 +153,22 @@ rbffi_ClosurePool_Free(ClosurePool* pool)
     }
 }
 
+/*
+ * Reuse a closure freed earlier, if there is one.
+ */
+static Closure*
+reuseClosure(ClosurePool* pool)
+{
+    Closure* closure = pool->list;
+
+    if (closure != NULL) {
+        pool->list = closure->next;
+        pool->refcnt++;
+    }
+
+    return closure;
+}
+
 #if !USE_FFI_ALLOC
 
 Closure*
@@ -136,27 +176,34 @@ rbffi_Closure_Alloc(ClosurePool* pool)
 {
     Closure *list = NULL;
     Memory* block = NULL;
-    void *code = NULL;
+    void *writable = NULL;
+    bool allocated = false;
     char errmsg[256];
     int nclosures;
     long trampolineSize;
+    size_t size;
     int i;
 
-    if (pool->list != NULL) {
-        Closure* closure = pool->list;
-        pool->list = pool->list->next;
-        pool->refcnt++;
-
-        return closure;
+    if ((list = reuseClosure(pool)) != NULL) {
+        return list;
     }
 
+    /*
+     * Pools which keep running out get bigger blocks, so that callback heavy
+     * code doesn't map and protect memory one page at a time.
+     */
     trampolineSize = roundup(pool->closureSize, 8);
-    nclosures = (int) (pageSize / trampolineSize);
+    size = (size_t) pool->blockPages * pageSize;
+    nclosures = (int) (size / trampolineSize);
     block = calloc(1, sizeof(*block));
     list = calloc(nclosures, sizeof(*list));
-    code = allocatePage();
 
-    if (block == NULL || list == NULL || code == NULL) {
+    if (block == NULL || list == NULL) {
+        snprintf(errmsg, sizeof(errmsg), "failed to allocate a page. errno=%d (%s)", errno, strerror(errno));
+        goto error;
+    }
+    block->size = size;
+    if (!(allocated = allocateCode(block)) || (writable = writableCode(block)) == NULL) {
         snprintf(errmsg, sizeof(errmsg), "failed to allocate a page. errno=%d (%s)", errno, strerror(errno));
         goto error;
     }
@@ -165,23 +212,28 @@ rbffi_Closure_Alloc(ClosurePool* pool)
         Closure* closure = &list[i];
         closure->next = &list[i + 1];
         closure->pool = pool;
-        closure->code = ((char *)code + (i * trampolineSize));
-        closure->pcl  = closure->code;
+        closure->code = ((char *)block->code + (i * trampolineSize));
+        closure->pcl  = ((char *)writable + (i * trampolineSize));
 
         if (!(*pool->prep)(pool->ctx, closure->code, closure, errmsg, sizeof(errmsg))) {
             goto error;
         }
+        closure->pcl = closure->code;
     }
 
-    if (!protectPage(code)) {
+    if (!finishCode(block, writable)) {
+        writable = NULL;
+        snprintf(errmsg, sizeof(errmsg), "failed to protect a page. errno=%d (%s)", errno, strerror(errno));
         goto error;
     }
 
     /* Track the allocated page + Closure memory area */
     block->data = list;
-    block->code = code;
     block->next = pool->blocks;
     pool->blocks = block;
+    if (pool->blockPages < MAX_BLOCK_PAGES) {
+        pool->blockPages *= 2;
+    }
 
     /* Thread the new block onto the free list, apart from the first one. */
     list[nclosures - 1].next = pool->list;
@@ -192,11 +244,16 @@ rbffi_Closure_Alloc(ClosurePool* pool)
     return list;
 
 error:
+#ifdef USE_DUAL_MAPPING
+    if (writable != NULL && block->fd >= 0) {
+        munmap(writable, size);
+    }
+#endif
+    if (allocated) {
+        releaseCode(block);
+    }
     free(block);
     free(list);
-    if (code != NULL) {
-        freePage(code);
-    }
 
 
     rb_raise(rb_eRuntimeError, "%s", errmsg);
@@ -214,6 +271,10 @@ rbffi_Closure_Alloc(ClosurePool* pool)
     void *pcl = NULL;
     char errmsg[256];
 
+    if ((closure = reuseClosure(pool)) != NULL) {
+        return closure;
+    }
+
     block = calloc(1, sizeof(*block));
     closure = calloc(1, sizeof(*closure));
     pcl = ffi_closure_alloc(sizeof(ffi_closure), &code);
@@ -234,9 +295,9 @@ rbffi_Closure_Alloc(ClosurePool* pool)
     /* Track the allocated page + Closure memory area */
     block->data = closure;
     block->code = pcl;
+    block->next = pool->blocks;
     pool->blocks = block;
 
-    /* Thread the new block onto the free list, apart from the first one. */
     pool->refcnt++;
 
     return closure;
@@ -291,35 +352,275 @@ getPageSize()
 
 #if !USE_FFI_ALLOC
 
-static void*
-allocatePage(void)
+#ifdef USE_DUAL_MAPPING
+/*
+ * The trampolines of all pools are carved out of one memfd file, which is
+ * mapped read-exec into address space reserved for it up front.  A block is
+ * written through a second, read-write, mapping of its part of the file,
+ * which is unmapped as soon as its trampolines are prepared, so no page is
+ * ever writable and executable at the same address, nor writable at all
+ * once it is in use.  As the file grows the read-exec view is extended in
+ * place, so it stays a single mapping however many blocks are handed out.
+ */
+#define SLAB_RESERVE (64 * 1024 * 1024)
+/* Block sizes (1, 2, 4... MAX_BLOCK_PAGES pages) kept on free lists */
+#define SLAB_SIZES (5)
+
+static struct {
+    int fd;
+    bool failed;
+    char* code;
+    size_t mapped;
+    size_t used;
+    /*
+     * Bumped on fork: blocks handed out before then may still be in use by
+     * the other process, which shares the file, so they are never reused.
+     */
+    unsigned long epoch;
+    Memory* free[SLAB_SIZES];
+} slab = { -1 };
+
+static int
+slabIndex(size_t size)
+{
+    size_t pages = size / pageSize;
+    int i;
+
+    for (i = 0; i < SLAB_SIZES; ++i) {
+        if (pages == ((size_t) 1 << i) && size == pages * pageSize) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static bool
+slabCreate(void)
+{
+    int fd = (int) syscall(SYS_memfd_create, "ffi-closures", MFD_CLOEXEC);
+    void* code = MAP_FAILED;
+
+    if (fd >= 0) {
+        code = mmap(NULL, SLAB_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    }
+    if (code == MAP_FAILED) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    /*
+     * A full slab stays mapped for the trampolines in it, and open, as its
+     * freed blocks are written again when they are reused
+     */
+    slab.fd = fd;
+    slab.code = code;
+    slab.mapped = 0;
+    slab.used = 0;
+
+    return true;
+}
+
+static bool
+slabGrow(size_t needed)
+{
+    size_t mapped = MAX(slab.mapped * 2, (size_t) MAX_BLOCK_PAGES * pageSize);
+
+    mapped = MIN(MAX(mapped, needed), SLAB_RESERVE);
+
+    if (ftruncate(slab.fd, mapped) != 0
+            || mmap(slab.code + slab.mapped, mapped - slab.mapped, PROT_READ | PROT_EXEC,
+                MAP_SHARED | MAP_FIXED, slab.fd, slab.mapped) == MAP_FAILED) {
+        return false;
+    }
+    slab.mapped = mapped;
+
+    return true;
+}
+
+static bool
+slabAllocate(Memory* block)
+{
+    int i = slabIndex(block->size);
+
+    if (i >= 0 && slab.free[i] != NULL) {
+        Memory* freed = slab.free[i];
+
+        slab.free[i] = freed->next;
+        block->code = freed->code;
+        block->fd = freed->fd;
+        block->offset = freed->offset;
+        block->epoch = freed->epoch;
+        free(freed);
+
+        return true;
+    }
+
+    if (slab.failed || block->size > SLAB_RESERVE) {
+        return false;
+    }
+
+    if ((slab.fd < 0 || slab.used + block->size > SLAB_RESERVE) && !slabCreate()) {
+        slab.failed = true;
+        return false;
+    }
+
+    if (slab.used + block->size > slab.mapped && !slabGrow(slab.used + block->size)) {
+        /* e.g. no executable file mappings allowed; don't keep trying */
+        slab.failed = true;
+        return false;
+    }
+
+    block->code = slab.code + slab.used;
+    block->fd = slab.fd;
+    block->offset = (off_t) slab.used;
+    block->epoch = slab.epoch;
+    slab.used += block->size;
+
+    return true;
+}
+
+static void
+slabRelease(Memory* block)
+{
+    int i = slabIndex(block->size);
+    Memory* freed;
+
+    if (i < 0 || block->epoch != slab.epoch || (freed = malloc(sizeof(*freed))) == NULL) {
+        /* Leave the pages where they are; they're only address space and file */
+        return;
+    }
+
+    *freed = *block;
+    freed->data = NULL;
+    freed->next = slab.free[i];
+    slab.free[i] = freed;
+}
+
+static void
+slabAfterFork(void)
+{
+    int i;
+
+    slab.epoch++;
+    for (i = 0; i < SLAB_SIZES; ++i) {
+        while (slab.free[i] != NULL) {
+            Memory* next = slab.free[i]->next;
+            free(slab.free[i]);
+            slab.free[i] = next;
+        }
+    }
+}
+
+static void
+slabAfterForkChild(void)
+{
+    slabAfterFork();
+
+    /*
+     * The parent carries on allocating from the slab, so start a new one.
+     * Blocks of the old ones are never written again here.
+     */
+    if (slab.fd >= 0) {
+        close(slab.fd);
+        slab.fd = -1;
+    }
+}
+#endif /* USE_DUAL_MAPPING */
+
+/*
+ * Get block->size bytes for trampolines at block->code.  With dual mapping
+ * they come from the slab and are read-exec from the start; otherwise they
+ * are read-write pages of their own until finishCode.
+ */
+static bool
+allocateCode(Memory* block)
 {
+    block->fd = -1;
+    block->offset = 0;
+    block->epoch = 0;
+
 #if !defined(__CYGWIN__) && (defined(_WIN32) || defined(__WIN32__))
-    return VirtualAlloc(NULL, pageSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    block->code = VirtualAlloc(NULL, block->size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    return block->code != NULL;
 #else
-    void *page = mmap(NULL, pageSize, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
-    return (page != (void *) -1) ? page : NULL;
+    void* page;
+
+#ifdef USE_DUAL_MAPPING
+    if (slabAllocate(block)) {
+        return true;
+    }
+#endif
+
+    page = mmap(NULL, block->size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    block->code = (page != MAP_FAILED) ? page : NULL;
+
+    return block->code != NULL;
 #endif
 }
 
+/*
+ * Where to write the trampolines of a block until finishCode: a read-write
+ * view of the slab's file, or the code itself.
+ */
+static void*
+writableCode(Memory* block)
+{
+#ifdef USE_DUAL_MAPPING
+    if (block->fd >= 0) {
+        void* writable = mmap(NULL, block->size, PROT_READ | PROT_WRITE, MAP_SHARED, block->fd, block->offset);
+        return writable != MAP_FAILED ? writable : NULL;
+    }
+#endif
+    return block->code;
+}
+
+/*
+ * Make the trampolines written at writable executable at block->code and
+ * no longer writable.  The code may have run before, if the block was
+ * freed and handed out again, so stale instructions are flushed.
+ */
 static bool
-freePage(void *addr)
+finishCode(Memory* block, void* writable)
 {
+    bool ok;
+
 #if !defined(__CYGWIN__) && (defined(_WIN32) || defined(__WIN32__))
-    return VirtualFree(addr, 0, MEM_RELEASE);
+    DWORD oldProtect;
+    ok = VirtualProtect(block->code, block->size, PAGE_EXECUTE_READ, &oldProtect);
 #else
-    return munmap(addr, pageSize) == 0;
+    if (writable != block->code) {
+        /* Already read-exec at code; drop the writable view */
+        ok = munmap(writable, block->size) == 0;
+    } else {
+        ok = mprotect(block->code, block->size, PROT_READ | PROT_EXEC) == 0;
+    }
 #endif
+#if defined(__GNUC__)
+    __builtin___clear_cache((char *) block->code, (char *) block->code + block->size);
+#endif
+
+    return ok;
 }
 
-static bool
-protectPage(void* page)
+/*
+ * Give back trampolines from allocateCode.
+ */
+static void
+releaseCode(Memory* block)
 {
 #if !defined(__CYGWIN__) && (defined(_WIN32) || defined(__WIN32__))
-    DWORD oldProtect;
-    return VirtualProtect(page, pageSize, PAGE_EXECUTE_READ, &oldProtect);
+    VirtualFree(block->code, 0, MEM_RELEASE);
 #else
-    return mprotect(page, pageSize, PROT_READ | PROT_EXEC) == 0;
+#ifdef USE_DUAL_MAPPING
+    if (block->fd >= 0) {
+        slabRelease(block);
+        return;
+    }
+#endif
+    munmap(block->code, block->size);
 #endif
 }
 
@@ -329,5 +630,8 @@ void
 rbffi_ClosurePool_Init(VALUE module)
 {
     pageSize = getPageSize();
+#ifdef USE_DUAL_MAPPING
+    pthread_atfork(NULL, slabAfterFork, slabAfterForkChild);
+#endif
 }
 
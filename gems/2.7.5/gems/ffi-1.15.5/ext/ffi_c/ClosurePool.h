@@ -36,7 +36,7 @@ struct Closure_ {
     void* info;      /* opaque handle for storing closure-instance specific data */
     void* function;  /* closure-instance specific function, called by custom trampoline */
     void* code;      /* Executable address for the native trampoline code location */
-    void* pcl;       /* Writeable address for the native trampoline code location */
+    void* pcl;       /* Writeable address for the native trampoline code location, while it is prepared */
 
     struct ClosurePool_* pool;
     Closure* next;
@@ -39,6 +39,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 #include <ruby.h>
 #include <ruby/thread.h>
 
@@ -99,6 +100,10 @@ VALUE rbffi_FunctionClass = Qnil;
 
 #if defined(DEFER_ASYNC_CALLBACK)
 static VALUE async_cb_thread = Qnil;
+/* Callbacks for the idle runner threads, and how many of those to keep */
+static VALUE async_cb_queue = Qnil;
+static int async_cb_max_runners = 4;
+static ID id_push = 0, id_pop = 0, id_length = 0, id_num_waiting = 0;
 #endif
 
 static ID id_call = 0, id_to_native = 0, id_from_native = 0, id_cbtable = 0, id_cb_ref = 0;
@@ -288,6 +293,8 @@ after_fork_callback(void)
 {
     /* Ensure that a new dispatcher thread is started in a forked process */
     async_cb_thread = Qnil;
+    async_cb_queue = Qnil;
+    async_cb_list = NULL;
     pthread_mutex_init(&async_cb_mutex, NULL);
     pthread_cond_init(&async_cb_cond, NULL);
 }
@@ -365,6 +372,120 @@ function_call(int argc, VALUE* argv, VALUE self)
     return (*fn->info->invoke)(argc, argv, fn->base.memory.address, fn->info);
 }
 
+/*
+ * call-seq: call_many(args, result = nil)
+ * @param [Array<Array>] args list of argument lists, one per call
+ * @param [AbstractMemory] result memory to store the native return values in, one after another
+ * @return [Array, AbstractMemory] the return values, or +result+
+ * Call the function once for each argument list.  All the arguments are
+ * converted before the first call, and the calls are made in one go, without
+ * the GVL if the function is blocking.
+ */
+static VALUE
+function_call_many(int argc, VALUE* argv, VALUE self)
+{
+    Function* fn;
+    VALUE rbArgs = Qnil, rbResult = Qnil;
+
+    rb_scan_args(argc, argv, "11", &rbArgs, &rbResult);
+    Data_Get_Struct(self, Function, fn);
+
+    return rbffi_CallFunctionMany(rbArgs, rbResult, fn->base.memory.address, fn->info);
+}
+
+/*
+ * call-seq: blocking_stats
+ * @return [Hash] +:calls+, the number of calls made so far (including those of {#call_many}),
+ *  +:released+, how many of them released the GVL, and +:average_ns+, about how long the last few
+ *  timed ones took in nanoseconds, or +nil+ if none were timed
+ * Statistics of the calls of a function declared with +blocking: true+ or +blocking: :adaptive+.
+ * The calls of adaptive functions are always timed, those of others only while
+ * {Function.blocking_timing} is set.
+ */
+static VALUE
+function_blocking_stats(VALUE self)
+{
+    Function* fn;
+
+    Data_Get_Struct(self, Function, fn);
+
+    return rbffi_blocking_stats_hash(&fn->info->blockingStats);
+}
+
+/*
+ * call-seq: blocking_timing
+ * @return [Boolean]
+ * Whether the calls of all blocking functions are timed for {#blocking_stats}.
+ */
+static VALUE
+function_s_blocking_timing(VALUE klass)
+{
+    return rbffi_blocking_timing ? Qtrue : Qfalse;
+}
+
+/*
+ * call-seq: blocking_timing = enable
+ * @param [Boolean] enable
+ * @return [Boolean]
+ * Time the calls of all blocking functions, not only adaptive ones, so that
+ * {#blocking_stats} reports how long they take.  Off by default, as it reads
+ * the clock twice per call.  Has no effect where there's no monotonic clock.
+ */
+static VALUE
+function_s_set_blocking_timing(VALUE klass, VALUE enable)
+{
+#ifdef CLOCK_MONOTONIC
+    rbffi_blocking_timing = RTEST(enable);
+#endif
+
+    return enable;
+}
+
+#if defined(DEFER_ASYNC_CALLBACK)
+/*
+ * call-seq: callback_runners
+ * @return [Integer]
+ * Number of idle threads kept for running callbacks made from native threads.
+ */
+static VALUE
+function_s_callback_runners(VALUE klass)
+{
+    return INT2NUM(async_cb_max_runners);
+}
+
+/*
+ * call-seq: callback_runners = count
+ * @param [Integer] count
+ * @return [Integer]
+ * Set the number of idle threads kept for running callbacks made from native
+ * threads.  More are started while callbacks are waiting for them, and idle
+ * ones beyond the new count exit.
+ */
+static VALUE
+function_s_set_callback_runners(VALUE klass, VALUE count)
+{
+    int n = NUM2INT(count);
+    long surplus;
+
+    if (n < 0) {
+        rb_raise(rb_eArgError, "negative number of callback runners");
+    }
+    async_cb_max_runners = n;
+
+    /* Wake the idle runners which are no longer wanted; nil tells them to exit */
+    if (async_cb_queue != Qnil) {
+        surplus = NUM2LONG(rb_funcall2(async_cb_queue, id_num_waiting, 0, NULL))
+            - NUM2LONG(rb_funcall2(async_cb_queue, id_length, 0, NULL)) - n;
+        for (; surplus > 0; --surplus) {
+            VALUE stop = Qnil;
+            rb_funcall2(async_cb_queue, id_push, 1, &stop);
+        }
+    }
+
+    return count;
+}
+#endif
+
 /*
  * call-seq: attach(m, name)
  * @param [Module] m
@@ -486,14 +607,23 @@ callback_invoke(ffi_cif* cif, void* retval, void** parameters, void* user_data)
         pthread_mutex_init(&cb.async_mutex, NULL);
         pthread_cond_init(&cb.async_cond, NULL);
 
-        /* Now signal the async callback thread */
-        pthread_mutex_lock(&async_cb_mutex);
-        empty = async_cb_list == NULL;
-        cb.next = async_cb_list;
-        async_cb_list = &cb;
+        /*
+         * Push the callback without taking a lock.  The dispatcher takes the
+         * whole list at once, so it only needs waking if it was empty; doing
+         * that under the mutex means it can't miss the wakeup between finding
+         * the list empty and waiting.
+         */
+        cb.next = __atomic_load_n(&async_cb_list, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&async_cb_list, &cb.next, &cb, true,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        empty = cb.next == NULL;
 
-        pthread_cond_signal(&async_cb_cond);
-        pthread_mutex_unlock(&async_cb_mutex);
+        if (empty) {
+            pthread_mutex_lock(&async_cb_mutex);
+            pthread_cond_signal(&async_cb_cond);
+            pthread_mutex_unlock(&async_cb_mutex);
+        }
 
         /* Wait for the thread executing the ruby callback to signal it is done */
         pthread_mutex_lock(&cb.async_mutex);
@@ -534,26 +664,84 @@ struct async_wait {
 
 static void * async_cb_wait(void *);
 static void async_cb_stop(void *);
+static VALUE async_cb_runner(void *);
+
+/*
+ * Hand a callback to an idle runner thread, or start a new one if they are
+ * all busy: a callback may wait for another one, so none is ever queued
+ * behind a running callback.
+ */
+static void
+async_cb_dispatch(struct gvl_callback* cb)
+{
+    VALUE idle = rb_funcall2(async_cb_queue, id_num_waiting, 0, NULL);
+    VALUE pending = rb_funcall2(async_cb_queue, id_length, 0, NULL);
+
+    if (NUM2LONG(idle) > NUM2LONG(pending)) {
+        VALUE rbCallback = ULL2NUM((uintptr_t) cb);
+        rb_funcall2(async_cb_queue, id_push, 1, &rbCallback);
+    } else {
+        VALUE new_thread = rb_thread_create(async_cb_runner, cb);
+        /* Name thread, for better debugging */
+        rb_funcall(new_thread, rb_intern("name="), 1, rb_str_new2("FFI Callback Runner"));
+    }
+}
 
 static VALUE
 async_cb_event(void* unused)
 {
     struct async_wait w = { 0 };
 
+    async_cb_queue = rb_class_new_instance(0, NULL, rb_path2class("Thread::Queue"));
+
     w.stop = false;
     while (!w.stop) {
+        struct gvl_callback* list = NULL;
+        struct gvl_callback* cb;
+
         rb_thread_call_without_gvl(async_cb_wait, &w, async_cb_stop, &w);
-        if (w.cb != NULL) {
-            /* Start up a new ruby thread to run the ruby callback */
-            VALUE new_thread = rb_thread_create(async_cb_call, w.cb);
-            /* Name thread, for better debugging */
-            rb_funcall(new_thread, rb_intern("name="), 1, rb_str_new2("FFI Callback Runner"));
+
+        /* The callbacks were pushed on the front of the list; run them in order */
+        for (cb = w.cb; cb != NULL; ) {
+            struct gvl_callback* next = cb->next;
+            cb->next = list;
+            list = cb;
+            cb = next;
+        }
+
+        for (cb = list; cb != NULL; ) {
+            struct gvl_callback* next = cb->next;
+            async_cb_dispatch(cb);
+            cb = next;
         }
     }
 
     return Qnil;
 }
 
+/*
+ * Run callbacks until there are enough idle runners, or until told to stop
+ * because there are fewer wanted.
+ */
+static VALUE
+async_cb_runner(void* data)
+{
+    VALUE queue = async_cb_queue;
+    VALUE rbCallback;
+
+    async_cb_call(data);
+
+    while (NUM2INT(rb_funcall2(queue, id_num_waiting, 0, NULL)) < async_cb_max_runners) {
+        rbCallback = rb_funcall2(queue, id_pop, 0, NULL);
+        if (rbCallback == Qnil) {
+            break;
+        }
+        async_cb_call((void *) (uintptr_t) NUM2ULL(rbCallback));
+    }
+
+    return Qnil;
+}
+
 #ifdef _WIN32
 static void *
 async_cb_wait(void *data)
@@ -570,10 +758,8 @@ async_cb_wait(void *data)
         EnterCriticalSection(&async_cb_lock);
     }
 
-    if (async_cb_list != NULL) {
-        w->cb = async_cb_list;
-        async_cb_list = async_cb_list->next;
-    }
+    w->cb = async_cb_list;
+    async_cb_list = NULL;
 
     LeaveCriticalSection(&async_cb_lock);
 
@@ -601,14 +787,12 @@ async_cb_wait(void *data)
 
     pthread_mutex_lock(&async_cb_mutex);
 
-    while (!w->stop && async_cb_list == NULL) {
+    while (!w->stop && __atomic_load_n(&async_cb_list, __ATOMIC_ACQUIRE) == NULL) {
         pthread_cond_wait(&async_cb_cond, &async_cb_mutex);
     }
 
-    if (async_cb_list != NULL) {
-        w->cb = async_cb_list;
-        async_cb_list = async_cb_list->next;
-    }
+    /* Take every callback queued so far */
+    w->cb = __atomic_exchange_n(&async_cb_list, NULL, __ATOMIC_ACQUIRE);
 
     pthread_mutex_unlock(&async_cb_mutex);
 
@@ -888,6 +1072,10 @@ rbffi_Function_Init(VALUE moduleFFI)
     rb_define_method(rbffi_FunctionClass, "initialize", function_initialize, -1);
     rb_define_method(rbffi_FunctionClass, "initialize_copy", function_initialize_copy, 1);
     rb_define_method(rbffi_FunctionClass, "call", function_call, -1);
+    rb_define_method(rbffi_FunctionClass, "call_many", function_call_many, -1);
+    rb_define_method(rbffi_FunctionClass, "blocking_stats", function_blocking_stats, 0);
+    rb_define_singleton_method(rbffi_FunctionClass, "blocking_timing", function_s_blocking_timing, 0);
+    rb_define_singleton_method(rbffi_FunctionClass, "blocking_timing=", function_s_set_blocking_timing, 1);
     rb_define_method(rbffi_FunctionClass, "attach", function_attach, 2);
     rb_define_method(rbffi_FunctionClass, "free", function_release, 0);
     rb_define_method(rbffi_FunctionClass, "autorelease=", function_set_autorelease, 1);
@@ -910,6 +1098,15 @@ rbffi_Function_Init(VALUE moduleFFI)
     id_cb_ref = rb_intern("@__ffi_callback__");
     id_to_native = rb_intern("to_native");
     id_from_native = rb_intern("from_native");
+#if defined(DEFER_ASYNC_CALLBACK)
+    rb_define_singleton_method(rbffi_FunctionClass, "callback_runners", function_s_callback_runners, 0);
+    rb_define_singleton_method(rbffi_FunctionClass, "callback_runners=", function_s_set_callback_runners, 1);
+    rb_global_variable(&async_cb_queue);
+    id_push = rb_intern("push");
+    id_pop = rb_intern("pop");
+    id_length = rb_intern("length");
+    id_num_waiting = rb_intern("num_waiting");
+#endif
 #if defined(_WIN32)
     InitializeCriticalSection(&async_cb_lock);
     async_cb_cond = CreateEvent(NULL, FALSE, FALSE, NULL);
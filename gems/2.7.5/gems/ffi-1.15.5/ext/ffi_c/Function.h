@@ -65,7 +65,9 @@ struct FunctionType_ {
     VALUE rbEnums;
     bool ignoreErrno;
     bool blocking;
+    bool adaptiveBlocking;
     bool hasStruct;
+    rbffi_blocking_stats_t blockingStats;
 };
 
 extern VALUE rbffi_FunctionTypeClass, rbffi_FunctionClass;
@@ -102,7 +102,8 @@ fntype_free(FunctionType* fnInfo)
  * @param [Type, Symbol] return_type return type for the function
  * @param [Array<Type, Symbol>] param_types array of parameters types
  * @param [Hash] options
- * @option options [Boolean] :blocking set to true if the C function is a blocking call
+ * @option options [Boolean, Symbol] :blocking set to true if the C function is a blocking call, or to
+ *  :adaptive to release the GVL only while its calls take long on average
  * @option options [Symbol] :convention calling convention see {FFI::Library#calling_convention}
  * @option options [FFI::Enums] :enums
  * @return [self]
@@ -137,6 +138,7 @@ fntype_initialize(int argc, VALUE* argv, VALUE self)
     fnInfo->rbParameterTypes = rb_ary_new2(fnInfo->parameterCount);
     fnInfo->rbEnums = rbEnums;
     fnInfo->blocking = RTEST(rbBlocking);
+    fnInfo->adaptiveBlocking = rbBlocking == ID2SYM(rb_intern("adaptive"));
     fnInfo->hasStruct = false;
 
     for (i = 0; i < fnInfo->parameterCount; ++i) {
@@ -37,6 +37,10 @@
 #include "Pointer.h"
 #include "MemoryPointer.h"
 
+#if defined(HAVE_NATIVETHREAD) && !defined(_WIN32) && !defined(__WIN32__)
+# include <pthread.h>
+# define USE_PTHREAD_LOCAL
+#endif
 
 static VALUE memptr_allocate(VALUE klass);
 static void memptr_release(Pointer* ptr);
@@ -44,6 +48,7 @@ static VALUE memptr_malloc(VALUE self, long size, long count, bool clear);
 static VALUE memptr_free(VALUE self);
 
 VALUE rbffi_MemoryPointerClass;
+static VALUE ArenaClass = Qnil;
 
 #define MEMPTR(obj) ((MemoryPointer *) rbffi_AbstractMemory_Cast(obj, rbffi_MemoryPointerClass))
 
@@ -162,6 +167,325 @@ memptr_s_from_string(VALUE klass, VALUE to_str)
     return obj;
 }
 
+/* Size of the chunks an arena carves pointers out of, and how many a thread keeps */
+#define ARENA_CHUNK_SIZE (16 * 1024)
+#define ARENA_CACHE_CHUNKS 4
+
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    unsigned long size;
+    unsigned long used;
+    char data[];
+} ArenaChunk;
+
+/* Chunks left over from earlier scopes on a thread */
+typedef struct ArenaCache {
+    ArenaChunk* chunks;
+    int count;
+} ArenaCache;
+
+/* The pointers handed out by an arena, kept in its own chunks */
+#define ARENA_REFS 15
+
+typedef struct ArenaRefs {
+    struct ArenaRefs* next;
+    long count;
+    VALUE pointers[ARENA_REFS];
+} ArenaRefs;
+
+typedef struct Arena {
+    ArenaChunk* chunks;
+    ArenaRefs* refs;
+    bool active;
+} Arena;
+
+static char* arena_malloc(struct Arena* arena, unsigned long size);
+
+static void
+arena_chunks_free(ArenaChunk* chunk)
+{
+    while (chunk != NULL) {
+        ArenaChunk* next = chunk->next;
+        xfree(chunk);
+        chunk = next;
+    }
+}
+
+static void
+arena_cache_release(void* ptr)
+{
+    ArenaCache* cache = (ArenaCache *) ptr;
+
+    arena_chunks_free(cache->chunks);
+    xfree(cache);
+}
+
+#if defined(USE_PTHREAD_LOCAL)
+static pthread_key_t arenaCacheKey;
+
+static ArenaCache*
+arena_cache_get(void)
+{
+    ArenaCache* cache = pthread_getspecific(arenaCacheKey);
+
+    if (cache == NULL) {
+        cache = xcalloc(1, sizeof(ArenaCache));
+        pthread_setspecific(arenaCacheKey, cache);
+    }
+
+    return cache;
+}
+
+#else
+static ID id_arena_cache;
+
+static const rb_data_type_t arena_cache_data_type = {
+    "FFI::MemoryPointer::ArenaCache",
+    { NULL, arena_cache_release, NULL, },
+    NULL, NULL, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static ArenaCache*
+arena_cache_get(void)
+{
+    VALUE obj = rb_thread_local_aref(rb_thread_current(), id_arena_cache);
+    ArenaCache* cache;
+
+    /* The thread local is visible to Ruby code, so only trust what we put there */
+    if (rb_typeddata_is_kind_of(obj, &arena_cache_data_type)) {
+        return (ArenaCache *) DATA_PTR(obj);
+    }
+
+    obj = TypedData_Make_Struct(rb_cObject, ArenaCache, &arena_cache_data_type, cache);
+    rb_thread_local_aset(rb_thread_current(), id_arena_cache, obj);
+
+    return cache;
+}
+#endif
+
+static void
+arena_mark(Arena* arena)
+{
+    ArenaRefs* refs;
+
+    for (refs = arena->refs; refs != NULL; refs = refs->next) {
+        rb_gc_mark_locations(&refs->pointers[0], &refs->pointers[refs->count]);
+    }
+}
+
+static void
+arena_track(Arena* arena, VALUE rbPointer)
+{
+    ArenaRefs* refs = arena->refs;
+
+    if (refs == NULL || refs->count == ARENA_REFS) {
+        refs = (ArenaRefs *) arena_malloc(arena, sizeof(ArenaRefs));
+        refs->count = 0;
+        refs->next = arena->refs;
+        arena->refs = refs;
+    }
+
+    refs->pointers[refs->count++] = rbPointer;
+}
+
+static void
+arena_release(Arena* arena)
+{
+    arena_chunks_free(arena->chunks);
+    xfree(arena);
+}
+
+/* The pointers of an arena keep it as their parent */
+static void
+arena_pointer_mark(Pointer* p)
+{
+    rb_gc_mark(p->rbParent);
+}
+
+/*
+ * Track +rbPointer+, made from the arena pointer +rbSource+ (e.g. by Pointer#+), so it is
+ * invalidated along with it when the scope ends.
+ */
+void
+rbffi_MemoryPointer_ArenaAdopt(VALUE rbSource, VALUE rbPointer)
+{
+    Pointer* source;
+    Pointer* p;
+    Arena* arena;
+
+    Data_Get_Struct(rbSource, Pointer, source);
+    Data_Get_Struct(rbPointer, Pointer, p);
+    Data_Get_Struct(source->rbParent, Arena, arena);
+
+    p->rbParent = source->rbParent;
+    arena_track(arena, rbPointer);
+}
+
+static VALUE
+arena_allocate(VALUE klass)
+{
+    Arena* arena;
+    VALUE obj = Data_Make_Struct(klass, Arena, arena_mark, arena_release, arena);
+    arena->active = true;
+
+    return obj;
+}
+
+static char*
+arena_malloc(Arena* arena, unsigned long size)
+{
+    ArenaChunk* chunk = arena->chunks;
+    ArenaCache* cache;
+    char* address;
+
+    /* keep every pointer aligned on at least a 8 byte boundary */
+    size = (size + 7) & ~7UL;
+
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        cache = arena_cache_get();
+
+        if (size <= ARENA_CHUNK_SIZE && cache->chunks != NULL) {
+            chunk = cache->chunks;
+            cache->chunks = chunk->next;
+            cache->count--;
+
+        } else {
+            unsigned long csize = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+            chunk = xmalloc(sizeof(ArenaChunk) + csize);
+            chunk->size = csize;
+        }
+
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    address = chunk->data + chunk->used;
+    chunk->used += size;
+
+    return address;
+}
+
+/*
+ * call-seq: alloc(size, count=1, clear=true)
+ * @param [Fixnum, Bignum, Symbol, FFI::Type] size size of a memory cell (in bytes, or type whom size will be used)
+ * @param [Numeric] count number of cells in memory
+ * @param [Boolean] clear set memory to all-zero if +true+
+ * @return [MemoryPointer]
+ * A new {MemoryPointer} in the arena, valid until the end of the {MemoryPointer.scope} block.
+ */
+static VALUE
+arena_alloc(int argc, VALUE* argv, VALUE self)
+{
+    VALUE rbSize = Qnil, rbCount = Qnil, rbClear = Qnil, obj;
+    Arena* arena;
+    Pointer* p;
+    long size, count;
+    int nargs = rb_scan_args(argc, argv, "12", &rbSize, &rbCount, &rbClear);
+
+    Data_Get_Struct(self, Arena, arena);
+    if (!arena->active) {
+        rb_raise(rb_eRuntimeError, "arena is no longer in scope");
+    }
+
+    size = rbffi_type_size(rbSize);
+    count = nargs > 1 ? NUM2LONG(rbCount) : 1;
+    if (size < 0 || count < 0 || (count > 0 && size > LONG_MAX / count)) {
+        rb_raise(rb_eArgError, "invalid size");
+    }
+
+    /* The memory belongs to the arena, so the pointer has nothing to free */
+    obj = Data_Make_Struct(rbffi_MemoryPointerClass, Pointer, arena_pointer_mark, -1, p);
+    p->rbParent = self;
+    p->memory.flags = MEM_RD | MEM_WR | MEM_ARENA;
+    p->memory.typeSize = (int) size;
+    p->memory.size = size * count;
+    p->memory.address = arena_malloc(arena, p->memory.size);
+
+    if ((RTEST(rbClear) || rbClear == Qnil) && p->memory.size > 0) {
+        memset(p->memory.address, 0, p->memory.size);
+    }
+
+    arena_track(arena, obj);
+
+    return obj;
+}
+
+static VALUE
+arena_end(VALUE self)
+{
+    Arena* arena;
+    ArenaCache* cache;
+    ArenaRefs* refs;
+    long i;
+
+    Data_Get_Struct(self, Arena, arena);
+    arena->active = false;
+
+    /*
+     * Any pointer that escaped the block, including those made from them and the structs
+     * which use them, now raises instead of reading reused memory
+     */
+    for (refs = arena->refs; refs != NULL; refs = refs->next) {
+        for (i = 0; i < refs->count; i++) {
+            Pointer* p;
+
+            Data_Get_Struct(refs->pointers[i], Pointer, p);
+            p->memory.address = NULL;
+            p->memory.size = 0;
+            p->memory.flags = 0;
+        }
+    }
+    arena->refs = NULL;
+
+    cache = arena_cache_get();
+    while (arena->chunks != NULL) {
+        ArenaChunk* chunk = arena->chunks;
+
+        arena->chunks = chunk->next;
+        if (chunk->size == ARENA_CHUNK_SIZE && cache->count < ARENA_CACHE_CHUNKS) {
+            chunk->next = cache->chunks;
+            cache->chunks = chunk;
+            cache->count++;
+        } else {
+            xfree(chunk);
+        }
+    }
+
+    return Qnil;
+}
+
+/*
+ * call-seq: scope { |arena| ... }
+ * @yieldparam [Arena] arena where to allocate temporary memory
+ * @return the value of the block
+ * Run the block with an {Arena}, whose pointers are all freed together when the block returns.
+ *
+ * Pointers from an arena are carved out of chunks of memory that are reused by later scopes
+ * on the same thread, so a block with several short-lived arguments mallocs no buffer of its
+ * own. That is the only gain: creating the pointer objects dominates, and for a handful of
+ * pointers per block a scope is not measurably faster than {MemoryPointer.new}. Using them
+ * after the block, or pointers and structs made from them, raises {NullPointerError}; only
+ * raw addresses (e.g. from {Pointer#address}) escape this.
+ *
+ * @example
+ *  FFI::MemoryPointer.scope do |arena|
+ *    width, height = arena.alloc(:int), arena.alloc(:int)
+ *    get_size(window, width, height)
+ *    [width.read_int, height.read_int]
+ *  end
+ */
+static VALUE
+memptr_s_scope(VALUE klass)
+{
+    VALUE arena;
+
+    rb_need_block();
+    arena = arena_allocate(ArenaClass);
+
+    return rb_ensure(rb_yield, arena, arena_end, arena);
+}
+
 void
 rbffi_MemoryPointer_Init(VALUE moduleFFI)
 {
@@ -188,5 +512,21 @@ rbffi_MemoryPointer_Init(VALUE moduleFFI)
     rb_define_alloc_func(rbffi_MemoryPointerClass, memptr_allocate);
     rb_define_method(rbffi_MemoryPointerClass, "initialize", memptr_initialize, -1);
     rb_define_singleton_method(rbffi_MemoryPointerClass, "from_string", memptr_s_from_string, 1);
+    rb_define_singleton_method(rbffi_MemoryPointerClass, "scope", memptr_s_scope, 0);
+
+    /*
+     * Document-class: FFI::MemoryPointer::Arena
+     * Allocator for the temporary {MemoryPointer}s of a {MemoryPointer.scope} block.
+     */
+    ArenaClass = rb_define_class_under(rbffi_MemoryPointerClass, "Arena", rb_cObject);
+    rb_global_variable(&ArenaClass);
+    rb_undef_alloc_func(ArenaClass);
+    rb_define_method(ArenaClass, "alloc", arena_alloc, -1);
+
+#if defined(USE_PTHREAD_LOCAL)
+    pthread_key_create(&arenaCacheKey, arena_cache_release);
+#else
+    id_arena_cache = rb_intern("ffi_arena_cache");
+#endif
 }
 
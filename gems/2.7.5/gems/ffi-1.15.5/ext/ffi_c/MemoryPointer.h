@@ -41,6 +41,7 @@ extern "C" {
     extern void rbffi_MemoryPointer_Init(VALUE moduleFFI);
     extern VALUE rbffi_MemoryPointerClass;
     extern VALUE rbffi_MemoryPointer_NewInstance(long size, long count, bool clear);
+    extern void rbffi_MemoryPointer_ArenaAdopt(VALUE rbSource, VALUE rbPointer);
 #ifdef	__cplusplus
 }
 #endif
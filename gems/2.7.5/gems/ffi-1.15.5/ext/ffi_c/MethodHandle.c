@@ -303,10 +303,11 @@ trampoline_offsets(long* ctxOffset, long* fnOffset)
 static bool
 prep_trampoline(void* ctx, void* code, Closure* closure, char* errmsg, size_t errmsgsize)
 {
-    memcpy(code, (void*) &ffi_trampoline, trampoline_size());
+    /* The stub is written through the writable view of the code */
+    memcpy(closure->pcl, (void*) &ffi_trampoline, trampoline_size());
     /* Patch the context and function addresses into the stub code */
-    *(intptr_t *)((char*)code + trampoline_ctx_offset) = (intptr_t) closure;
-    *(intptr_t *)((char*)code + trampoline_func_offset) = (intptr_t) custom_trampoline;
+    *(intptr_t *)((char*)closure->pcl + trampoline_ctx_offset) = (intptr_t) closure;
+    *(intptr_t *)((char*)closure->pcl + trampoline_func_offset) = (intptr_t) custom_trampoline;
 
     return true;
 }
@@ -31,13 +31,17 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <ruby.h>
+#include <ruby/encoding.h>
 #include "rbffi.h"
 #include "rbffi_endian.h"
 #include "AbstractMemory.h"
 #include "Pointer.h"
+#include "MemoryPointer.h"
 
 #define POINTER(obj) rbffi_AbstractMemory_Cast((obj), rbffi_PointerClass)
 
+static void borrow_adopt(VALUE rbSource, VALUE rbPointer);
+
 VALUE rbffi_PointerClass = Qnil;
 VALUE rbffi_NullPointerSingleton = Qnil;
 
@@ -126,6 +130,11 @@ ptr_initialize(int argc, VALUE* argv, VALUE self)
                 p->rbParent = rbAddress;
                 Data_Get_Struct(rbAddress, Pointer, orig);
                 p->memory = orig->memory;
+                if (orig->memory.flags & MEM_ARENA) {
+                    rbffi_MemoryPointer_ArenaAdopt(rbAddress, self);
+                } else if (orig->memory.flags & MEM_BORROW) {
+                    borrow_adopt(rbAddress, self);
+                }
             } else {
                 rb_raise(rb_eTypeError, "wrong argument type, expected Integer or FFI::Pointer");
             }
@@ -205,6 +214,11 @@ slice(VALUE self, long offset, long size)
     p->memory.flags = ptr->flags;
     p->memory.typeSize = ptr->typeSize;
     p->rbParent = self;
+    if (ptr->flags & MEM_ARENA) {
+        rbffi_MemoryPointer_ArenaAdopt(self, retval);
+    } else if (ptr->flags & MEM_BORROW) {
+        borrow_adopt(self, retval);
+    }
 
     return retval;
 }
@@ -241,6 +255,150 @@ ptr_slice(VALUE self, VALUE rbOffset, VALUE rbLength)
     return slice(self, NUM2LONG(rbOffset), NUM2LONG(rbLength));
 }
 
+struct borrow {
+    VALUE rbPointer;
+    VALUE rbString;
+    bool writable;
+};
+
+static VALUE
+borrow_yield(VALUE data)
+{
+    return rb_yield(((struct borrow *) data)->rbPointer);
+}
+
+/*
+ * Track a pointer derived from one borrowed in a block (rbSource, which may
+ * itself be derived), so that it is cleared along with it.  The first time,
+ * the parent of the borrowed pointer is replaced by a hidden Array of the
+ * string followed by the derived pointers, which becomes their parent too.
+ */
+static void
+borrow_adopt(VALUE rbSource, VALUE rbPointer)
+{
+    Pointer* source;
+    Pointer* p;
+
+    Data_Get_Struct(rbSource, Pointer, source);
+    Data_Get_Struct(rbPointer, Pointer, p);
+
+    if (!RB_TYPE_P(source->rbParent, T_ARRAY)) {
+        VALUE borrowed = rb_ary_new_from_args(1, source->rbParent);
+        rb_obj_hide(borrowed);
+        source->rbParent = borrowed;
+    }
+    p->rbParent = source->rbParent;
+    rb_ary_push(p->rbParent, rbPointer);
+}
+
+static void
+borrow_clear(Pointer* p)
+{
+    p->memory.address = NULL;
+    p->memory.size = 0;
+    p->memory.flags = 0;
+}
+
+static VALUE
+borrow_end(VALUE data)
+{
+    struct borrow* b = (struct borrow *) data;
+    Pointer* p;
+
+    /* The string may be modified or moved from now on, so stop using it */
+    Data_Get_Struct(b->rbPointer, Pointer, p);
+    borrow_clear(p);
+
+    /* Nor may anything derived from the pointer */
+    if (RB_TYPE_P(p->rbParent, T_ARRAY)) {
+        VALUE borrowed = p->rbParent;
+        long i;
+
+        for (i = 1; i < RARRAY_LEN(borrowed); ++i) {
+            Pointer* derived;
+
+            Data_Get_Struct(RARRAY_AREF(borrowed, i), Pointer, derived);
+            borrow_clear(derived);
+            derived->rbParent = Qnil;
+        }
+        p->rbParent = RARRAY_AREF(borrowed, 0);
+        rb_ary_clear(borrowed);
+    }
+
+    if (b->writable) {
+        rb_str_unlocktmp(b->rbString);
+        ENC_CODERANGE_CLEAR(b->rbString);
+    }
+
+    return Qnil;
+}
+
+/*
+ * call-seq: borrow(str, writable = false)
+ * @overload borrow(str)
+ *  @param [String] str
+ *  @return [Pointer] a read-only pointer to the contents of +str+
+ * @overload borrow(str, writable = false) { |ptr| ... }
+ *  @param [String] str
+ *  @param [Boolean] writable whether native code may write to the string
+ *  @yieldparam [Pointer] ptr pointer to the contents of +str+, valid until the block returns
+ *  @return the value of the block
+ * Point at the contents of a string rather than a copy of them, as
+ * {MemoryPointer.from_string} makes.
+ *
+ * A read-only pointer sees the string as it was when borrowed, even if the
+ * string is changed later (when it isn't frozen, the pointer refers to a
+ * frozen copy, which shares the contents of all but the shortest strings).
+ * Native code must not write through it.
+ *
+ * A writable pointer is only available within a block, and writes to
+ * +str+ itself, which must not be frozen; the string can't be modified by
+ * Ruby until the block returns.
+ *
+ * A pointer borrowed in a block, and any pointer derived from it (with
+ * {#+}, {#slice}, {#order} or {Pointer.new}), raises {NullPointerError}
+ * once the block has returned.
+ */
+static VALUE
+ptr_s_borrow(int argc, VALUE* argv, VALUE klass)
+{
+    struct borrow b;
+    Pointer* p;
+    VALUE rbWritable = Qnil;
+
+    rb_scan_args(argc, argv, "11", &b.rbString, &rbWritable);
+    StringValue(b.rbString);
+    b.writable = RTEST(rbWritable);
+
+    if (b.writable) {
+        if (!rb_block_given_p()) {
+            rb_raise(rb_eArgError, "a writable string can only be borrowed in a block");
+        }
+        /* Raises if frozen, and gives the string its own buffer to write to */
+        rb_str_modify(b.rbString);
+    } else {
+        b.rbString = rb_str_new_frozen(b.rbString);
+    }
+
+    b.rbPointer = Data_Make_Struct(klass, Pointer, ptr_mark, -1, p);
+    p->memory.address = RSTRING_PTR(b.rbString);
+    p->memory.size = RSTRING_LEN(b.rbString);
+    p->memory.flags = b.writable ? (MEM_RD | MEM_WR) : MEM_RD;
+    p->memory.typeSize = 1;
+    p->rbParent = b.rbString;
+
+    if (!rb_block_given_p()) {
+        return b.rbPointer;
+    }
+    p->memory.flags |= MEM_BORROW;
+
+    if (b.writable) {
+        rb_str_locktmp(b.rbString);
+    }
+
+    return rb_ensure(borrow_yield, (VALUE) &b, borrow_end, (VALUE) &b);
+}
+
 /*
  * call-seq: ptr.inspect
  * @return [String]
@@ -482,6 +640,7 @@ rbffi_Pointer_Init(VALUE moduleFFI)
     rb_global_variable(&rbffi_PointerClass);
 
     rb_define_alloc_func(rbffi_PointerClass, ptr_allocate);
+    rb_define_singleton_method(rbffi_PointerClass, "borrow", ptr_s_borrow, -1);
     rb_define_method(rbffi_PointerClass, "initialize", ptr_initialize, -1);
     rb_define_method(rbffi_PointerClass, "initialize_copy", ptr_initialize_copy, 1);
     rb_define_method(rbffi_PointerClass, "inspect", ptr_inspect, 0);
@@ -297,20 +297,9 @@ struct_field(Struct* s, VALUE fieldName)
     return p_ce->field;
 }
 
-/*
- * call-seq: struct[field_name]
- * @param field_name field to access
- * Acces to a Struct field.
- */
 static VALUE
-struct_aref(VALUE self, VALUE fieldName)
+struct_field_get(Struct* s, StructField* f)
 {
-    Struct* s;
-    StructField* f;
-
-    s = struct_validate(self);
-
-    f = struct_field(s, fieldName);
     if (f->get != NULL) {
         return (*f->get)(f, s);
 
@@ -318,28 +307,15 @@ struct_aref(VALUE self, VALUE fieldName)
         return (*f->memoryOp->get)(s->pointer, f->offset);
 
     } else {
-        VALUE rbField = rb_hash_aref(s->layout->rbFieldMap, fieldName);
+        VALUE rbField = rb_hash_aref(s->layout->rbFieldMap, f->rbName);
         /* call up to the ruby code to fetch the value */
         return rb_funcall2(rbField, id_get, 1, &s->rbPointer);
     }
 }
 
-/*
- * call-seq: []=(field_name, value)
- * @param field_name field to access
- * @param value value to set to +field_name+
- * @return [value]
- * Set a field in Struct.
- */
-static VALUE
-struct_aset(VALUE self, VALUE fieldName, VALUE value)
+static void
+struct_field_put(Struct* s, StructField* f, VALUE value)
 {
-    Struct* s;
-    StructField* f;
-
-    s = struct_validate(self);
-
-    f = struct_field(s, fieldName);
     if (f->put != NULL) {
         (*f->put)(f, s, value);
 
@@ -348,7 +324,7 @@ struct_aset(VALUE self, VALUE fieldName, VALUE value)
         (*f->memoryOp->put)(s->pointer, f->offset, value);
 
     } else {
-        VALUE rbField = rb_hash_aref(s->layout->rbFieldMap, fieldName);
+        VALUE rbField = rb_hash_aref(s->layout->rbFieldMap, f->rbName);
         /* call up to the ruby code to set the value */
         VALUE argv[2];
         argv[0] = s->rbPointer;
@@ -359,10 +335,218 @@ struct_aset(VALUE self, VALUE fieldName, VALUE value)
     if (f->referenceRequired) {
         store_reference_value(f, s, value);
     }
+}
+
+/*
+ * call-seq: struct[field_name]
+ * @param field_name field to access
+ * Acces to a Struct field.
+ */
+static VALUE
+struct_aref(VALUE self, VALUE fieldName)
+{
+    Struct* s = struct_validate(self);
+
+    return struct_field_get(s, struct_field(s, fieldName));
+}
+
+/*
+ * call-seq: []=(field_name, value)
+ * @param field_name field to access
+ * @param value value to set to +field_name+
+ * @return [value]
+ * Set a field in Struct.
+ */
+static VALUE
+struct_aset(VALUE self, VALUE fieldName, VALUE value)
+{
+    Struct* s = struct_validate(self);
+
+    struct_field_put(s, struct_field(s, fieldName), value);
 
     return value;
 }
 
+/*
+ * Accessors defined by Struct.freeze_layout! for the first FIELD_ACCESSOR_MAX fields
+ * each know the index of their field, so they need no lookup by name.  That index is
+ * only right for the layout they were defined for, which a subclass that has a layout
+ * of its own, or an instance created with one, may not share.  So each layout records
+ * the class it is known to be indexed by, and anything else looks the field up by the
+ * name of the method.  Every freeze_layout! bumps the generation, as it may add
+ * accessors above a class that has been checked already.
+ */
+#define FIELD_ACCESSOR_MAX 64
+
+static unsigned long accessor_generation = 1;
+static ID id_frozen_layout = 0;
+
+/*
+ * Whether the accessors which instances of +klass+ with +layout+ reach were all defined
+ * for that layout.  A class frozen more than once with different layouts holds false.
+ */
+static bool
+struct_accessors_indexed(VALUE klass, StructLayout* layout)
+{
+    VALUE c;
+
+    for (c = klass; c != Qnil && c != rbffi_StructClass; c = rb_class_superclass(c)) {
+        VALUE frozen = rb_attr_get(c, id_frozen_layout);
+        if (frozen != Qnil && (frozen == Qfalse || DATA_PTR(frozen) != layout)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static StructField*
+struct_indexed_field(VALUE self, Struct* s, int index)
+{
+    StructLayout* layout = s->layout;
+    VALUE klass = CLASS_OF(self);
+
+    if (likely(layout->rbAccessorClass == klass && layout->accessorGeneration == accessor_generation)) {
+        return layout->fields[index];
+    }
+
+    if (index < layout->fieldCount && struct_accessors_indexed(klass, layout)) {
+        layout->rbAccessorClass = klass;
+        layout->accessorGeneration = accessor_generation;
+        return layout->fields[index];
+    }
+
+    return NULL;
+}
+
+static VALUE
+struct_get_named(VALUE self)
+{
+    Struct* s = struct_validate(self);
+
+    return struct_field_get(s, struct_field(s, ID2SYM(rb_frame_this_func())));
+}
+
+static VALUE
+struct_put_named(VALUE self, VALUE value)
+{
+    Struct* s = struct_validate(self);
+    VALUE name = rb_id2str(rb_frame_this_func());
+
+    struct_field_put(s, struct_field(s, rb_str_intern(rb_str_substr(name, 0, RSTRING_LEN(name) - 1))), value);
+
+    return value;
+}
+
+static inline VALUE
+struct_get_indexed(VALUE self, int index)
+{
+    Struct* s = struct_validate(self);
+    StructField* f = struct_indexed_field(self, s, index);
+
+    return f != NULL ? struct_field_get(s, f) : struct_get_named(self);
+}
+
+static inline VALUE
+struct_put_indexed(VALUE self, int index, VALUE value)
+{
+    Struct* s = struct_validate(self);
+    StructField* f = struct_indexed_field(self, s, index);
+
+    if (f == NULL) {
+        return struct_put_named(self, value);
+    }
+    struct_field_put(s, f, value);
+
+    return value;
+}
+
+#define FIELD_ACCESSOR(n, index) \
+    static VALUE struct_get_##n(VALUE self) { return struct_get_indexed(self, index); } \
+    static VALUE struct_put_##n(VALUE self, VALUE value) { return struct_put_indexed(self, index, value); }
+#define FIELD_ACCESSORS(h) \
+    FIELD_ACCESSOR(h##0, h * 8 + 0) FIELD_ACCESSOR(h##1, h * 8 + 1) \
+    FIELD_ACCESSOR(h##2, h * 8 + 2) FIELD_ACCESSOR(h##3, h * 8 + 3) \
+    FIELD_ACCESSOR(h##4, h * 8 + 4) FIELD_ACCESSOR(h##5, h * 8 + 5) \
+    FIELD_ACCESSOR(h##6, h * 8 + 6) FIELD_ACCESSOR(h##7, h * 8 + 7)
+#define FIELD_ACCESSOR_LIST(prefix, h) \
+    prefix##h##0, prefix##h##1, prefix##h##2, prefix##h##3, \
+    prefix##h##4, prefix##h##5, prefix##h##6, prefix##h##7
+
+FIELD_ACCESSORS(0) FIELD_ACCESSORS(1) FIELD_ACCESSORS(2) FIELD_ACCESSORS(3)
+FIELD_ACCESSORS(4) FIELD_ACCESSORS(5) FIELD_ACCESSORS(6) FIELD_ACCESSORS(7)
+
+static VALUE (*struct_getters[FIELD_ACCESSOR_MAX])(VALUE) = {
+    FIELD_ACCESSOR_LIST(struct_get_, 0), FIELD_ACCESSOR_LIST(struct_get_, 1),
+    FIELD_ACCESSOR_LIST(struct_get_, 2), FIELD_ACCESSOR_LIST(struct_get_, 3),
+    FIELD_ACCESSOR_LIST(struct_get_, 4), FIELD_ACCESSOR_LIST(struct_get_, 5),
+    FIELD_ACCESSOR_LIST(struct_get_, 6), FIELD_ACCESSOR_LIST(struct_get_, 7),
+};
+
+static VALUE (*struct_putters[FIELD_ACCESSOR_MAX])(VALUE, VALUE) = {
+    FIELD_ACCESSOR_LIST(struct_put_, 0), FIELD_ACCESSOR_LIST(struct_put_, 1),
+    FIELD_ACCESSOR_LIST(struct_put_, 2), FIELD_ACCESSOR_LIST(struct_put_, 3),
+    FIELD_ACCESSOR_LIST(struct_put_, 4), FIELD_ACCESSOR_LIST(struct_put_, 5),
+    FIELD_ACCESSOR_LIST(struct_put_, 6), FIELD_ACCESSOR_LIST(struct_put_, 7),
+};
+
+/*
+ * Whether freeze_layout! leaves +id+ alone: a public method, or a private one that
+ * doesn't come from Kernel, such as #initialize.
+ */
+static bool
+struct_method_taken(VALUE klass, ID id)
+{
+    return rb_method_boundp(klass, id, 1)
+        || (rb_method_boundp(klass, id, 0) && !rb_method_boundp(rb_mKernel, id, 0));
+}
+
+/*
+ * call-seq: freeze_layout!
+ * @return [self]
+ * Define a reader and a writer method for each field of the layout, which access the field
+ * without looking it up by name, e.g. +s.x+ and <code>s.x = 1</code> for <code>s[:x]</code>
+ * and <code>s[:x] = 1</code>. Fields for which either name is already a public method of the
+ * class, such as +:size+ or +:values+, are left to {#[]} and {#[]=}; private Kernel methods
+ * such as +p+ or +format+ are shadowed.
+ *
+ * Instances of a subclass whose parent was frozen with another layout, or created with a
+ * layout other than their class's, look the field up by name instead.
+ */
+static VALUE
+struct_s_freeze_layout(VALUE klass)
+{
+    VALUE rbLayout = struct_class_layout(klass);
+    VALUE frozen = rb_attr_get(klass, id_frozen_layout);
+    StructLayout* layout;
+    int i;
+
+    Data_Get_Struct(rbLayout, StructLayout, layout);
+
+    for (i = 0; i < layout->fieldCount; ++i) {
+        StructField* f = layout->fields[i];
+        ID getterId = SYM2ID(f->rbName);
+        ID setterId = rb_intern_str(rb_str_plus(rb_sym2str(f->rbName), rb_str_new2("=")));
+
+        if (struct_method_taken(klass, getterId) || struct_method_taken(klass, setterId)) {
+            continue;
+        }
+
+        if (i < FIELD_ACCESSOR_MAX) {
+            rb_define_method_id(klass, getterId, struct_getters[i], 0);
+            rb_define_method_id(klass, setterId, struct_putters[i], 1);
+        } else {
+            rb_define_method_id(klass, getterId, struct_get_named, 0);
+            rb_define_method_id(klass, setterId, struct_put_named, 1);
+        }
+    }
+
+    rb_ivar_set(klass, id_frozen_layout, frozen == Qnil || frozen == rbLayout ? rbLayout : Qfalse);
+    accessor_generation++;
+
+    return klass;
+}
+
 /*
  * call-seq: pointer= pointer
  * @param [AbstractMemory] pointer
@@ -797,6 +981,7 @@ rbffi_Struct_Init(VALUE moduleFFI)
     rb_define_method(StructClass, "[]", struct_aref, 1);
     rb_define_method(StructClass, "[]=", struct_aset, 2);
     rb_define_method(StructClass, "null?", struct_null_p, 0);
+    rb_define_singleton_method(StructClass, "freeze_layout!", struct_s_freeze_layout, 0);
 
     rb_include_module(rbffi_StructInlineArrayClass, rb_mEnumerable);
     rb_define_alloc_func(rbffi_StructInlineArrayClass, inline_array_allocate);
@@ -813,6 +998,7 @@ rbffi_Struct_Init(VALUE moduleFFI)
 
     id_pointer_ivar = rb_intern("@pointer");
     id_layout_ivar = rb_intern("@layout");
+    id_frozen_layout = rb_intern("__ffi_frozen_layout");
     id_layout = rb_intern("layout");
     id_get = rb_intern("get");
     id_put = rb_intern("put");
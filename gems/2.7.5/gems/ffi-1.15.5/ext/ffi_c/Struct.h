@@ -87,6 +87,13 @@ extern "C" {
         VALUE rbFieldNames;
         VALUE rbFieldMap;
         VALUE rbFields;
+
+        /**
+         * The class whose Struct.freeze_layout! accessors are known to index this layout,
+         * as of accessorGeneration
+         */
+        VALUE rbAccessorClass;
+        unsigned long accessorGeneration;
     };
 
     struct Struct_ {
@@ -420,6 +420,7 @@ struct_layout_allocate(VALUE klass)
     layout->rbFieldMap = Qnil;
     layout->rbFieldNames = Qnil;
     layout->rbFields = Qnil;
+    layout->rbAccessorClass = Qnil;
     layout->base.ffiType = xcalloc(1, sizeof(*layout->base.ffiType));
     layout->base.ffiType->size = 0;
     layout->base.ffiType->alignment = 0;
@@ -601,6 +602,7 @@ struct_layout_mark(StructLayout *layout)
     rb_gc_mark(layout->rbFieldMap);
     rb_gc_mark(layout->rbFieldNames);
     rb_gc_mark(layout->rbFields);
+    rb_gc_mark(layout->rbAccessorClass);
     /* Clear the cache, to be safe from changes of fieldName VALUE by GC.compact.
      * TODO: Move cache clearing to compactation callback provided by Ruby-2.7+.
      */
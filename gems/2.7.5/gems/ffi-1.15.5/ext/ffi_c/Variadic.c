@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <ruby.h>
 
 #include <ffi.h>
@@ -50,6 +51,28 @@
 #include "Call.h"
 #include "Thread.h"
 
+/* Number of call shapes whose prepared CIF each invoker keeps. */
+#define VARIADIC_CIF_CACHE_SIZE 8
+
+/*
+ * A CIF prepared for one call shape: the FFI::Type of every argument (the
+ * key, compared by identity), the number of fixed arguments and the return
+ * type.  The arrays the CIF points to live in the same allocation.
+ */
+typedef struct VariadicCif_ {
+    ffi_cif cif;
+    Type* returnType;
+    int fixedCount;
+    int paramCount;
+    int callbackCount;
+    int inUse;
+    unsigned long lastUsed;
+    VALUE* rbParamTypes;
+    Type** paramTypes;
+    ffi_type** ffiParamTypes;
+    VALUE* callbackParameters;
+} VariadicCif;
+
 typedef struct VariadicInvoker_ {
     VALUE rbAddress;
     VALUE rbReturnType;
@@ -60,6 +83,10 @@ typedef struct VariadicInvoker_ {
     void* function;
     int paramCount;
     bool blocking;
+
+    VariadicCif* cifCache[VARIADIC_CIF_CACHE_SIZE];
+    unsigned long cifClock;
+    rbffi_blocking_stats_t blockingStats;
 } VariadicInvoker;
 
 
@@ -67,6 +94,7 @@ static VALUE variadic_allocate(VALUE klass);
 static VALUE variadic_initialize(VALUE self, VALUE rbFunction, VALUE rbParameterTypes,
         VALUE rbReturnType, VALUE options);
 static void variadic_mark(VariadicInvoker *);
+static void variadic_free(VariadicInvoker *);
 
 static VALUE classVariadicInvoker = Qnil;
 
@@ -75,7 +103,7 @@ static VALUE
 variadic_allocate(VALUE klass)
 {
     VariadicInvoker *invoker;
-    VALUE obj = Data_Make_Struct(klass, VariadicInvoker, variadic_mark, -1, invoker);
+    VALUE obj = Data_Make_Struct(klass, VariadicInvoker, variadic_mark, variadic_free, invoker);
 
     invoker->rbAddress = Qnil;
     invoker->rbEnums = Qnil;
@@ -88,9 +116,117 @@ variadic_allocate(VALUE klass)
 static void
 variadic_mark(VariadicInvoker *invoker)
 {
+    int i;
+
     rb_gc_mark(invoker->rbEnums);
     rb_gc_mark(invoker->rbAddress);
     rb_gc_mark(invoker->rbReturnType);
+
+    for (i = 0; i < VARIADIC_CIF_CACHE_SIZE; ++i) {
+        if (invoker->cifCache[i] != NULL) {
+            rb_gc_mark_locations(invoker->cifCache[i]->rbParamTypes,
+                invoker->cifCache[i]->rbParamTypes + invoker->cifCache[i]->paramCount);
+        }
+    }
+}
+
+static void
+variadic_free(VariadicInvoker *invoker)
+{
+    int i;
+
+    for (i = 0; i < VARIADIC_CIF_CACHE_SIZE; ++i) {
+        xfree(invoker->cifCache[i]);
+    }
+    xfree(invoker);
+}
+
+/*
+ * Find the CIF prepared for calls with these argument types, or NULL.
+ */
+static VariadicCif*
+variadic_cif_lookup(VariadicInvoker* invoker, int fixedCount, int paramCount, const VALUE* rbParamTypes)
+{
+    int i;
+
+    for (i = 0; i < VARIADIC_CIF_CACHE_SIZE; ++i) {
+        VariadicCif* entry = invoker->cifCache[i];
+
+        if (entry != NULL && entry->paramCount == paramCount && entry->fixedCount == fixedCount
+                && entry->returnType == invoker->returnType
+                && memcmp(entry->rbParamTypes, rbParamTypes, paramCount * sizeof(VALUE)) == 0) {
+            entry->lastUsed = ++invoker->cifClock;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* Bytes needed for a CIF and its arrays for paramCount arguments. */
+static size_t
+variadic_cif_size(int paramCount)
+{
+    return sizeof(VariadicCif) + paramCount * (2 * sizeof(VALUE) + sizeof(Type *) + sizeof(ffi_type *));
+}
+
+/*
+ * Point the arrays of the CIF at memory (variadic_cif_size(paramCount)
+ * bytes) to the space right after it.
+ */
+static VariadicCif*
+variadic_cif_layout(void* memory, int paramCount)
+{
+    VariadicCif* entry = memory;
+    char* p = (char *) (entry + 1);
+
+    entry->rbParamTypes = (VALUE *) p;
+    p += paramCount * sizeof(VALUE);
+    entry->callbackParameters = (VALUE *) p;
+    p += paramCount * sizeof(VALUE);
+    entry->paramTypes = (Type **) p;
+    p += paramCount * sizeof(Type *);
+    entry->ffiParamTypes = (ffi_type **) p;
+    entry->paramCount = paramCount;
+    entry->cif.arg_types = entry->ffiParamTypes;
+
+    return entry;
+}
+
+/*
+ * Cache a copy of the CIF prepared in temporary memory, in place of the
+ * least recently used one that isn't in the middle of a call.  If they all
+ * are, the CIF isn't cached and is returned as it is.
+ */
+static VariadicCif*
+variadic_cif_insert(VariadicInvoker* invoker, VariadicCif* entry)
+{
+    VariadicCif* copy;
+    size_t size = variadic_cif_size(entry->paramCount);
+    int i, victim = -1;
+
+    for (i = 0; i < VARIADIC_CIF_CACHE_SIZE; ++i) {
+        if (invoker->cifCache[i] == NULL) {
+            victim = i;
+            break;
+        }
+        if (invoker->cifCache[i]->inUse == 0
+                && (victim < 0 || invoker->cifCache[i]->lastUsed < invoker->cifCache[victim]->lastUsed)) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        return entry;
+    }
+
+    copy = xmalloc(size);
+    memcpy(copy, entry, size);
+    copy = variadic_cif_layout(copy, entry->paramCount);
+    copy->lastUsed = ++invoker->cifClock;
+    xfree(invoker->cifCache[victim]);
+    invoker->cifCache[victim] = copy;
+
+    return copy;
 }
 
 static VALUE
@@ -156,61 +292,48 @@ variadic_initialize(VALUE self, VALUE rbFunction, VALUE rbParameterTypes, VALUE
     return retval;
 }
 
-static VALUE
-variadic_invoke(VALUE self, VALUE parameterTypes, VALUE parameterValues)
+/*
+ * Resolve the argument types of a call and prepare its CIF.
+ */
+static VariadicCif*
+variadic_cif_prepare(VariadicInvoker* invoker, void* memory, VALUE parameterTypes, int fixedCount, int paramCount)
 {
-    VariadicInvoker* invoker;
-    FFIStorage* params;
-    void* retval;
-    ffi_cif cif;
-    void** ffiValues;
-    ffi_type** ffiParamTypes;
+    VariadicCif* entry;
     ffi_type* ffiReturnType;
-    Type** paramTypes;
-    VALUE* argv;
-    VALUE* callbackParameters;
-    int paramCount = 0, fixedCount = 0, callbackCount = 0, i;
     ffi_status ffiStatus;
-    rbffi_frame_t frame = { 0 };
-
-    Check_Type(parameterTypes, T_ARRAY);
-    Check_Type(parameterValues, T_ARRAY);
+    int i;
 
-    Data_Get_Struct(self, VariadicInvoker, invoker);
-    paramCount = (int) RARRAY_LEN(parameterTypes);
-    paramTypes = ALLOCA_N(Type *, paramCount);
-    ffiParamTypes = ALLOCA_N(ffi_type *, paramCount);
-    params = ALLOCA_N(FFIStorage, paramCount);
-    ffiValues = ALLOCA_N(void*, paramCount);
-    argv = ALLOCA_N(VALUE, paramCount);
-    callbackParameters = ALLOCA_N(VALUE, paramCount);
-    retval = alloca(MAX(invoker->returnType->ffiType->size, FFI_SIZEOF_ARG));
+    memset(memory, 0, sizeof(VariadicCif));
+    entry = variadic_cif_layout(memory, paramCount);
+    entry->returnType = invoker->returnType;
+    entry->fixedCount = fixedCount;
+    entry->callbackCount = 0;
 
-    for (i = 0; i < paramCount; ++i) {
+    for (i = 0; i < entry->paramCount; ++i) {
         VALUE rbType = rb_ary_entry(parameterTypes, i);
 
         if (!rb_obj_is_kind_of(rbType, rbffi_TypeClass)) {
             rb_raise(rb_eTypeError, "wrong type.  Expected (FFI::Type)");
         }
-        Data_Get_Struct(rbType, Type, paramTypes[i]);
+        Data_Get_Struct(rbType, Type, entry->paramTypes[i]);
 
-        switch (paramTypes[i]->nativeType) {
+        switch (entry->paramTypes[i]->nativeType) {
             case NATIVE_INT8:
             case NATIVE_INT16:
             case NATIVE_INT32:
                 rbType = rb_const_get(rbffi_TypeClass, rb_intern("INT32"));
-                Data_Get_Struct(rbType, Type, paramTypes[i]);
+                Data_Get_Struct(rbType, Type, entry->paramTypes[i]);
                 break;
             case NATIVE_UINT8:
             case NATIVE_UINT16:
             case NATIVE_UINT32:
                 rbType = rb_const_get(rbffi_TypeClass, rb_intern("UINT32"));
-                Data_Get_Struct(rbType, Type, paramTypes[i]);
+                Data_Get_Struct(rbType, Type, entry->paramTypes[i]);
                 break;
 
             case NATIVE_FLOAT32:
                 rbType = rb_const_get(rbffi_TypeClass, rb_intern("DOUBLE"));
-                Data_Get_Struct(rbType, Type, paramTypes[i]);
+                Data_Get_Struct(rbType, Type, entry->paramTypes[i]);
                 break;
 
             case NATIVE_FUNCTION:
@@ -218,7 +341,7 @@ variadic_invoke(VALUE self, VALUE parameterTypes, VALUE parameterValues)
                     VALUE typeName = rb_funcall2(rbType, rb_intern("inspect"), 0, NULL);
                     rb_raise(rb_eTypeError, "Incorrect parameter type (%s)", RSTRING_PTR(typeName));
                 }
-                callbackParameters[callbackCount++] = rbType;
+                entry->callbackParameters[entry->callbackCount++] = rbType;
                 break;
 
             default:
@@ -226,11 +349,10 @@ variadic_invoke(VALUE self, VALUE parameterTypes, VALUE parameterValues)
         }
 
 
-        ffiParamTypes[i] = paramTypes[i]->ffiType;
-        if (ffiParamTypes[i] == NULL) {
-            rb_raise(rb_eArgError, "Invalid parameter type #%x", paramTypes[i]->nativeType);
+        entry->ffiParamTypes[i] = entry->paramTypes[i]->ffiType;
+        if (entry->ffiParamTypes[i] == NULL) {
+            rb_raise(rb_eArgError, "Invalid parameter type #%x", entry->paramTypes[i]->nativeType);
         }
-        argv[i] = rb_ary_entry(parameterValues, i);
     }
 
     ffiReturnType = invoker->returnType->ffiType;
@@ -238,13 +360,10 @@ variadic_invoke(VALUE self, VALUE parameterTypes, VALUE parameterValues)
         rb_raise(rb_eArgError, "Invalid return type");
     }
 
-    /*Get the number of fixed args from @fixed array*/
-    fixedCount = RARRAY_LEN(rb_iv_get(self, "@fixed"));
-
 #ifdef HAVE_FFI_PREP_CIF_VAR
-    ffiStatus = ffi_prep_cif_var(&cif, invoker->abi, fixedCount, paramCount, ffiReturnType, ffiParamTypes);
+    ffiStatus = ffi_prep_cif_var(&entry->cif, invoker->abi, fixedCount, entry->paramCount, ffiReturnType, entry->ffiParamTypes);
 #else
-    ffiStatus = ffi_prep_cif(&cif, invoker->abi, paramCount, ffiReturnType, ffiParamTypes);
+    ffiStatus = ffi_prep_cif(&entry->cif, invoker->abi, entry->paramCount, ffiReturnType, entry->ffiParamTypes);
 #endif
     switch (ffiStatus) {
         case FFI_BAD_ABI:
@@ -257,24 +376,52 @@ variadic_invoke(VALUE self, VALUE parameterTypes, VALUE parameterValues)
             rb_raise(rb_eArgError, "Unknown FFI error");
     }
 
-    rbffi_SetupCallParams(paramCount, argv, -1, paramTypes, params,
-        ffiValues, callbackParameters, callbackCount, invoker->rbEnums);
+    for (i = 0; i < entry->paramCount; ++i) {
+        entry->rbParamTypes[i] = rb_ary_entry(parameterTypes, i);
+    }
+
+    return entry;
+}
+
+typedef struct VariadicCall {
+    VariadicInvoker* invoker;
+    VariadicCif* entry;
+    VALUE* argv;
+    int paramCount;
+    FFIStorage* params;
+    void** ffiValues;
+    void* retval;
+} VariadicCall;
+
+static VALUE
+variadic_call(VALUE data)
+{
+    VariadicCall* call = (VariadicCall *) data;
+    VariadicInvoker* invoker = call->invoker;
+    VariadicCif* entry = call->entry;
+    rbffi_frame_t frame = { 0 };
+
+    rbffi_SetupCallParams(call->paramCount, call->argv, -1, entry->paramTypes, call->params,
+        call->ffiValues, entry->callbackParameters, entry->callbackCount, invoker->rbEnums);
 
     rbffi_frame_push(&frame);
 
     if(unlikely(invoker->blocking)) {
         rbffi_blocking_call_t* bc;
         bc = ALLOCA_N(rbffi_blocking_call_t, 1);
-        bc->retval = retval;
+        bc->retval = call->retval;
         bc->function = invoker->function;
-        bc->ffiValues = ffiValues;
-        bc->params = params;
+        bc->ffiValues = call->ffiValues;
+        bc->params = call->params;
         bc->frame = &frame;
-        bc->cif = cif;
+        bc->cif = &entry->cif;
+        bc->timed = rbffi_blocking_timing;
+        bc->nanos = 0;
 
         rb_rescue2(rbffi_do_blocking_call, (VALUE) bc, rbffi_save_frame_exception, (VALUE) &frame, rb_eException, (VALUE) 0);
+        rbffi_record_blocking_calls(&invoker->blockingStats, 1, true, bc->timed, bc->nanos);
     } else {
-        ffi_call(&cif, FFI_FN(invoker->function), retval, ffiValues);
+        ffi_call(&entry->cif, FFI_FN(invoker->function), call->retval, call->ffiValues);
     }
 
     rbffi_frame_pop(&frame);
@@ -285,7 +432,75 @@ variadic_invoke(VALUE self, VALUE parameterTypes, VALUE parameterValues)
         rb_exc_raise(frame.exc);
     }
 
-    return rbffi_NativeValue_ToRuby(invoker->returnType, invoker->rbReturnType, retval);
+    return Qnil;
+}
+
+static VALUE
+variadic_call_done(VALUE data)
+{
+    ((VariadicCall *) data)->entry->inUse--;
+
+    return Qnil;
+}
+
+static VALUE
+variadic_invoke(VALUE self, VALUE parameterTypes, VALUE parameterValues)
+{
+    VariadicInvoker* invoker;
+    VariadicCall call;
+    int paramCount = 0, fixedCount = 0, i;
+
+    Check_Type(parameterTypes, T_ARRAY);
+    Check_Type(parameterValues, T_ARRAY);
+
+    Data_Get_Struct(self, VariadicInvoker, invoker);
+    paramCount = (int) RARRAY_LEN(parameterTypes);
+    call.invoker = invoker;
+    call.paramCount = paramCount;
+    call.params = ALLOCA_N(FFIStorage, paramCount);
+    call.ffiValues = ALLOCA_N(void*, paramCount);
+    call.argv = ALLOCA_N(VALUE, paramCount);
+    call.retval = alloca(MAX(invoker->returnType->ffiType->size, FFI_SIZEOF_ARG));
+
+    /*Get the number of fixed args from @fixed array*/
+    fixedCount = RARRAY_LEN(rb_iv_get(self, "@fixed"));
+
+    /* Calls of a shape seen before reuse its types and CIF. */
+    call.entry = variadic_cif_lookup(invoker, fixedCount, paramCount, RARRAY_CONST_PTR(parameterTypes));
+    if (call.entry == NULL) {
+        call.entry = variadic_cif_prepare(invoker, alloca(variadic_cif_size(paramCount)),
+            parameterTypes, fixedCount, paramCount);
+        call.entry = variadic_cif_insert(invoker, call.entry);
+    }
+
+    for (i = 0; i < paramCount; ++i) {
+        call.argv[i] = rb_ary_entry(parameterValues, i);
+    }
+
+    /*
+     * Converting the arguments and callbacks may call this invoker again;
+     * don't let that evict the entry until the call is over.
+     */
+    call.entry->inUse++;
+    rb_ensure(variadic_call, (VALUE) &call, variadic_call_done, (VALUE) &call);
+
+    return rbffi_NativeValue_ToRuby(invoker->returnType, invoker->rbReturnType, call.retval);
+}
+
+/*
+ * call-seq: blocking_stats
+ * @return [Hash]
+ * Statistics of the calls of a function declared with +blocking: true+, as
+ * {Function#blocking_stats} gives them.
+ */
+static VALUE
+variadic_blocking_stats(VALUE self)
+{
+    VariadicInvoker* invoker;
+
+    Data_Get_Struct(self, VariadicInvoker, invoker);
+
+    return rbffi_blocking_stats_hash(&invoker->blockingStats);
 }
 
 
@@ -299,5 +514,6 @@ rbffi_Variadic_Init(VALUE moduleFFI)
 
     rb_define_method(classVariadicInvoker, "initialize", variadic_initialize, 4);
     rb_define_method(classVariadicInvoker, "invoke", variadic_invoke, 2);
+    rb_define_method(classVariadicInvoker, "blocking_stats", variadic_blocking_stats, 0);
 }
 
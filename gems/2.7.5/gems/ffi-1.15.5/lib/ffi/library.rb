@@ -223,7 +223,8 @@ module FFI
     # @param [#to_s] func name of C function to attach
     # @param [Array<Symbol>] args an array of types
     # @param [Symbol] returns type of return value
-    # @option options [Boolean] :blocking (@blocking) set to true if the C function is a blocking call
+    # @option options [Boolean, Symbol] :blocking (@blocking) set to true if the C function is a blocking call, or to
+    #   :adaptive to release the GVL only while its calls take long on average (see {Function#blocking_stats})
     # @option options [Symbol] :convention (:default) calling convention (see {#ffi_convention})
     # @option options [FFI::Enums] :enums
     # @option options [Hash] :type_map
@@ -273,9 +274,31 @@ module FFI
       raise FFI::NotFoundError.new(cname.to_s, ffi_libraries.map { |lib| lib.name }) unless invoker
 
       invoker.attach(self, mname.to_s)
+      (@ffi_functions ||= {})[mname.to_sym] = invoker
       invoker
     end
 
+    # @param [#to_s] name name of a function attached with {#attach_function}
+    # @param [Array<Array>] args list of argument lists, one per call
+    # @param [AbstractMemory] result memory to store the native return values in
+    # @return [Array, AbstractMemory] the return values, or +result+
+    # Call an attached function once for each argument list, converting all of them
+    # before the first call. See {Function#call_many}.
+    # @example
+    #   module LibC
+    #     extend FFI::Library
+    #     ffi_lib FFI::Library::LIBC
+    #     attach_function :strlen, [:string], :size_t
+    #   end
+    #   LibC.call_many(:strlen, [["a"], ["bc"]])  # => [1, 2]
+    # @raise [ArgumentError] if +name+ is not attached or is variadic
+    def call_many(name, args, result = nil, &block)
+      function = defined?(@ffi_functions) && @ffi_functions[name.to_sym]
+      raise ArgumentError, "#{name} is not an attached function" unless function.is_a?(Function)
+
+      function.call_many(args, result, &block)
+    end
+
     # @param [#to_s] name function name
     # @param [Array] arg_types function's argument types
     # @return [Array<String>]
@@ -0,0 +1,79 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+describe "Function#blocking_stats" do
+  module BlockingStatsLibC
+    extend FFI::Library
+    ffi_lib FFI::Library::LIBC
+    BLOCKING_STRLEN = attach_function :blocking_strlen, :strlen, [:string], :size_t, blocking: true
+    ADAPTIVE_STRLEN = attach_function :adaptive_strlen, :strlen, [:string], :size_t, blocking: :adaptive
+    STRLEN = attach_function :strlen, [:string], :size_t
+    SNPRINTF = attach_function :snprintf, [:pointer, :size_t, :string, :varargs], :int, blocking: true
+  end
+
+  after :each do
+    FFI::Function.blocking_timing = false
+  end
+
+  def stats_delta(function)
+    before = function.blocking_stats
+    yield
+    after = function.blocking_stats
+    { calls: after[:calls] - before[:calls], released: after[:released] - before[:released], average_ns: after[:average_ns] }
+  end
+
+  it "counts the calls of a blocking function without timing them by default" do
+    function = BlockingStatsLibC::BLOCKING_STRLEN
+    expect(FFI::Function.blocking_timing).to be false
+    delta = stats_delta(function) { 3.times { expect(BlockingStatsLibC.blocking_strlen("abc")).to eq(3) } }
+    expect(delta[:calls]).to eq(3)
+    expect(delta[:released]).to eq(3)
+    expect(function.blocking_stats[:average_ns]).to be_nil
+  end
+
+  it "times the calls of a blocking function while blocking_timing is set" do
+    FFI::Function.blocking_timing = true
+    expect(FFI::Function.blocking_timing).to be true
+    BlockingStatsLibC.blocking_strlen("abc")
+    expect(BlockingStatsLibC::BLOCKING_STRLEN.blocking_stats[:average_ns]).to be_a(Integer)
+  end
+
+  it "always times the calls of an adaptive function" do
+    function = BlockingStatsLibC::ADAPTIVE_STRLEN
+    delta = stats_delta(function) { 20.times { BlockingStatsLibC.adaptive_strlen("abc") } }
+    expect(delta[:calls]).to eq(20)
+    expect(delta[:released]).to be_between(0, 20)
+    expect(delta[:average_ns]).to be_a(Integer)
+  end
+
+  it "counts the calls of a batch" do
+    FFI::Function.blocking_timing = true
+    delta = stats_delta(BlockingStatsLibC::BLOCKING_STRLEN) do
+      expect(BlockingStatsLibC.call_many(:blocking_strlen, [["a"], ["bc"], ["def"]])).to eq([1, 2, 3])
+    end
+    expect(delta[:calls]).to eq(3)
+    expect(delta[:released]).to eq(3)
+    expect(delta[:average_ns]).to be_a(Integer)
+  end
+
+  it "counts the calls of a blocking variadic function" do
+    buf = FFI::MemoryPointer.new(:char, 16)
+    delta = stats_delta(BlockingStatsLibC::SNPRINTF) do
+      BlockingStatsLibC.snprintf(buf, buf.size, "%d", :int, 42)
+      BlockingStatsLibC.snprintf(buf, buf.size, "%s", :string, "x")
+    end
+    expect(buf.read_string).to eq("x")
+    expect(delta[:calls]).to eq(2)
+    expect(delta[:released]).to eq(2)
+  end
+
+  it "leaves functions which aren't blocking alone" do
+    BlockingStatsLibC.strlen("abc")
+    BlockingStatsLibC.call_many(:strlen, [["a"]])
+    expect(BlockingStatsLibC::STRLEN.blocking_stats).to eq(calls: 0, released: 0, average_ns: nil)
+  end
+end
@@ -0,0 +1,36 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+describe "Library#call_many" do
+  module CallManyLibC
+    extend FFI::Library
+    ffi_lib FFI::Library::LIBC
+    attach_function :strlen, [:pointer], :size_t
+  end
+
+  # Converts to a fresh MemoryPointer, which nothing else holds on to
+  class CallManyString
+    def initialize(s)
+      @s = s
+    end
+
+    def to_ptr
+      FFI::MemoryPointer.from_string(@s)
+    end
+  end
+
+  it "keeps what #to_ptr returned alive until all the calls are made" do
+    args = 200.times.map { |i| [CallManyString.new("x" * (i % 50))] }
+    begin
+      GC.stress = true
+      lengths = CallManyLibC.call_many(:strlen, args)
+    ensure
+      GC.stress = false
+    end
+    expect(lengths).to eq(200.times.map { |i| i % 50 })
+  end
+end
@@ -0,0 +1,83 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+describe "FFI::Function.callback_runners", if: FFI::Function.respond_to?(:callback_runners) do
+  module CallbackRunnersLib
+    extend FFI::Library
+    ffi_lib FFI::CURRENT_PROCESS
+    callback :thread_start, [:pointer], :pointer
+    attach_function :pthread_create, [:pointer, :pointer, :thread_start, :pointer], :int
+    attach_function :pthread_join, [:ulong, :pointer], :int, blocking: true
+  end
+
+  def runners
+    Thread.list.count { |t| t.alive? && t.name == "FFI Callback Runner" }
+  end
+
+  def wait_for_runners(count)
+    100.times do
+      break if runners == count
+
+      sleep 0.05
+    end
+    runners
+  end
+
+  # Make +count+ callbacks from native threads at once, so that each needs a runner
+  def run_callbacks(count)
+    release = Queue.new
+    started = Queue.new
+    callback = FFI::Function.new(:pointer, [:pointer]) do |arg|
+      started << true
+      release.pop
+      arg
+    end
+    threads = count.times.map do
+      thread = FFI::MemoryPointer.new(:ulong)
+      expect(CallbackRunnersLib.pthread_create(thread, nil, callback, nil)).to eq(0)
+      thread.read_ulong
+    end
+    count.times { started.pop }
+    count.times { release << true }
+    threads.each { |thread| expect(CallbackRunnersLib.pthread_join(thread, nil)).to eq(0) }
+  end
+
+  before :each do
+    @default = FFI::Function.callback_runners
+  end
+
+  after :each do
+    FFI::Function.callback_runners = @default
+  end
+
+  it "keeps as many idle runners as it is set to after growing" do
+    FFI::Function.callback_runners = 2
+    run_callbacks(5)
+    expect(wait_for_runners(2)).to eq(2)
+  end
+
+  it "stops idle runners when lowered, and starts them again when needed" do
+    FFI::Function.callback_runners = 4
+    run_callbacks(4)
+    expect(wait_for_runners(4)).to eq(4)
+
+    FFI::Function.callback_runners = 1
+    expect(FFI::Function.callback_runners).to eq(1)
+    expect(wait_for_runners(1)).to eq(1)
+
+    FFI::Function.callback_runners = 0
+    expect(wait_for_runners(0)).to eq(0)
+
+    FFI::Function.callback_runners = 3
+    run_callbacks(3)
+    expect(wait_for_runners(3)).to eq(3)
+  end
+
+  it "rejects a negative count" do
+    expect { FFI::Function.callback_runners = -1 }.to raise_error(ArgumentError)
+  end
+end
@@ -0,0 +1,35 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+describe "Callback trampolines" do
+  def closure_mappings
+    File.readlines("/proc/self/maps").grep(/ffi-closures/)
+  end
+
+  it "reuses freed closures for new procs" do
+    functions = 50.times.map { |i| FFI::Function.new(:int, [:int]) { |x| x + i } }
+    expect(functions.each_with_index.map { |f, i| f.call(1) - i }.uniq).to eq([1])
+    functions.each(&:free)
+
+    functions = 50.times.map { |i| FFI::Function.new(:int, [:int]) { |x| x * i } }
+    expect(functions.each_with_index.map { |f, i| f.call(3) - 3 * i }.uniq).to eq([0])
+  end
+
+  it "rewrites the blocks of collected pools correctly" do
+    results = 2000.times.map do |n|
+      GC.start if n % 100 == 0
+      FFI::Function.new(:long, [:long, :long]) { |a, b| a * b + n }.call(n, 2) - 3 * n
+    end
+    expect(results.uniq).to eq([0])
+  end
+
+  it "never leaves trampolines writable", if: FFI::Platform::IS_LINUX && File.readable?("/proc/self/maps") do
+    functions = 20.times.map { |i| FFI::Function.new(:int, []) { i } }
+    expect(functions.map(&:call)).to eq((0...20).to_a)
+    expect(closure_mappings.map { |line| line.split[1] }.grep(/w/)).to eq([])
+  end
+end
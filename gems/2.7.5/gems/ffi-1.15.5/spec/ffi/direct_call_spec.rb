@@ -0,0 +1,134 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+# Functions whose parameters and return value all fit in an integer register
+# are called without libffi where BYPASS_FFI is defined; the results must be
+# the same either way.
+describe "Functions with integer register signatures" do
+  module DirectCallLibC
+    extend FFI::Library
+    ffi_lib FFI::Library::LIBC
+
+    enum :direct_sign, [:negative, -3, :positive, 3]
+    callback :direct_compare, [:pointer, :pointer], :int
+
+    attach_function :getpid, [], :int
+    attach_function :abs, [:int], :int
+    attach_function :abs_int8, :abs, [:int8], :int8
+    attach_function :abs_int16, :abs, [:int16], :int16
+    attach_function :abs_bool, :abs, [:bool], :int
+    attach_function :abs_enum, :abs, [:direct_sign], :int
+    attach_function :toupper_uint8, :toupper, [:uint8], :uint8
+    attach_function :toupper_uint16, :toupper, [:uint16], :uint16
+    attach_function :abs_uint32, :abs, [:uint32], :uint32
+    attach_function :labs, [:long], :long
+    attach_function :labs_int64, :labs, [:int64], :int64
+    attach_function :strtoul, [:string, :pointer, :int], :ulong
+    attach_function :strtoull, [:string, :pointer, :int], :uint64
+    attach_function :strtol, [:string, :pointer, :int], :long
+    attach_function :strlen, [:string], :size_t
+    attach_function :strchr, [:string, :int], :string
+    attach_function :memchr, [:pointer, :int, :size_t], :pointer
+    attach_function :memcpy, [:buffer_out, :buffer_in, :size_t], :pointer
+    attach_function :memmove, [:buffer_inout, :buffer_in, :size_t], :pointer
+    attach_function :qsort, [:pointer, :size_t, :size_t, :direct_compare], :void
+    attach_function :bsearch, [:pointer, :pointer, :size_t, :size_t, :direct_compare], :pointer
+    attach_function :mmap, [:pointer, :size_t, :int, :int, :int, :long], :pointer
+    attach_function :munmap, [:pointer, :size_t], :int
+
+    # Not integer register signatures, so these go through libffi
+    attach_function :atof, [:string], :double
+    attach_function :strlen_blocking, :strlen, [:string], :size_t, blocking: true
+  end
+
+  let(:compare) { proc { |a, b| a.read_int <=> b.read_int } }
+
+  it "takes no arguments" do
+    expect(DirectCallLibC.getpid).to eq(Process.pid)
+  end
+
+  it "sign and zero extends narrow arguments and results" do
+    expect(DirectCallLibC.abs(-42)).to eq(42)
+    expect(DirectCallLibC.abs_int8(-5)).to eq(5)
+    expect(DirectCallLibC.abs_int8(-128)).to eq(-128)
+    expect(DirectCallLibC.abs_int16(-300)).to eq(300)
+    expect(DirectCallLibC.toupper_uint8('a'.ord)).to eq('A'.ord)
+    expect(DirectCallLibC.toupper_uint8(0xe9)).to eq(0xe9)
+    expect(DirectCallLibC.toupper_uint16('z'.ord)).to eq('Z'.ord)
+    expect(DirectCallLibC.abs_uint32(0xffffffff)).to eq(1)
+  end
+
+  it "passes bool and enum arguments" do
+    expect(DirectCallLibC.abs_bool(true)).to eq(1)
+    expect(DirectCallLibC.abs_bool(false)).to eq(0)
+    expect(DirectCallLibC.abs_enum(:negative)).to eq(3)
+    expect(DirectCallLibC.abs_enum(:positive)).to eq(3)
+  end
+
+  it "passes and returns 64-bit and long values" do
+    expect(DirectCallLibC.labs(-(1 << 30))).to eq(1 << 30)
+    expect(DirectCallLibC.labs_int64(-(1 << 40))).to eq(1 << 40)
+    expect(DirectCallLibC.strtoull("18446744073709551615", nil, 10)).to eq(2**64 - 1)
+    expect(DirectCallLibC.strtoul("4294967295", nil, 10)).to eq(4294967295)
+  end
+
+  it "passes strings and returns strings and pointers" do
+    expect(DirectCallLibC.strlen("hello")).to eq(5)
+    expect(DirectCallLibC.strchr("hello", 'l'.ord)).to eq("llo")
+    expect(DirectCallLibC.strchr("hello", 'x'.ord)).to be_nil
+
+    buf = FFI::MemoryPointer.from_string("abcdef")
+    expect(DirectCallLibC.memchr(buf, 'd'.ord, 6).address).to eq(buf.address + 3)
+    expect(DirectCallLibC.memchr(buf, 'x'.ord, 6)).to be_null
+  end
+
+  it "passes buffers" do
+    out = FFI::Buffer.new(:char, 6)
+    DirectCallLibC.memcpy(out, "abcdef", 6)
+    expect(out.get_bytes(0, 6)).to eq("abcdef")
+
+    inout = FFI::Buffer.new(:char, 4)
+    inout.put_bytes(0, "wxyz")
+    DirectCallLibC.memmove(inout, "AB", 2)
+    expect(inout.get_bytes(0, 4)).to eq("AByz")
+  end
+
+  it "passes callbacks with four and five arguments" do
+    values = FFI::MemoryPointer.new(:int, 5).write_array_of_int([5, 3, 9, 1, 7])
+    expect(DirectCallLibC.qsort(values, 5, values.type_size, compare)).to be_nil
+    expect(values.read_array_of_int(5)).to eq([1, 3, 5, 7, 9])
+
+    key = FFI::MemoryPointer.new(:int).write_int(7)
+    expect(DirectCallLibC.bsearch(key, values, 5, values.type_size, compare).address).to eq(values.address + 3 * values.type_size)
+    key.write_int(4)
+    expect(DirectCallLibC.bsearch(key, values, 5, values.type_size, compare)).to be_null
+  end
+
+  it "raises exceptions from callbacks" do
+    values = FFI::MemoryPointer.new(:int, 2).write_array_of_int([2, 1])
+    expect { DirectCallLibC.qsort(values, 2, values.type_size, proc { raise ArgumentError, "from callback" }) }.to raise_error(ArgumentError, "from callback")
+  end
+
+  it "passes six arguments", if: FFI::Platform::IS_LINUX do
+    # PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS
+    page = DirectCallLibC.mmap(nil, 4096, 3, 0x22, -1, 0)
+    expect(page).not_to eq(FFI::Pointer.new(-1))
+    page.put_int(4092, 1234)
+    expect(page.get_int(4092)).to eq(1234)
+    expect(DirectCallLibC.munmap(page, 4096)).to eq(0)
+  end
+
+  it "saves errno" do
+    expect(DirectCallLibC.strtol("9" * 40, nil, 10)).to eq(FFI::Platform::LONG_SIZE == 64 ? 2**63 - 1 : 2**31 - 1)
+    expect(FFI.errno).to eq(Errno::ERANGE::Errno)
+  end
+
+  it "falls back to libffi for other signatures" do
+    expect(DirectCallLibC.atof("2.5")).to eq(2.5)
+    expect(DirectCallLibC.strlen_blocking("hello")).to eq(5)
+  end
+end
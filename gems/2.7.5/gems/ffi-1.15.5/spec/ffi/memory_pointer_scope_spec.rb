@@ -0,0 +1,140 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+describe "FFI::MemoryPointer.scope" do
+  module ArenaLibC
+    extend FFI::Library
+    ffi_lib FFI::Library::LIBC
+    attach_function :memset, [:pointer, :int, :size_t], :pointer
+  end
+
+  class ArenaStruct < FFI::Struct
+    layout :a, :int, :b, :long
+  end
+
+  it "returns the value of the block" do
+    expect(FFI::MemoryPointer.scope { |arena| 42 }).to eq(42)
+    expect { FFI::MemoryPointer.scope }.to raise_error(LocalJumpError)
+  end
+
+  it "allocates pointers of the requested size" do
+    FFI::MemoryPointer.scope do |arena|
+      int = arena.alloc(:int)
+      longs = arena.alloc(:long, 4)
+      bytes = arena.alloc(3, 5)
+      expect(int).to be_kind_of(FFI::MemoryPointer)
+      expect(int.size).to eq(FFI.type_size(:int))
+      expect(int.type_size).to eq(FFI.type_size(:int))
+      expect(longs.size).to eq(4 * FFI.type_size(:long))
+      expect(bytes.size).to eq(15)
+      expect(arena.alloc(:int, 0).size).to eq(0)
+      expect { arena.alloc(:int, -1) }.to raise_error(ArgumentError)
+    end
+  end
+
+  it "allocates distinct, aligned pointers" do
+    FFI::MemoryPointer.scope do |arena|
+      ptrs = [1, 3, 8, 13, 64].map { |n| arena.alloc(n) }
+      ptrs.each { |ptr| expect(ptr.address % 8).to eq(0) }
+      expect(ptrs.map(&:address).uniq.size).to eq(ptrs.size)
+      ptrs.each_with_index { |ptr, i| ArenaLibC.memset(ptr, i + 1, ptr.size) }
+      ptrs.each_with_index { |ptr, i| expect(ptr.get_bytes(0, ptr.size)).to eq((i + 1).chr * ptr.size) }
+    end
+  end
+
+  it "clears memory unless asked not to" do
+    FFI::MemoryPointer.scope do |arena|
+      ArenaLibC.memset(arena.alloc(64, 1, false), 0xff, 64)
+    end
+    FFI::MemoryPointer.scope do |arena|
+      expect(arena.alloc(64).get_bytes(0, 64)).to eq("\0" * 64)
+      expect(arena.alloc(64, 1, nil).get_bytes(0, 64)).to eq("\0" * 64)
+    end
+  end
+
+  it "allocates more than a chunk" do
+    FFI::MemoryPointer.scope do |arena|
+      small = arena.alloc(:int)
+      big = arena.alloc(:char, 100_000)
+      ArenaLibC.memset(big, 'x'.ord, big.size)
+      small.write_int(7)
+      expect(big.get_bytes(big.size - 3, 3)).to eq("xxx")
+      expect(small.read_int).to eq(7)
+      many = (1..200).map { |i| arena.alloc(:int).tap { |ptr| ptr.write_int(i) } }
+      expect(many.map(&:read_int)).to eq((1..200).to_a)
+    end
+  end
+
+  it "invalidates its pointers after the block" do
+    arena, ptr = FFI::MemoryPointer.scope { |a| [a, a.alloc(:int)] }
+    expect(ptr.size).to eq(0)
+    expect { ptr.read_int }.to raise_error(FFI::NullPointerError)
+    expect { ptr.write_int(1) }.to raise_error(FFI::NullPointerError)
+    expect { arena.alloc(:int) }.to raise_error(RuntimeError)
+  end
+
+  it "invalidates its pointers when the block raises" do
+    ptr = nil
+    expect {
+      FFI::MemoryPointer.scope { |arena| ptr = arena.alloc(:int); raise "boom" }
+    }.to raise_error(RuntimeError, "boom")
+    expect { ptr.read_int }.to raise_error(FFI::NullPointerError)
+  end
+
+  it "invalidates pointers and structs derived from its pointers" do
+    derived = FFI::MemoryPointer.scope do |arena|
+      ptr = arena.alloc(:int, 8)
+      ptr.put_array_of_int(0, (1..8).to_a)
+      slice = ptr.slice(8, 16)
+      plus = ptr + 4
+      struct = ArenaStruct.new(arena.alloc(ArenaStruct.size))
+      struct[:a] = 5
+      expect(slice.get_int(0)).to eq(3)
+      expect(plus.read_int).to eq(2)
+      expect(struct[:a]).to eq(5)
+      [slice, slice + 4, slice.slice(4, 4), plus, ptr.order(:big), FFI::Pointer.new(:int, plus), struct, ArenaStruct.new(plus)]
+    end
+    derived.each do |obj|
+      if obj.is_a?(FFI::Struct)
+        expect { obj[:a] }.to raise_error(FFI::NullPointerError)
+      else
+        expect(obj.address).to eq(0)
+        expect { obj.read_int }.to raise_error(FFI::NullPointerError)
+      end
+    end
+  end
+
+  it "nests, each scope invalidating its own pointers" do
+    outer_ptr = inner_ptr = nil
+    FFI::MemoryPointer.scope do |outer|
+      outer_ptr = outer.alloc(:int)
+      outer_ptr.write_int(1)
+      FFI::MemoryPointer.scope { |inner| inner_ptr = inner.alloc(:int) }
+      expect { inner_ptr.read_int }.to raise_error(FFI::NullPointerError)
+      expect(outer_ptr.read_int).to eq(1)
+    end
+    expect { outer_ptr.read_int }.to raise_error(FFI::NullPointerError)
+  end
+
+  it "works on several threads" do
+    results = 4.times.map do |t|
+      Thread.new do
+        100.times.map do |i|
+          FFI::MemoryPointer.scope { |arena| arena.alloc(:int).tap { |ptr| ptr.write_int(t * 1000 + i) }.read_int }
+        end
+      end
+    end.map(&:value)
+    expect(results).to eq(4.times.map { |t| 100.times.map { |i| t * 1000 + i } })
+  end
+
+  it "is not confused by thread locals" do
+    Thread.current[:ffi_arena_cache] = FFI::MemoryPointer.new(:int)
+    expect(FFI::MemoryPointer.scope { |arena| arena.alloc(:int).tap { |ptr| ptr.write_int(9) }.read_int }).to eq(9)
+  ensure
+    Thread.current[:ffi_arena_cache] = nil
+  end
+end
@@ -0,0 +1,90 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+describe "Packed array accessors" do
+  # type => [size, pack directive, signed]
+  PACKED_INTEGER_TYPES = {
+    int16: [2, "s", true], uint16: [2, "S", false],
+    int32: [4, "l", true], uint32: [4, "L", false],
+    int64: [8, "q", true], uint64: [8, "Q", false],
+    long: [FFI::Type::LONG.size, "l!", true], ulong: [FFI::Type::ULONG.size, "L!", false],
+  }
+
+  # Element counts which don't fill whole 16 byte vectors, around the ones that do
+  PACKED_COUNTS = [1, 3, 7, 8, 9, 17, 33]
+
+  def values(count, size, signed)
+    bits = size * 8
+    (0...count).map do |i|
+      v = (0x0123456789abcdef * (i + 1) + 0x5a) & ((1 << bits) - 1)
+      signed && v >= (1 << (bits - 1)) ? v - (1 << bits) : v
+    end
+  end
+
+  PACKED_INTEGER_TYPES.each do |type, (size, directive, signed)|
+    [:big, :little].each do |order|
+      endian = order == :big ? ">" : "<"
+
+      it "puts #{type} in #{order} endian order" do
+        PACKED_COUNTS.each do |count|
+          ary = values(count, size, signed)
+          memory = FFI::MemoryPointer.new(:char, count * size + 1).order(order)
+          expect(memory.send("put_packed_array_of_#{type}", 1, ary.pack("#{directive}*"))).to eq(memory)
+          expect(memory.get_bytes(1, count * size)).to eq(ary.pack("#{directive}#{endian}*"))
+          expect(memory.send("get_array_of_#{type}", 1, count)).to eq(ary)
+        end
+      end
+
+      it "gets #{type} in #{order} endian order" do
+        PACKED_COUNTS.each do |count|
+          ary = values(count, size, signed)
+          memory = FFI::MemoryPointer.new(:char, count * size + 1).order(order)
+          memory.put_bytes(1, ary.pack("#{directive}#{endian}*"))
+          packed = memory.send("get_packed_array_of_#{type}", 1, count)
+          expect(packed.encoding).to eq(Encoding::BINARY)
+          expect(packed.unpack("#{directive}*")).to eq(ary)
+          expect((memory + 1).send("read_packed_array_of_#{type}", count)).to eq(packed)
+        end
+      end
+    end
+  end
+
+  it "copies bytes as they are" do
+    bytes = (0...37).map { |i| (i * 37) & 0xff }.pack("C*")
+    memory = FFI::MemoryPointer.new(:char, 37).order(:big)
+    memory.write_packed_array_of_uint8(bytes)
+    expect(memory.read_packed_array_of_uint8(37)).to eq(bytes)
+    expect(memory.get_packed_array_of_int8(0, 37).unpack("c*")).to eq(bytes.unpack("c*"))
+  end
+
+  it "doesn't swap floating point values" do
+    floats = [1.5, -2.25, 3.0e10, 0.1, 7.0]
+    [:big, :little].each do |order|
+      memory = FFI::MemoryPointer.new(:double, floats.size).order(order)
+      memory.write_packed_array_of_float64(floats.pack("d*"))
+      expect(memory.read_bytes(floats.size * 8)).to eq(floats.pack("d*"))
+      expect(memory.read_packed_array_of_float64(floats.size).unpack("d*")).to eq(floats)
+      memory.write_packed_array_of_float32(floats.pack("f*"))
+      expect(memory.read_packed_array_of_float32(floats.size).unpack("f*")).to eq(floats.pack("f*").unpack("f*"))
+    end
+  end
+
+  it "has the usual aliases" do
+    memory = FFI::MemoryPointer.new(:int, 3)
+    memory.write_packed_array_of_int([1, -2, 3].pack("l*"))
+    expect(memory.read_packed_array_of_int32(3).unpack("l*")).to eq([1, -2, 3])
+  end
+
+  it "checks lengths and bounds" do
+    memory = FFI::MemoryPointer.new(:int32, 4)
+    expect { memory.put_packed_array_of_int32(0, "abc") }.to raise_error(ArgumentError)
+    expect { memory.put_packed_array_of_int32(4, [1, 2, 3, 4].pack("l*")) }.to raise_error(IndexError)
+    expect { memory.get_packed_array_of_int32(0, 5) }.to raise_error(IndexError)
+    expect { memory.get_packed_array_of_int32(0, -1) }.to raise_error(IndexError)
+    expect(memory.get_packed_array_of_int32(16, 0)).to eq("")
+  end
+end
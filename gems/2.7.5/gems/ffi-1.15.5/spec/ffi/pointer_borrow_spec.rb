@@ -0,0 +1,95 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+describe "FFI::Pointer.borrow" do
+  module BorrowLibC
+    extend FFI::Library
+    ffi_lib FFI::Library::LIBC
+    attach_function :strlen, [:pointer], :size_t
+    attach_function :memset, [:pointer, :int, :size_t], :pointer
+  end
+
+  class BorrowStruct < FFI::Struct
+    layout :a, :uint8, :b, :uint8
+  end
+
+  it "points at the contents of a string" do
+    str = "hello world"
+    ptr = FFI::Pointer.borrow(str)
+    expect(ptr.read_bytes(str.bytesize)).to eq(str)
+    expect(ptr.size).to eq(str.bytesize)
+    expect { ptr.put_uint8(0, 1) }.to raise_error(RuntimeError)
+    expect(FFI::Pointer.borrow(str) { |p| BorrowLibC.strlen(p) }).to eq(str.bytesize)
+  end
+
+  it "keeps a read-only pointer on the string as it was" do
+    str = "abcdef" * 10
+    ptr = FFI::Pointer.borrow(str)
+    str.replace("x")
+    expect(ptr.read_bytes(60)).to eq("abcdef" * 10)
+  end
+
+  it "lets native code write to the string in a block" do
+    str = "abcdef"
+    FFI::Pointer.borrow(str, true) do |ptr|
+      BorrowLibC.memset(ptr + 2, 'z'.ord, 3)
+      expect { str << "g" }.to raise_error(RuntimeError)
+    end
+    expect(str).to eq("abzzzf")
+    expect { FFI::Pointer.borrow("x".freeze, true) { } }.to raise_error(FrozenError)
+    expect { FFI::Pointer.borrow(+"x", true) }.to raise_error(ArgumentError)
+  end
+
+  it "clears a pointer which escapes its block" do
+    escaped = FFI::Pointer.borrow("abcdef") { |ptr| ptr }
+    expect(escaped.size).to eq(0)
+    expect { escaped.read_bytes(1) }.to raise_error(FFI::NullPointerError)
+  end
+
+  it "clears pointers derived from one which escape its block" do
+    str = "abcdefgh"
+    derived = FFI::Pointer.borrow(str, true) do |ptr|
+      plus = ptr + 4
+      slice = ptr.slice(2, 4)
+      [plus, slice, slice + 1, slice.slice(1, 2), ptr.order(:big), ptr.order(:little), FFI::Pointer.new(ptr), FFI::Pointer.new(:uint16, plus)]
+    end
+    derived.each do |ptr|
+      expect(ptr.address).to eq(0)
+      expect { ptr.get_uint8(0) }.to raise_error(FFI::NullPointerError)
+      expect { ptr.put_uint8(0, 1) }.to raise_error(FFI::NullPointerError)
+    end
+
+    # The string is the caller's again
+    str << "ijkl"
+    expect(str).to eq("abcdefghijkl")
+  end
+
+  it "reads through derived pointers within the block" do
+    FFI::Pointer.borrow("abcdefgh") do |ptr|
+      expect((ptr + 4).read_bytes(4)).to eq("efgh")
+      expect(ptr.slice(2, 3).read_bytes(3)).to eq("cde")
+      expect(FFI::Pointer.new(ptr + 1).read_bytes(2)).to eq("bc")
+    end
+  end
+
+  it "clears structs on pointers which escape the block" do
+    struct = FFI::Pointer.borrow("\x01\x02\x03".b) do |ptr|
+      s = BorrowStruct.new(ptr + 1)
+      expect(s[:a]).to eq(2)
+      expect(s[:b]).to eq(3)
+      s
+    end
+    expect { struct[:a] }.to raise_error(FFI::NullPointerError)
+  end
+
+  it "leaves pointers derived from one borrowed without a block alone" do
+    ptr = FFI::Pointer.borrow("abcdef")
+    plus = ptr + 2
+    GC.start
+    expect(plus.read_bytes(4)).to eq("cdef")
+  end
+end
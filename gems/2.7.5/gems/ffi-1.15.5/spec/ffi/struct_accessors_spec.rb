@@ -0,0 +1,135 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+describe "FFI::Struct.freeze_layout!" do
+  class AccessorStruct < FFI::Struct
+    layout :x, :int, :y, :double, :name, [:char, 8], :size, :int, :p, :int, :format, :int,
+           :test, :int, :open, :int, :select, :int, :initialize, :int
+    freeze_layout!
+  end
+
+  class AccessorChild < AccessorStruct
+    layout :y, :int, :x, :long_long, :z, :short
+    freeze_layout!
+  end
+
+  class AccessorOtherStruct < FFI::Struct
+    layout :b, :int, :a, :int, :x, :int
+  end
+
+  WideStruct = Class.new(FFI::Struct) do
+    layout(*(0...70).flat_map { |i| [:"f#{i}", :int] })
+    freeze_layout!
+  end
+
+  it "reads and writes the fields" do
+    s = AccessorStruct.new
+    expect(s.x = 5).to eq(5)
+    s.y = 1.5
+    expect(s.x).to eq(5)
+    expect(s.y).to eq(1.5)
+    expect(s[:x]).to eq(5)
+    s[:y] = 2.5
+    expect(s.y).to eq(2.5)
+    expect(s.name).to be_kind_of(FFI::StructLayout::CharArray)
+    expect { s.x = "a" }.to raise_error(TypeError)
+  end
+
+  it "shadows private Kernel methods" do
+    s = AccessorStruct.new
+    [:p, :format, :test, :open, :select].each_with_index do |name, i|
+      s.public_send(:"#{name}=", i + 10)
+      expect(s.public_send(name)).to eq(i + 10)
+      expect(s[name]).to eq(i + 10)
+    end
+  end
+
+  it "leaves public methods and #initialize alone" do
+    s = AccessorStruct.new
+    expect(s.size).to eq(AccessorStruct.size)
+    expect(AccessorStruct.public_method_defined?(:size=)).to be false
+    expect(AccessorStruct.public_method_defined?(:initialize=)).to be false
+    expect(AccessorStruct.new(FFI::MemoryPointer.new(AccessorStruct.size)).x).to eq(0)
+  end
+
+  it "defines the reader and the writer of a field as a pair" do
+    klass = Class.new(FFI::Struct) do
+      layout :a, :int, :b, :int
+      def b=(value)
+        self[:b] = value * 2
+      end
+      freeze_layout!
+    end
+    expect(klass.public_method_defined?(:a=)).to be true
+    expect(klass.public_method_defined?(:b)).to be false
+    s = klass.new
+    s.b = 2
+    expect(s[:b]).to eq(4)
+  end
+
+  it "reads the right field of a subclass with a layout of its own" do
+    c = AccessorChild.new
+    c[:x] = 1 << 40
+    c[:y] = 7
+    c.z = 3
+    expect(c.x).to eq(1 << 40)
+    expect(c.y).to eq(7)
+    expect(c.z).to eq(3)
+    c.x = 2
+    expect(c[:x]).to eq(2)
+    expect { c.p }.to raise_error(ArgumentError)
+
+    s = AccessorStruct.new
+    s.x = 4
+    expect(s.x).to eq(4)
+  end
+
+  it "reads the right field of an instance with a layout of its own" do
+    s = AccessorStruct.new
+    s.send(:layout=, AccessorOtherStruct.new.layout)
+    s[:x] = 9
+    s[:b] = 1
+    expect(s.x).to eq(9)
+    s.x = 6
+    expect(s[:x]).to eq(6)
+    expect(s[:b]).to eq(1)
+  end
+
+  it "reads the right field after the layout is redefined" do
+    klass = Class.new(FFI::Struct) do
+      layout :a, :int, :b, :int
+      freeze_layout!
+    end
+    old = klass.new
+    old.b = 1
+    verbose, $VERBOSE = $VERBOSE, nil
+    begin
+      klass.layout :b, :int, :a, :int, :c, :int
+    ensure
+      $VERBOSE = verbose
+    end
+    s = klass.new
+    s[:a] = 2
+    expect(s.a).to eq(2)
+    expect(s.b).to eq(0)
+    expect(old.b).to eq(1)
+
+    klass.freeze_layout!
+    s.c = 3
+    s.b = 4
+    expect(s.values).to eq([4, 2, 3])
+  end
+
+  it "defines accessors for fields past the 64th" do
+    s = WideStruct.new
+    70.times { |i| s.public_send(:"f#{i}=", i * 3) }
+    70.times { |i| expect(s.public_send(:"f#{i}")).to eq(i * 3) }
+    expect(s[:f63]).to eq(189)
+    expect(s[:f64]).to eq(192)
+    expect(s[:f69]).to eq(207)
+  end
+end
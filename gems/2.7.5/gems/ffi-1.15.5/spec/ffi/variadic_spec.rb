@@ -0,0 +1,52 @@
+#
+# This file is part of ruby-ffi.
+# For licensing, see LICENSE.SPECS
+#
+
+require 'ffi'
+
+describe "Variadic calls" do
+  module VariadicLibC
+    extend FFI::Library
+    ffi_lib FFI::Library::LIBC
+    attach_function :snprintf, [:pointer, :size_t, :string, :varargs], :int
+  end
+
+  def format(fmt, *args)
+    buf = FFI::MemoryPointer.new(:char, 128)
+    VariadicLibC.snprintf(buf, buf.size, fmt, *args)
+    buf.read_string
+  end
+
+  # A string argument which makes variadic calls of its own while it is
+  # converted, one shape more than the CIF cache holds
+  class VariadicNestedString
+    attr_reader :results
+
+    def initialize(spec, s)
+      @spec = spec
+      @s = s
+    end
+
+    def to_ptr
+      @results = (1..9).map do |n|
+        @spec.format("%d" * n, *([:int, 1] * n)) + @spec.format("%f" * n, *([:double, 2.5] * n))
+      end
+      FFI::MemoryPointer.from_string(@s)
+    end
+  end
+
+  it "formats arguments of different types" do
+    expect(format("%d %s %.1f %ld", :int, -3, :string, "x", :double, 1.5, :long, 1 << 40)).to eq("-3 x 1.5 1099511627776")
+  end
+
+  it "keeps the CIF of a call whose argument conversion evicts it" do
+    nested = VariadicNestedString.new(self, "outer")
+    expect(format("%s %d %.2f", :pointer, nested, :int, 42, :double, 0.25)).to eq("outer 42 0.25")
+    expect(nested.results).to eq((1..9).map { |n| "1" * n + "2.500000" * n })
+
+    # The cache still gives the right answer for shapes it evicted or kept
+    expect(format("%d%d", :int, 1, :int, 1)).to eq("11")
+    expect(format("%s %d %.2f", :string, "again", :int, 7, :double, 0.5)).to eq("again 7 0.50")
+  end
+end
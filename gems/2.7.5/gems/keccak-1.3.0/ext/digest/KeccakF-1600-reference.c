@@ -206,8 +206,15 @@ void KeccakInitializeRhoOffsets()
 
 void KeccakInitialize()
 {
+    // The tables are read by permutations running without the GVL,
+    // so they must only be written once
+    static int initialized = 0;
+
+    if (initialized)
+        return;
     KeccakInitializeRoundConstants();
     KeccakInitializeRhoOffsets();
+    initialized = 1;
 }
 
 void displayRoundConstants(FILE *f)
@@ -40,6 +40,99 @@ HashReturn Init(hashState *state, int hashbitlen)
     return SUCCESS;
 }
 
+HashReturn InitSHA3(hashState *state, int hashbitlen)
+{
+    HashReturn result;
+
+    if (hashbitlen == 0)
+        return BAD_HASHLEN; // SHA3 only comes with fixed output lengths
+    result = Init(state, hashbitlen);
+    if (result != SUCCESS)
+        return result;
+    SetDomainSuffix((spongeState*)state, 0x02, 2);
+    return SUCCESS;
+}
+
+HashReturn InitSHAKE(hashState *state, int securitylevel)
+{
+    switch(securitylevel) {
+        case 128:
+            InitSponge((spongeState*)state, 1344, 256);
+            break;
+        case 256:
+            InitSponge((spongeState*)state, 1088, 512);
+            break;
+        default:
+            return BAD_HASHLEN;
+    }
+    state->fixedOutputLength = securitylevel;
+    SetDomainSuffix((spongeState*)state, 0x0F, 4);
+    return SUCCESS;
+}
+
+HashReturn InitCSHAKE(hashState *state, int securitylevel, const BitSequence *name, DataLength namebitlen, const BitSequence *custom, DataLength custombitlen)
+{
+    HashReturn result;
+
+    result = InitSHAKE(state, securitylevel);
+    if ((result != SUCCESS) || ((namebitlen == 0) && (custombitlen == 0)))
+        return result;
+    // bytepad(encode_string(N) || encode_string(S), rate/8)
+    if (AbsorbLeftEncoded((spongeState*)state, state->rate/8) != 0)
+        return FAIL;
+    if (AbsorbEncodedString((spongeState*)state, name, namebitlen) != 0)
+        return FAIL;
+    if (AbsorbEncodedString((spongeState*)state, custom, custombitlen) != 0)
+        return FAIL;
+    if (AbsorbZeroesToBlockBoundary((spongeState*)state) != 0)
+        return FAIL;
+    SetDomainSuffix((spongeState*)state, 0x00, 2);
+    return SUCCESS;
+}
+
+HashReturn Reinit(hashState *state)
+{
+    unsigned int fixedOutputLength = state->fixedOutputLength;
+    unsigned char domainSuffix = state->domainSuffix;
+    unsigned int domainSuffixLength = state->domainSuffixLength;
+
+    if (InitSponge((spongeState*)state, state->rate, state->capacity) != 0)
+        return FAIL;
+    state->fixedOutputLength = fixedOutputLength;
+    SetDomainSuffix((spongeState*)state, domainSuffix, domainSuffixLength);
+    return SUCCESS;
+}
+
+static void Wipe(hashState *state)
+{
+    volatile unsigned char *p = (volatile unsigned char *)state;
+    size_t i;
+
+    for(i=0; i<sizeof(hashState); i++)
+        p[i] = 0;
+}
+
+HashReturn KMAC(int securitylevel, const BitSequence *key, DataLength keybitlen, const BitSequence *data, DataLength databitlen, const BitSequence *custom, DataLength custombitlen, BitSequence *output, DataLength outputbitlen)
+{
+    static const BitSequence name[] = { 'K', 'M', 'A', 'C' };
+    hashState state;
+    HashReturn result;
+
+    if ((outputbitlen % 8) != 0)
+        return FAIL;
+    result = InitCSHAKE(&state, securitylevel, name, sizeof(name)*8, custom, custombitlen);
+    if (result != SUCCESS)
+        return result;
+    // bytepad(encode_string(K), rate/8) || X || right_encode(L)
+    if ((AbsorbBytepaddedString(&state, key, keybitlen) != 0)
+        || (Absorb(&state, data, databitlen) != 0)
+        || (AbsorbRightEncoded(&state, outputbitlen) != 0)
+        || (Squeeze(&state, output, outputbitlen) != 0))
+        result = FAIL;
+    Wipe(&state);
+    return result;
+}
+
 HashReturn Update(hashState *state, const BitSequence *data, DataLength databitlen)
 {
     if ((databitlen % 8) == 0)
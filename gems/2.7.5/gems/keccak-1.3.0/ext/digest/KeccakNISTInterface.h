@@ -33,6 +33,62 @@ typedef spongeState hashState;
   * @return SUCCESS if successful, BAD_HASHLEN if the value of hashbitlen is incorrect.
   */
 HashReturn Init(hashState *state, int hashbitlen);
+/**
+  * Function to initialize the state for one of the FIPS 202 SHA3 hash functions.
+  * This is the same as Init() except that the domain separation bits 01 are
+  * appended to the input before padding.
+  * @param  state       Pointer to the state of the sponge function to be initialized.
+  * @param  hashbitlen  The desired number of output bits.
+  * @pre    The value of hashbitlen must be one of 224, 256, 384 and 512.
+  * @return SUCCESS if successful, BAD_HASHLEN if the value of hashbitlen is incorrect.
+  */
+HashReturn InitSHA3(hashState *state, int hashbitlen);
+/**
+  * Function to initialize the state for one of the FIPS 202 SHAKE extendable-output functions.
+  * Final() produces @a securitylevel bits, use Squeeze() for output of any other length.
+  * @param  state       Pointer to the state of the sponge function to be initialized.
+  * @param  securitylevel   128 for SHAKE128 or 256 for SHAKE256.
+  * @return SUCCESS if successful, BAD_HASHLEN if the value of securitylevel is incorrect.
+  */
+HashReturn InitSHAKE(hashState *state, int securitylevel);
+/**
+  * Function to initialize the state for cSHAKE128 or cSHAKE256 (NIST SP 800-185).
+  * The function name and customization string are absorbed right away.
+  * When both are empty, the result is the same as InitSHAKE().
+  * @param  state       Pointer to the state of the sponge function to be initialized.
+  * @param  securitylevel   128 for cSHAKE128 or 256 for cSHAKE256.
+  * @param  name        Pointer to the function name N.
+  * @param  namebitlen  The number of bits in @a name, it must be a multiple of 8.
+  * @param  custom      Pointer to the customization string S.
+  * @param  custombitlen    The number of bits in @a custom, it must be a multiple of 8.
+  * @return SUCCESS if successful, BAD_HASHLEN if the value of securitylevel is incorrect,
+  *         FAIL otherwise.
+  */
+HashReturn InitCSHAKE(hashState *state, int securitylevel, const BitSequence *name, DataLength namebitlen, const BitSequence *custom, DataLength custombitlen);
+/**
+  * Function to return the state to where Init(), InitSHA3() or InitSHAKE() left it,
+  * with the same parameters, discarding any data absorbed or output squeezed since.
+  * A prefix absorbed by InitCSHAKE() is discarded as well.
+  * @param  state       Pointer to the state of the sponge function initialized by one of the above.
+  * @return SUCCESS if successful, FAIL otherwise.
+  */
+HashReturn Reinit(hashState *state);
+/**
+  * Function to compute KMAC128 or KMAC256 (NIST SP 800-185) in one go.
+  * The key is only ever copied into the sponge state, which is wiped before returning.
+  * @param  securitylevel   128 for KMAC128 or 256 for KMAC256.
+  * @param  key         Pointer to the key K.
+  * @param  keybitlen   The number of bits in @a key, it must be a multiple of 8.
+  * @param  data        Pointer to the input data X.
+  * @param  databitlen  The number of bits in @a data, it must be a multiple of 8.
+  * @param  custom      Pointer to the customization string S.
+  * @param  custombitlen    The number of bits in @a custom, it must be a multiple of 8.
+  * @param  output      Pointer to the buffer where to store the output.
+  * @param  outputbitlen    The number of output bits L, it must be a multiple of 8.
+  * @return SUCCESS if successful, BAD_HASHLEN if the value of securitylevel is incorrect,
+  *         FAIL otherwise.
+  */
+HashReturn KMAC(int securitylevel, const BitSequence *key, DataLength keybitlen, const BitSequence *data, DataLength databitlen, const BitSequence *custom, DataLength custombitlen, BitSequence *output, DataLength outputbitlen);
 /**
   * Function to give input data for the sponge function to absorb.
   * @param  state       Pointer to the state of the sponge function initialized by Init().
@@ -33,6 +33,8 @@ int InitSponge(spongeState *state, unsigned int rate, unsigned int capacity)
     state->bitsInQueue = 0;
     state->squeezing = 0;
     state->bitsAvailableForSqueezing = 0;
+    state->domainSuffix = 0;
+    state->domainSuffixLength = 0;
 
     return 0;
 }
@@ -193,7 +195,17 @@ int Absorb(spongeState *state, const unsigned char *data, unsigned long long dat
 
 void PadAndSwitchToSqueezingPhase(spongeState *state)
 {
+    unsigned int i;
+
     // Note: the bits are numbered from 0=LSB to 7=MSB
+    for(i=0; i<state->domainSuffixLength; i++) {
+        if ((state->bitsInQueue % 8) == 0)
+            state->dataQueue[state->bitsInQueue/8] = 0;
+        state->dataQueue[state->bitsInQueue/8] |= ((state->domainSuffix >> i) & 1) << (state->bitsInQueue % 8);
+        state->bitsInQueue++;
+        if (state->bitsInQueue == state->rate)
+            AbsorbQueue(state);
+    }
     if (state->bitsInQueue + 1 == state->rate) {
         state->dataQueue[state->bitsInQueue/8 ] |= 1 << (state->bitsInQueue % 8);
         AbsorbQueue(state);
@@ -264,3 +276,92 @@ int Squeeze(spongeState *state, unsigned char *output, unsigned long long output
     }
     return 0;
 }
+
+void CopySpongeState(spongeState *dest, const spongeState *source)
+{
+    unsigned int queueBytes;
+
+    if (source->squeezing)
+        queueBytes = source->rate/8;
+    else
+        queueBytes = (source->bitsInQueue+7)/8;
+    memcpy(dest->state, source->state, KeccakPermutationSizeInBytes);
+    memcpy(dest->dataQueue, source->dataQueue, queueBytes);
+    dest->rate = source->rate;
+    dest->capacity = source->capacity;
+    dest->bitsInQueue = source->bitsInQueue;
+    dest->fixedOutputLength = source->fixedOutputLength;
+    dest->squeezing = source->squeezing;
+    dest->bitsAvailableForSqueezing = source->bitsAvailableForSqueezing;
+    dest->domainSuffix = source->domainSuffix;
+    dest->domainSuffixLength = source->domainSuffixLength;
+}
+
+int SetDomainSuffix(spongeState *state, unsigned char suffix, unsigned int suffixLength)
+{
+    if (suffixLength > 8)
+        return 1;
+    if (state->squeezing)
+        return 1; // Too late, the padding has been applied already
+    state->domainSuffix = suffix;
+    state->domainSuffixLength = suffixLength;
+    return 0;
+}
+
+int AbsorbLeftEncoded(spongeState *state, unsigned long long value)
+{
+    unsigned char encoded[sizeof(unsigned long long)+1];
+    unsigned int n, i;
+
+    for(n=1; (n < sizeof(unsigned long long)) && ((value >> (8*n)) != 0); n++)
+        ;
+    encoded[0] = (unsigned char)n;
+    for(i=1; i<=n; i++)
+        encoded[i] = (unsigned char)(value >> (8*(n-i)));
+    return Absorb(state, encoded, (n+1)*8);
+}
+
+int AbsorbRightEncoded(spongeState *state, unsigned long long value)
+{
+    unsigned char encoded[sizeof(unsigned long long)+1];
+    unsigned int n, i;
+
+    for(n=1; (n < sizeof(unsigned long long)) && ((value >> (8*n)) != 0); n++)
+        ;
+    for(i=0; i<n; i++)
+        encoded[i] = (unsigned char)(value >> (8*(n-1-i)));
+    encoded[n] = (unsigned char)n;
+    return Absorb(state, encoded, (n+1)*8);
+}
+
+int AbsorbEncodedString(spongeState *state, const unsigned char *data, unsigned long long databitlen)
+{
+    if ((databitlen % 8) != 0)
+        return 1;
+    if (AbsorbLeftEncoded(state, databitlen) != 0)
+        return 1;
+    return Absorb(state, data, databitlen);
+}
+
+int AbsorbZeroesToBlockBoundary(spongeState *state)
+{
+    unsigned char zeroes[KeccakMaximumRateInBytes];
+
+    if ((state->bitsInQueue % 8) != 0)
+        return 1;
+    if (state->bitsInQueue == 0)
+        return 0;
+    memset(zeroes, 0, sizeof(zeroes));
+    return Absorb(state, zeroes, state->rate - state->bitsInQueue);
+}
+
+int AbsorbBytepaddedString(spongeState *state, const unsigned char *data, unsigned long long databitlen)
+{
+    if (state->bitsInQueue != 0)
+        return 1;
+    if (AbsorbLeftEncoded(state, state->rate/8) != 0)
+        return 1;
+    if (AbsorbEncodedString(state, data, databitlen) != 0)
+        return 1;
+    return AbsorbZeroesToBlockBoundary(state);
+}
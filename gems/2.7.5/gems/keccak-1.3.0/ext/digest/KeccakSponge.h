@@ -36,6 +36,8 @@ ALIGN typedef struct spongeStateStruct {
     unsigned int fixedOutputLength;
     int squeezing;
     unsigned int bitsAvailableForSqueezing;
+    unsigned char domainSuffix;
+    unsigned int domainSuffixLength;
 } spongeState;
 
 /**
@@ -72,5 +74,66 @@ int Absorb(spongeState *state, const unsigned char *data, unsigned long long dat
   * @return Zero if successful, 1 otherwise.
   */
 int Squeeze(spongeState *state, unsigned char *output, unsigned long long outputLength);
+/**
+  * Function to copy the state of a sponge function, e.g. after absorbing a common prefix,
+  * so that absorbing can continue from the copy independently.
+  * Only the parts of the data queue that are in use are copied.
+  * @param  dest        Pointer to the state to be overwritten.
+  * @param  source      Pointer to the state of the sponge function initialized by InitSponge().
+  */
+void CopySpongeState(spongeState *dest, const spongeState *source);
+/**
+  * Function to set the domain separation bits appended to the input before padding,
+  * as used by the FIPS 202 functions (SHA3: 01, SHAKE: 1111, cSHAKE: 00).
+  * The original Keccak padding corresponds to a suffix of length 0, the default.
+  * @param  state       Pointer to the state of the sponge function initialized by InitSponge().
+  * @param  suffix      The suffix bits, the first one in the least significant bit.
+  * @param  suffixLength    The number of suffix bits, at most 8.
+  * @pre    The sponge function must be in the absorbing phase.
+  * @return Zero if successful, 1 otherwise.
+  */
+int SetDomainSuffix(spongeState *state, unsigned char suffix, unsigned int suffixLength);
+/**
+  * Function to absorb the integer @a value encoded as left_encode(value) of NIST SP 800-185.
+  * @param  state       Pointer to the state of the sponge function initialized by InitSponge().
+  * @param  value       The integer to encode.
+  * @pre    The previous input absorbed was a whole number of bytes.
+  * @return Zero if successful, 1 otherwise.
+  */
+int AbsorbLeftEncoded(spongeState *state, unsigned long long value);
+/**
+  * Function to absorb the integer @a value encoded as right_encode(value) of NIST SP 800-185.
+  * @param  state       Pointer to the state of the sponge function initialized by InitSponge().
+  * @param  value       The integer to encode.
+  * @pre    The previous input absorbed was a whole number of bytes.
+  * @return Zero if successful, 1 otherwise.
+  */
+int AbsorbRightEncoded(spongeState *state, unsigned long long value);
+/**
+  * Function to absorb a string encoded as encode_string(data) of NIST SP 800-185,
+  * i.e. left_encode(databitlen) followed by the data itself.
+  * @param  state       Pointer to the state of the sponge function initialized by InitSponge().
+  * @param  data        Pointer to the input data.
+  * @param  databitlen  The number of input bits, it must be a multiple of 8.
+  * @return Zero if successful, 1 otherwise.
+  */
+int AbsorbEncodedString(spongeState *state, const unsigned char *data, unsigned long long databitlen);
+/**
+  * Function to absorb zero bytes up to the next block boundary,
+  * completing bytepad(X, rate/8) of NIST SP 800-185 when X was absorbed
+  * from the start of the sponge preceded by left_encode(rate/8).
+  * @param  state       Pointer to the state of the sponge function initialized by InitSponge().
+  * @return Zero if successful, 1 otherwise.
+  */
+int AbsorbZeroesToBlockBoundary(spongeState *state);
+/**
+  * Function to absorb bytepad(encode_string(data), rate/8) of NIST SP 800-185,
+  * as done with the key at the start of KMAC.
+  * @param  state       Pointer to the state of the sponge function, at a block boundary.
+  * @param  data        Pointer to the input data.
+  * @param  databitlen  The number of input bits, it must be a multiple of 8.
+  * @return Zero if successful, 1 otherwise.
+  */
+int AbsorbBytepaddedString(spongeState *state, const unsigned char *data, unsigned long long databitlen);
 
 #endif
@@ -4,11 +4,24 @@
 #else
 #include "digest.h"
 #endif
+#include "ruby/io.h"
+#include "ruby/thread.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "KeccakNISTInterface.h"
 
 #define MAX_DIGEST_SIZE 64
 #define DEFAULT_DIGEST_LEN 512
 
+/* Inputs of at least this many bytes are absorbed with the GVL released,
+   below it the cost of giving up the lock outweighs the permutation work. */
+#define NOGVL_THRESHOLD (64 * 1024)
+/* Size of the chunks read from disk by Digest::Keccak#file. */
+#define FILE_CHUNK_SIZE (1024 * 1024)
+
+static ID id_initial_state;
+
 static int keccak_init_func();
 static void keccak_update_func(hashState *ctx, unsigned char *str, size_t len);
 static int keccak_finish_func(hashState *ctx, unsigned char *digest);
@@ -69,23 +82,213 @@ rb_keccak_finish(VALUE self) {
   return digest;
 }
 
+struct keccak_update_arg {
+	hashState *ctx;
+	const unsigned char *data;
+	size_t len;
+};
+
+static void *
+keccak_update_nogvl(void *ptr) {
+	struct keccak_update_arg *arg = (struct keccak_update_arg *)ptr;
+
+	keccak_update_func(arg->ctx, (unsigned char *)arg->data, arg->len);
+	return NULL;
+}
+
+static VALUE
+keccak_update_locked(VALUE ptr) {
+	/* Absorbing can't be stopped part way without corrupting the state, so
+	   there is no unblock function: a pending interrupt is raised once the
+	   whole string has been absorbed. */
+	rb_thread_call_without_gvl(keccak_update_nogvl, (void *)ptr, NULL, NULL);
+	return Qnil;
+}
+
+static VALUE
+keccak_update_unlock(VALUE str) {
+	return rb_str_unlocktmp(str);
+}
+
+/* Ruby method.  Digest::Keccak#update(string)
+ * Large strings are absorbed without holding the GVL, the string is
+ * locked against modification for the duration.  This can't be
+ * interrupted; Thread#raise and the like take effect once it's done.
+ * @param string [String] data to add to the digest.
+ * @returns [Digest::Keccak] self
+ */
+static VALUE
+rb_keccak_update(VALUE self, VALUE str) {
+	struct keccak_update_arg arg;
+
+	StringValue(str);
+	rb_check_frozen(self);
+	arg.ctx = (hashState *)RTYPEDDATA_DATA(self);
+	if (arg.ctx->squeezing)
+		rb_raise(rb_eRuntimeError, "Cannot update a digest after squeezing output from it");
+	arg.data = (const unsigned char *)RSTRING_PTR(str);
+	arg.len = RSTRING_LEN(str);
+
+	if (arg.len < NOGVL_THRESHOLD) {
+		keccak_update_nogvl(&arg);
+	} else {
+		rb_str_locktmp(str);
+		rb_ensure(keccak_update_locked, (VALUE)&arg, keccak_update_unlock, str);
+	}
+	RB_GC_GUARD(str);
+
+	return self;
+}
+
+struct keccak_file_arg {
+	hashState *ctx;
+	int fd;
+	unsigned char *buf;
+	ssize_t nread;
+	int err;
+};
+
+/* Reads one chunk and absorbs it, called without the GVL. */
+static void *
+keccak_file_chunk_nogvl(void *ptr) {
+	struct keccak_file_arg *arg = (struct keccak_file_arg *)ptr;
+
+	arg->nread = read(arg->fd, arg->buf, FILE_CHUNK_SIZE);
+	if (arg->nread < 0) {
+		arg->err = errno;
+		return NULL;
+	}
+	keccak_update_func(arg->ctx, arg->buf, (size_t)arg->nread);
+	return NULL;
+}
+
+static VALUE
+keccak_file_read(VALUE ptr) {
+	struct keccak_file_arg *arg = (struct keccak_file_arg *)ptr;
+
+	for (;;) {
+		arg->err = 0;
+		rb_thread_call_without_gvl(keccak_file_chunk_nogvl, arg, RUBY_UBF_IO, NULL);
+		if (arg->nread == 0)
+			break;
+		if (arg->nread < 0 && arg->err != EINTR && arg->err != EAGAIN)
+			return Qfalse;
+		rb_thread_check_ints();
+	}
+	return Qtrue;
+}
+
+static VALUE
+keccak_file_close(VALUE ptr) {
+	struct keccak_file_arg *arg = (struct keccak_file_arg *)ptr;
+
+	close(arg->fd);
+	xfree(arg->buf);
+	return Qnil;
+}
+
+/* Ruby method.  Digest::Keccak#file(path)
+ * Streams the file at path into the digest in chunks, with the GVL
+ * released while reading and absorbing.  Digest::Keccak.file(path)
+ * goes through this method as well.
+ * @param path [String] path of the file to hash.
+ * @returns [Digest::Keccak] self
+ */
+static VALUE
+rb_keccak_file(VALUE self, VALUE path) {
+	struct keccak_file_arg arg;
+
+	FilePathValue(path);
+	path = rb_str_encode_ospath(path);
+	rb_check_frozen(self);
+
+	arg.ctx = (hashState *)RTYPEDDATA_DATA(self);
+	arg.fd = rb_cloexec_open(RSTRING_PTR(path), O_RDONLY, 0);
+	if (arg.fd < 0)
+		rb_sys_fail_str(path);
+	rb_update_max_fd(arg.fd);
+	arg.buf = ALLOC_N(unsigned char, FILE_CHUNK_SIZE);
+
+	if (!RTEST(rb_ensure(keccak_file_read, (VALUE)&arg, keccak_file_close, (VALUE)&arg))) {
+		errno = arg.err;
+		rb_sys_fail_str(path);
+	}
+
+	return self;
+}
+
+/* Ruby method.  Digest::Keccak#snapshot()
+ * Captures the data absorbed so far, e.g. a constant message prefix,
+ * so that hashing can later continue from it with #restore.
+ * @returns [Digest::Keccak] frozen copy of self
+ */
+static VALUE
+rb_keccak_snapshot(VALUE self) {
+	VALUE snapshot;
+
+	snapshot = rb_obj_alloc(rb_obj_class(self));
+	CopySpongeState((hashState *)RTYPEDDATA_DATA(snapshot), (hashState *)RTYPEDDATA_DATA(self));
+
+	return rb_obj_freeze(snapshot);
+}
+
+/* Ruby method.  Digest::Keccak#restore(snapshot)
+ * Resets self to the state captured by #snapshot, in place.
+ * @param snapshot [Digest::Keccak] digest of the same class as self
+ * @returns [Digest::Keccak] self
+ */
+static VALUE
+rb_keccak_restore(VALUE self, VALUE snapshot) {
+	rb_check_frozen(self);
+	if (rb_obj_class(snapshot) != rb_obj_class(self)) {
+		rb_raise(rb_eTypeError, "snapshot of a different digest class (%"PRIsVALUE" for %"PRIsVALUE")",
+			rb_obj_class(snapshot), rb_obj_class(self));
+	}
+
+	CopySpongeState((hashState *)RTYPEDDATA_DATA(self), (hashState *)RTYPEDDATA_DATA(snapshot));
+
+	return self;
+}
+
+/* Ruby method.  Digest::Keccak#reset()
+ * Discards the data absorbed and the output squeezed so far, keeping the
+ * hash length and variant given to new.
+ * @returns [Digest::Keccak] self
+ */
+static VALUE
+rb_keccak_reset(VALUE self) {
+	rb_check_frozen(self);
+	if (Reinit((hashState *)RTYPEDDATA_DATA(self)) != SUCCESS)
+		rb_raise(rb_eRuntimeError, "Unknown error");
+
+	return self;
+}
+
 /* :nodoc: private method
- * initialize the ctx with the bitlength
+ * raise the matching Ruby exception for an Init* result
  */
 static void
-keccak_init(hashState *ctx, size_t bitlen) {
-	switch (Init(ctx, bitlen)) {
+keccak_check(HashReturn ret, const char *bad_hashlen_msg) {
+	switch (ret) {
 	case SUCCESS:
 		return;
 	case FAIL:
 		rb_raise(rb_eRuntimeError, "Unknown error");
 	case BAD_HASHLEN:
-		rb_raise(rb_eArgError, "Bad hash length (must be 0, 224, 256, 384 or 512)");
+		rb_raise(rb_eArgError, "%s", bad_hashlen_msg);
 	default:
 		rb_raise(rb_eRuntimeError, "Unknown error code");
 	}
 }
 
+/* :nodoc: private method
+ * initialize the ctx with the bitlength
+ */
+static void
+keccak_init(hashState *ctx, size_t bitlen) {
+	keccak_check(Init(ctx, bitlen), "Bad hash length (must be 0, 224, 256, 384 or 512)");
+}
+
 /* Ruby method.  Digest::Keccak.new(hashlen)
  * @param hashlen The length of hash, only supports 224, 256, 384 or 512
  * @returns [Digest::Keccak] new object.
@@ -111,6 +314,209 @@ rb_keccak_initialize(int argc, VALUE *argv, VALUE self) {
 	return rb_call_super(0, NULL);
 }
 
+/* Ruby method.  Digest::Keccak::SHA3.new(hashlen)
+ * FIPS 202 SHA3, differing from Keccak only in the padding.
+ * @param hashlen The length of hash, only supports 224, 256 (default), 384 or 512
+ * @returns [Digest::Keccak::SHA3] new object.
+ */
+static VALUE
+rb_keccak_sha3_initialize(int argc, VALUE *argv, VALUE self) {
+	hashState *ctx;
+	VALUE hashlen;
+	int i_hashlen;
+
+	if (rb_scan_args(argc, argv, "01", &hashlen) == 0) {
+		i_hashlen = 256;
+	} else {
+		i_hashlen = NUM2INT(hashlen);
+	}
+
+	/* Digest::Keccak#initialize sets up plain Keccak, replaced below. */
+	rb_call_super(0, NULL);
+	ctx = (hashState *)RTYPEDDATA_DATA(self);
+	keccak_check(InitSHA3(ctx, i_hashlen), "Bad hash length (must be 224, 256, 384 or 512)");
+
+	return self;
+}
+
+/* Ruby method.  Digest::Keccak::SHAKE.new(level)
+ * FIPS 202 SHAKE extendable-output function.  The digest methods return
+ * level bits of output, use #squeeze for any other length.
+ * @param level The security level, 128 or 256 (default)
+ * @returns [Digest::Keccak::SHAKE] new object.
+ */
+static VALUE
+rb_keccak_shake_initialize(int argc, VALUE *argv, VALUE self) {
+	hashState *ctx;
+	VALUE level;
+	int i_level;
+
+	if (rb_scan_args(argc, argv, "01", &level) == 0) {
+		i_level = 256;
+	} else {
+		i_level = NUM2INT(level);
+	}
+
+	rb_call_super(0, NULL);
+	ctx = (hashState *)RTYPEDDATA_DATA(self);
+	keccak_check(InitSHAKE(ctx, i_level), "Bad security level (must be 128 or 256)");
+
+	return self;
+}
+
+/* Ruby method.  Digest::Keccak::CSHAKE.new(level, name, custom)
+ * NIST SP 800-185 cSHAKE, SHAKE with a function name and customization
+ * string mixed into the initial state.
+ * @param level The security level, 128 or 256 (default)
+ * @param name [String] The function name, empty by default
+ * @param custom [String] The customization string, empty by default
+ * @returns [Digest::Keccak::CSHAKE] new object.
+ */
+static VALUE
+rb_keccak_cshake_initialize(int argc, VALUE *argv, VALUE self) {
+	hashState *ctx;
+	VALUE level, name, custom;
+	int i_level = 256;
+
+	rb_scan_args(argc, argv, "03", &level, &name, &custom);
+	if (!NIL_P(level))
+		i_level = NUM2INT(level);
+	name = NIL_P(name) ? rb_str_new(0, 0) : StringValue(name);
+	custom = NIL_P(custom) ? rb_str_new(0, 0) : StringValue(custom);
+
+	rb_call_super(0, NULL);
+	ctx = (hashState *)RTYPEDDATA_DATA(self);
+	keccak_check(InitCSHAKE(ctx, i_level,
+		(const BitSequence *)RSTRING_PTR(name), (DataLength)RSTRING_LEN(name) * 8,
+		(const BitSequence *)RSTRING_PTR(custom), (DataLength)RSTRING_LEN(custom) * 8),
+		"Bad security level (must be 128 or 256)");
+	/* The absorbed name and customization string can't be recovered from
+	   the state, #reset goes back to this copy instead. */
+	rb_ivar_set(self, id_initial_state, rb_keccak_snapshot(self));
+
+	return self;
+}
+
+/* Ruby method.  Digest::Keccak::CSHAKE#reset()
+ * Discards the data absorbed and the output squeezed so far, keeping the
+ * function name and customization string given to new.
+ * @returns [Digest::Keccak::CSHAKE] self
+ */
+static VALUE
+rb_keccak_cshake_reset(VALUE self) {
+	VALUE initial;
+
+	initial = rb_attr_get(self, id_initial_state);
+	if (NIL_P(initial))
+		return rb_keccak_reset(self);
+	return rb_keccak_restore(self, initial);
+}
+
+struct keccak_squeeze_arg {
+	hashState *ctx;
+	unsigned char *output;
+	size_t len;
+};
+
+static void *
+keccak_squeeze_nogvl(void *ptr) {
+	struct keccak_squeeze_arg *arg = (struct keccak_squeeze_arg *)ptr;
+
+	Squeeze(arg->ctx, arg->output, (unsigned long long)arg->len * 8);
+	return NULL;
+}
+
+/* Ruby method.  Digest::Keccak::SHAKE#squeeze(length)
+ * Pads the input on first use and returns the next length bytes of
+ * output.  No more data can be added afterwards.
+ * @param length [Integer] number of bytes to return.
+ * @returns [String] output bytes
+ */
+static VALUE
+rb_keccak_squeeze(VALUE self, VALUE length) {
+	struct keccak_squeeze_arg arg;
+	VALUE output;
+	long len;
+
+	len = NUM2LONG(length);
+	if (len < 0)
+		rb_raise(rb_eArgError, "negative output length");
+	rb_check_frozen(self);
+
+	output = rb_str_new(0, len);
+	arg.ctx = (hashState *)RTYPEDDATA_DATA(self);
+	arg.output = (unsigned char *)RSTRING_PTR(output);
+	arg.len = (size_t)len;
+
+	if (arg.len < NOGVL_THRESHOLD)
+		keccak_squeeze_nogvl(&arg);
+	else
+		rb_thread_call_without_gvl(keccak_squeeze_nogvl, &arg, NULL, NULL);
+
+	return output;
+}
+
+/* :nodoc: private method
+ * KMAC256 into a new string of len bytes, straight from the Ruby strings
+ */
+static VALUE
+keccak_kmac256(VALUE key, VALUE data, VALUE length, VALUE custom) {
+	VALUE output;
+	long len;
+
+	StringValue(key);
+	StringValue(data);
+	custom = NIL_P(custom) ? rb_str_new(0, 0) : StringValue(custom);
+	len = NUM2LONG(length);
+	if (len < 0)
+		rb_raise(rb_eArgError, "negative output length");
+
+	output = rb_str_new(0, len);
+	keccak_check(KMAC(256,
+		(const BitSequence *)RSTRING_PTR(key), (DataLength)RSTRING_LEN(key) * 8,
+		(const BitSequence *)RSTRING_PTR(data), (DataLength)RSTRING_LEN(data) * 8,
+		(const BitSequence *)RSTRING_PTR(custom), (DataLength)RSTRING_LEN(custom) * 8,
+		(BitSequence *)RSTRING_PTR(output), (DataLength)len * 8),
+		"Bad security level");
+
+	return output;
+}
+
+/* Ruby method.  Digest::Keccak.kmac256(key, data, length, custom)
+ * NIST SP 800-185 KMAC256, computed natively in one pass.
+ * @param key [String] The MAC key
+ * @param data [String] The message
+ * @param length [Integer] Number of output bytes
+ * @param custom [String] The customization string, empty by default
+ * @returns [String] MAC of length bytes
+ */
+static VALUE
+rb_keccak_s_kmac256(int argc, VALUE *argv, VALUE klass) {
+	VALUE key, data, length, custom;
+
+	rb_scan_args(argc, argv, "31", &key, &data, &length, &custom);
+	return keccak_kmac256(key, data, length, custom);
+}
+
+/* Ruby method.  Digest::Keccak.kdf256(key, info, length, label)
+ * Derives length bytes of keying material from key, the KMAC256 based
+ * KDF of NIST SP 800-108 (KMAC256 with the label as customization
+ * string over the context info).  Plays the role of HKDF-Expand, the
+ * key needs to be uniformly random already.
+ * @param key [String] The key derivation key
+ * @param info [String] The context the key is bound to
+ * @param length [Integer] Number of output bytes
+ * @param label [String] The purpose of the derived key, empty by default
+ * @returns [String] Derived key of length bytes
+ */
+static VALUE
+rb_keccak_s_kdf256(int argc, VALUE *argv, VALUE klass) {
+	VALUE key, info, length, label;
+
+	rb_scan_args(argc, argv, "31", &key, &info, &length, &label);
+	return keccak_kmac256(key, info, length, label);
+}
+
 /* Ruby method.  Digest::Keccak#digest_length
  * @returns [Numeric] Length of the digest.
  */
@@ -135,9 +541,10 @@ rb_keccak_block_length(VALUE self) {
 
 void __attribute__((visibility("default")))
 Init_keccak() {
-	VALUE mDigest, cDigest_Base, cKeccak;
+	VALUE mDigest, cDigest_Base, cKeccak, cSHA3, cSHAKE, cCSHAKE;
 
 	rb_require("digest");
+	id_initial_state = rb_intern("initial_state");
 
 	mDigest = rb_path2class("Digest");
 	cDigest_Base = rb_path2class("Digest::Base");
@@ -150,4 +557,24 @@ Init_keccak() {
   rb_define_method(cKeccak, "digest_length", rb_keccak_digest_length, 0);
   rb_define_method(cKeccak, "block_length", rb_keccak_block_length, 0);
   rb_define_method(cKeccak, "finish", rb_keccak_finish, 0);
+  rb_define_method(cKeccak, "update", rb_keccak_update, 1);
+  rb_define_method(cKeccak, "<<", rb_keccak_update, 1);
+  rb_define_method(cKeccak, "file", rb_keccak_file, 1);
+  rb_define_method(cKeccak, "reset", rb_keccak_reset, 0);
+  rb_define_method(cKeccak, "snapshot", rb_keccak_snapshot, 0);
+  rb_define_method(cKeccak, "restore", rb_keccak_restore, 1);
+
+  rb_define_singleton_method(cKeccak, "kmac256", rb_keccak_s_kmac256, -1);
+  rb_define_singleton_method(cKeccak, "kdf256", rb_keccak_s_kdf256, -1);
+
+	cSHA3 = rb_define_class_under(cKeccak, "SHA3", cKeccak);
+	rb_define_method(cSHA3, "initialize", rb_keccak_sha3_initialize, -1);
+
+	cSHAKE = rb_define_class_under(cKeccak, "SHAKE", cKeccak);
+	rb_define_method(cSHAKE, "initialize", rb_keccak_shake_initialize, -1);
+	rb_define_method(cSHAKE, "squeeze", rb_keccak_squeeze, 1);
+
+	cCSHAKE = rb_define_class_under(cKeccak, "CSHAKE", cSHAKE);
+	rb_define_method(cCSHAKE, "initialize", rb_keccak_cshake_initialize, -1);
+	rb_define_method(cCSHAKE, "reset", rb_keccak_cshake_reset, 0);
 }
@@ -0,0 +1,11 @@
+# frozen_string_literal: true
+
+# Runs the tests against the extension built by `make all` in ext/digest.
+$LOAD_PATH.unshift File.expand_path('../ext', __dir__)
+
+require 'test/unit'
+require 'digest/keccak'
+
+Dir[File.join(__dir__, 'test_*.rb')].sort.each do |file|
+  require file unless File.expand_path(file) == File.expand_path(__FILE__)
+end
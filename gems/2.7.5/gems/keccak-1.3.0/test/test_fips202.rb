@@ -0,0 +1,50 @@
+# frozen_string_literal: true
+
+require 'test/unit'
+require 'digest/keccak'
+
+class TestFIPS202 < Test::Unit::TestCase
+  def test_sha3_256
+    assert_equal '3a985da74fe225b2045c172d6bd390bd855f086e3e9d525b46bfe24511431532',
+                 Digest::Keccak::SHA3.new(256).hexdigest('abc')
+  end
+
+  def test_shake128_squeeze
+    assert_equal '7f9c2ba4e88f827d616045507605853ed73b8093f6efbc88eb1a6eacfa66ef26',
+                 Digest::Keccak::SHAKE.new(128).squeeze(32).unpack1('H*')
+  end
+
+  def test_cshake128
+    cshake = Digest::Keccak::CSHAKE.new(128, '', 'Email Signature')
+    cshake << ['00010203'].pack('H*')
+    assert_equal 'c1c36925b6409a04f1b504fcbca9d82b4017277cb5ed2b2065fc1d3814d5aaf5',
+                 cshake.squeeze(32).unpack1('H*')
+  end
+
+  def test_digest_twice_resets
+    [Digest::Keccak.new(256), Digest::Keccak::SHA3.new(256),
+     Digest::Keccak::SHAKE.new(128), Digest::Keccak::CSHAKE.new(128, 'N', 'S')].each do |digest|
+      first = digest.hexdigest('abc')
+      assert_equal first, digest.hexdigest('abc'), digest.class.name
+    end
+  end
+
+  def test_reset_after_squeeze
+    shake = Digest::Keccak::SHAKE.new(256)
+    shake << 'abc'
+    shake.squeeze(10)
+    assert_raise(RuntimeError) { shake << 'def' }
+    shake.reset
+    shake << 'abc'
+    assert_equal Digest::Keccak::SHAKE.new(256).update('abc').hexdigest, shake.hexdigest
+  end
+
+  def test_cshake_reset_keeps_customization
+    cshake = Digest::Keccak::CSHAKE.new(128, '', 'Email Signature')
+    cshake << 'junk'
+    cshake.reset
+    cshake << ['00010203'].pack('H*')
+    assert_equal 'c1c36925b6409a04f1b504fcbca9d82b4017277cb5ed2b2065fc1d3814d5aaf5',
+                 cshake.squeeze(32).unpack1('H*')
+  end
+end
@@ -0,0 +1,46 @@
+# frozen_string_literal: true
+
+require 'test/unit'
+require 'digest/keccak'
+
+# KMAC256 samples #4 to #6 published by NIST for SP 800-185.
+class TestKMAC < Test::Unit::TestCase
+  KEY = (0x40..0x5f).to_a.pack('C*')
+  SHORT = [0, 1, 2, 3].pack('C*')
+  LONG = (0x00..0xc7).to_a.pack('C*')
+
+  def kmac256(data, custom)
+    Digest::Keccak.kmac256(KEY, data, 64, custom).unpack1('H*')
+  end
+
+  def test_sample4
+    assert_equal '20c570c31346f703c9ac36c61c03cb64c3970d0cfc787e9b79599d273a68d2f7' \
+                 'f69d4cc3de9d104a351689f27cf6f5951f0103f33f4f24871024d9c27773a8dd',
+                 kmac256(SHORT, 'My Tagged Application')
+  end
+
+  def test_sample5
+    assert_equal '75358cf39e41494e949707927cee0af20a3ff553904c86b08f21cc414bcfd691' \
+                 '589d27cf5e15369cbbff8b9a4c2eb17800855d0235ff635da82533ec6b759b69',
+                 kmac256(LONG, '')
+  end
+
+  def test_sample6
+    assert_equal 'b58618f71f92e1d56c1b8c55ddd7cd188b97b4ca4d99831eb2699a837da2e4d9' \
+                 '70fbacfde50033aea585f1a2708510c32d07880801bd182898fe476876fc8965',
+                 kmac256(LONG, 'My Tagged Application')
+  end
+
+  def test_customization_defaults_to_empty
+    assert_equal kmac256(LONG, ''), Digest::Keccak.kmac256(KEY, LONG, 64).unpack1('H*')
+  end
+
+  def test_kdf256_is_kmac256_with_label
+    assert_equal Digest::Keccak.kmac256(KEY, 'context', 48, 'label'),
+                 Digest::Keccak.kdf256(KEY, 'context', 48, 'label')
+  end
+
+  def test_negative_length
+    assert_raise(ArgumentError) { Digest::Keccak.kmac256(KEY, SHORT, -1) }
+  end
+end
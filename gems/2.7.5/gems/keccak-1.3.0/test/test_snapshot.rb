@@ -0,0 +1,39 @@
+# frozen_string_literal: true
+
+require 'tempfile'
+require 'test/unit'
+require 'digest/keccak'
+
+class TestSnapshot < Test::Unit::TestCase
+  def test_restore_continues_from_prefix
+    digest = Digest::Keccak.new(256)
+    digest << 'prefix'
+    snapshot = digest.snapshot
+    digest << 'one'
+    assert_equal Digest::Keccak.new(256).update('prefixone').hexdigest, digest.hexdigest
+    digest.restore(snapshot)
+    digest << 'two'
+    assert_equal Digest::Keccak.new(256).update('prefixtwo').hexdigest, digest.hexdigest
+  end
+
+  def test_snapshot_is_frozen
+    snapshot = Digest::Keccak.new(256).update('prefix').snapshot
+    assert_true snapshot.frozen?
+    assert_raise(FrozenError) { snapshot << 'more' }
+    assert_raise(FrozenError) { snapshot.restore(snapshot) }
+  end
+
+  def test_file_on_frozen_digest
+    Tempfile.create('keccak') do |file|
+      file.write('data')
+      file.close
+      snapshot = Digest::Keccak.new(256).snapshot
+      assert_raise(FrozenError) { snapshot.file(file.path) }
+      assert_equal Digest::Keccak.new(256).hexdigest, snapshot.hexdigest
+    end
+  end
+
+  def test_restore_from_other_class
+    assert_raise(TypeError) { Digest::Keccak.new(256).restore(Digest::Keccak::SHA3.new(256).snapshot) }
+  end
+end
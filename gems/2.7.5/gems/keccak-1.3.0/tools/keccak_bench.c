@@ -0,0 +1,104 @@
+/*
+ * Micro-benchmark for the Keccak sponge, reporting cycles/byte for the
+ * permutation compiled in (see KECCAK_PERMUTATION in the top-level Makefile).
+ *
+ * Usage: keccak_bench [hashbitlen]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+#include "KeccakNISTInterface.h"
+
+#define RUNS 5
+#define MIN_BYTES_PER_RUN (1024 * 1024)
+
+static const size_t sizes[] = { 32, 64, 256, 4096, 1024 * 1024 };
+
+static unsigned long long
+ticks(void)
+{
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static double
+seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char **argv)
+{
+	BitSequence digest[64];
+	unsigned char *data;
+	size_t i, n, iterations;
+	int hashbitlen = 256, run;
+
+	if (argc > 1)
+		hashbitlen = atoi(argv[1]);
+	if (Hash(hashbitlen, (const BitSequence *)"", 0, digest) != SUCCESS) {
+		fprintf(stderr, "unsupported hash length %d\n", hashbitlen);
+		return 2;
+	}
+
+	data = malloc(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+	if (data == NULL)
+		return 2;
+	for (i = 0; i < sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]; i++)
+		data[i] = (unsigned char)(i * 131 + 7);
+
+	printf("Keccak-%d, best of %d runs\n", hashbitlen, RUNS);
+#ifdef HAVE_RDTSC
+	printf("%10s %14s %12s\n", "bytes", "cycles/byte", "MiB/s");
+#else
+	printf("%10s %14s %12s\n", "bytes", "ns/byte", "MiB/s");
+#endif
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		double best_per_byte = 0, best_seconds = 0;
+
+		iterations = MIN_BYTES_PER_RUN / sizes[i];
+		if (iterations == 0)
+			iterations = 1;
+
+		for (run = 0; run < RUNS; run++) {
+			unsigned long long start_ticks, elapsed_ticks;
+			double start_seconds, elapsed_seconds, per_byte;
+
+			start_seconds = seconds();
+			start_ticks = ticks();
+			for (n = 0; n < iterations; n++)
+				Hash(hashbitlen, data, (DataLength)sizes[i] * 8, digest);
+			elapsed_ticks = ticks() - start_ticks;
+			elapsed_seconds = seconds() - start_seconds;
+
+			per_byte = (double)elapsed_ticks / ((double)iterations * sizes[i]);
+			if (run == 0 || per_byte < best_per_byte) {
+				best_per_byte = per_byte;
+				best_seconds = elapsed_seconds;
+			}
+		}
+
+		printf("%10zu %14.2f %12.1f\n", sizes[i], best_per_byte,
+		    (double)iterations * sizes[i] / best_seconds / (1024 * 1024));
+	}
+
+	free(data);
+	return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Known-answer test runner for the Keccak sponge, checking the permutation
+ * compiled in against the ShortMsgKAT_*.txt and LongMsgKAT_*.txt files of
+ * the Keccak reference package.  The hash length is taken from the file
+ * name, e.g. ShortMsgKAT_256.txt; ShortMsgKAT_0.txt checks the first bytes
+ * of arbitrarily-long output ("Squeezed =").
+ *
+ * Usage: keccak_kat KATFILE...
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "KeccakNISTInterface.h"
+
+#define MAX_LINE (1024 * 1024)
+#define MAX_OUTPUT 512
+
+static int
+hexval(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c = tolower(c);
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* Decodes hex digits into out, returning the number of bytes or -1. */
+static long
+unhex(const char *hex, unsigned char *out, size_t max)
+{
+	size_t n = 0;
+	int hi, lo;
+
+	while (isxdigit((unsigned char)hex[0])) {
+		hi = hexval(hex[0]);
+		lo = hexval(hex[1]);
+		if (lo < 0 || n == max)
+			return -1;
+		out[n++] = (unsigned char)(hi << 4 | lo);
+		hex += 2;
+	}
+	return (long)n;
+}
+
+static int
+hashbitlen_from_path(const char *path)
+{
+	const char *base, *sep;
+
+	base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+	sep = strrchr(base, '_');
+	if (sep == NULL || !isdigit((unsigned char)sep[1]))
+		return -1;
+	return atoi(sep + 1);
+}
+
+static int
+run_file(const char *path, char *line, unsigned char *msg)
+{
+	unsigned char expected[MAX_OUTPUT], actual[MAX_OUTPUT];
+	unsigned long long len = 0;
+	long msglen = 0, outlen;
+	int hashbitlen, checked = 0, failed = 0;
+	hashState state;
+	FILE *f;
+
+	if ((hashbitlen = hashbitlen_from_path(path)) < 0) {
+		fprintf(stderr, "%s: cannot tell the hash length from the file name\n", path);
+		return -1;
+	}
+	if ((f = fopen(path, "r")) == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, MAX_LINE, f) != NULL) {
+		if (sscanf(line, "Len = %llu", &len) == 1)
+			continue;
+		if (strncmp(line, "Msg = ", 6) == 0) {
+			msglen = unhex(line + 6, msg, MAX_LINE / 2);
+			if (msglen < 0 || (unsigned long long)msglen * 8 < len) {
+				fprintf(stderr, "%s: malformed Msg for Len = %llu\n", path, len);
+				failed++;
+				msglen = -1;
+			}
+			continue;
+		}
+		if (strncmp(line, "MD = ", 5) == 0)
+			outlen = unhex(line + 5, expected, sizeof(expected));
+		else if (strncmp(line, "Squeezed = ", 11) == 0)
+			outlen = unhex(line + 11, expected, sizeof(expected));
+		else
+			continue;
+		if (msglen < 0 || outlen <= 0)
+			continue;
+
+		if (Init(&state, hashbitlen) != SUCCESS) {
+			fprintf(stderr, "%s: unsupported hash length %d\n", path, hashbitlen);
+			fclose(f);
+			return -1;
+		}
+		Update(&state, msg, len);
+		if (hashbitlen == 0)
+			Squeeze(&state, actual, (unsigned long long)outlen * 8);
+		else
+			Final(&state, actual);
+
+		checked++;
+		if ((hashbitlen != 0 && outlen * 8 != hashbitlen) || memcmp(actual, expected, outlen) != 0) {
+			fprintf(stderr, "%s: mismatch for Len = %llu\n", path, len);
+			failed++;
+		}
+	}
+	fclose(f);
+
+	printf("%s: %d vectors, %d failed\n", path, checked, failed);
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned char *msg;
+	char *line;
+	int i, result, failed = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s KATFILE...\n", argv[0]);
+		return 2;
+	}
+
+	line = malloc(MAX_LINE);
+	msg = malloc(MAX_LINE / 2);
+	if (line == NULL || msg == NULL)
+		return 2;
+
+	for (i = 1; i < argc; i++) {
+		result = run_file(argv[i], line, msg);
+		if (result < 0)
+			return 2;
+		failed += result;
+	}
+
+	free(line);
+	free(msg);
+	return failed ? 1 : 0;
+}
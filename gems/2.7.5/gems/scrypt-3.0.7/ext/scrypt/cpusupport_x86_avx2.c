@@ -0,0 +1,47 @@
+#include "cpusupport.h"
+
+#ifdef CPUSUPPORT_X86_AVX2
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cpuid.h>
+
+#define CPUID_OSXSAVE_BIT (1 << 27)
+#define CPUID_AVX_BIT (1 << 28)
+#define CPUID_AVX2_BIT (1 << 5)
+#define XCR0_AVX_STATE 0x06	/* XMM and YMM registers. */
+
+/* Read XCR0; written as bytes since not every assembler knows xgetbv. */
+static uint64_t
+xgetbv0(void)
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0"
+	    : "=a" (lo), "=d" (hi) : "c" (0));
+	return (((uint64_t)hi << 32) | lo);
+}
+
+CPUSUPPORT_FEATURE_DECL(x86, avx2)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	/* The OS must save the YMM registers for us. */
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return (0);
+	if ((ecx & (CPUID_OSXSAVE_BIT | CPUID_AVX_BIT)) !=
+	    (CPUID_OSXSAVE_BIT | CPUID_AVX_BIT))
+		return (0);
+	if ((xgetbv0() & XCR0_AVX_STATE) != XCR0_AVX_STATE)
+		return (0);
+
+	/* Check if CPUID supports the value we need. */
+	if (__get_cpuid_max(0, NULL) < 7)
+		return (0);
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+	/* Return the relevant feature bit. */
+	return ((ebx & CPUID_AVX2_BIT) ? 1 : 0);
+}
+
+#endif /* CPUSUPPORT_X86_AVX2 */
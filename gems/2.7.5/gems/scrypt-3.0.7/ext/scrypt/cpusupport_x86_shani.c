@@ -0,0 +1,32 @@
+#include "cpusupport.h"
+
+#ifdef CPUSUPPORT_X86_SHANI
+
+#include <stddef.h>
+#include <cpuid.h>
+
+#define CPUID_SSSE3_BIT (1 << 9)
+#define CPUID_SSE41_BIT (1 << 19)
+#define CPUID_SHANI_BIT (1 << 29)
+
+CPUSUPPORT_FEATURE_DECL(x86, shani)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	/* The SHA code also shuffles and blends with SSSE3 and SSE4.1. */
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return (0);
+	if ((ecx & (CPUID_SSSE3_BIT | CPUID_SSE41_BIT)) !=
+	    (CPUID_SSSE3_BIT | CPUID_SSE41_BIT))
+		return (0);
+
+	/* Check if CPUID supports the value we need. */
+	if (__get_cpuid_max(0, NULL) < 7)
+		return (0);
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+	/* Return the relevant feature bit. */
+	return ((ebx & CPUID_SHANI_BIT) ? 1 : 0);
+}
+
+#endif /* CPUSUPPORT_X86_SHANI */
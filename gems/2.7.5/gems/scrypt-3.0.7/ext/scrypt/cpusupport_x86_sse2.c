@@ -0,0 +1,21 @@
+#include "cpusupport.h"
+
+#ifdef CPUSUPPORT_X86_SSE2
+
+#include <cpuid.h>
+
+#define CPUID_SSE2_BIT (1 << 26)
+
+CPUSUPPORT_FEATURE_DECL(x86, sse2)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	/* Check if CPUID supports the value we need. */
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return (0);
+
+	/* Return the relevant feature bit. */
+	return ((edx & CPUID_SSE2_BIT) ? 1 : 0);
+}
+
+#endif /* CPUSUPPORT_X86_SSE2 */
@@ -34,6 +34,10 @@
  	#ifndef HAVE_MMAP
 		#define HAVE_MMAP 1
  	#endif
+ 	#include <pthread.h>
+ 	#ifndef HAVE_PTHREAD
+		#define HAVE_PTHREAD 1
+ 	#endif
 #endif
 #include <errno.h>
 #include <stdint.h>
@@ -46,28 +50,174 @@
 
 #include "crypto_scrypt_smix.h"
 #include "crypto_scrypt_smix_sse2.h"
+#include "crypto_scrypt_smix_avx2.h"
+#include "crypto_scrypt_smix_avx512.h"
 
 #include "crypto_scrypt.h"
+#include "crypto_scrypt_vmem.h"
+#include "memlimit.h"
+#include "scrypt_pool.h"
 #include "warnp.h"
 
 static void (*smix_func)(uint8_t *, size_t, uint64_t, void *, void *) = NULL;
+static const char * smix_name = NULL;
+
+/*
+ * Multi-lane smix working on ${smix_wide_width} consecutive blocks B_i at a
+ * time, with V and XY as large as that many single-lane regions.
+ */
+static void (*smix_wide_func)(uint8_t *, size_t, uint64_t, void *, void *);
+static size_t smix_wide_width = 0;
+
+#ifdef HAVE_PTHREAD
+/* The implementations are picked once, by whichever thread gets there first. */
+static pthread_once_t smix_once = PTHREAD_ONCE_INIT;
+static pthread_once_t smix_wide_once = PTHREAD_ONCE_INIT;
+#endif
+
+#ifdef HAVE_PTHREAD
+/* Upper bound on the number of threads working on the p lanes of one call. */
+#define MAXTHREADS 16
+
+struct smix_lanes {
+	pthread_mutex_t mutex;
+	uint8_t * B;
+	size_t r;
+	uint64_t N;
+	size_t p;
+	size_t next;
+	void (*smix)(uint8_t *, size_t, uint64_t, void *, void *);
+	size_t width;
+	void (*smix_wide)(uint8_t *, size_t, uint64_t, void *, void *);
+	int vflags;
+};
 
 /**
- * _crypto_scrypt(passwd, passwdlen, salt, saltlen, N, r, p, buf, buflen, smix):
- * Perform the requested scrypt computation, using ${smix} as the smix routine.
+ * smix_lanes_run(lanes, V, XY):
+ * Claim lanes B_i not yet processed and compute B_i <-- MF(B_i, N) on them,
+ * using V and XY as temporary storage, until none are left.  Lanes are taken
+ * ${width} at a time while that many remain.
+ */
+static void
+smix_lanes_run(struct smix_lanes * lanes, void * V, void * XY)
+{
+	size_t i, n;
+
+	for (;;) {
+		pthread_mutex_lock(&lanes->mutex);
+		i = lanes->next;
+		n = (lanes->p - i >= lanes->width) ? lanes->width : 1;
+		if (i < lanes->p)
+			lanes->next += n;
+		pthread_mutex_unlock(&lanes->mutex);
+		if (i >= lanes->p)
+			break;
+		(n > 1 ? lanes->smix_wide : lanes->smix)(
+		    &lanes->B[i * 128 * lanes->r], lanes->r, lanes->N, V, XY);
+	}
+}
+
+/**
+ * smix_lanes_worker(cookie):
+ * Pool thread entry point: allocate private V and XY regions and work on
+ * lanes.  If the memory cannot be allocated the lanes are left to the other
+ * threads.
+ */
+static void
+smix_lanes_worker(void * cookie)
+{
+	struct smix_lanes * lanes = cookie;
+	size_t r = lanes->r;
+	size_t width = lanes->width;
+	struct crypto_scrypt_vmem vmem;
+	void * XY0;
+	uint32_t * V;
+	uint32_t * XY;
+
+	if ((XY0 = malloc((256 * r + 64) * width + 63)) == NULL)
+		goto err0;
+	XY = (uint32_t *)(((uintptr_t)(XY0) + 63) & ~ (uintptr_t)(63));
+
+	/*
+	 * Pool threads serve every caller, and an arena kept by one of them
+	 * could not be handed back with crypto_scrypt_release_arena.
+	 */
+	if ((V = crypto_scrypt_vmem_alloc(&vmem, 128 * r * lanes->N * width,
+	    lanes->vflags & ~CRYPTO_SCRYPT_V_ARENA)) == NULL)
+		goto err1;
+
+	smix_lanes_run(lanes, V, XY);
+
+	crypto_scrypt_vmem_free(&vmem, 128 * r * lanes->N * width);
+err1:
+	free(XY0);
+err0:
+	return;
+}
+
+/**
+ * smix_parallel(B, r, N, p, V, XY, nthreads, smix, width, smix_wide, vflags):
+ * Compute B_i <-- MF(B_i, N) for all p lanes of B, using up to ${nthreads}
+ * threads, each running ${smix_wide} on ${width} lanes at once where it can.
+ * The calling thread takes part using V and XY; the others come from the
+ * shared scrypt_pool, as they are free, and allocate their own copies as
+ * selected by ${vflags}.
+ */
+static void
+smix_parallel(uint8_t * B, size_t r, uint64_t N, size_t p, void * V,
+    void * XY, size_t nthreads,
+    void (*smix)(uint8_t *, size_t, uint64_t, void *, void *), size_t width,
+    void (*smix_wide)(uint8_t *, size_t, uint64_t, void *, void *), int vflags)
+{
+	struct smix_lanes lanes;
+	struct scrypt_pool_task task;
+	size_t i;
+
+	lanes.B = B;
+	lanes.r = r;
+	lanes.N = N;
+	lanes.p = p;
+	lanes.next = 0;
+	lanes.smix = smix;
+	lanes.width = width;
+	lanes.smix_wide = smix_wide;
+	lanes.vflags = vflags;
+	if (pthread_mutex_init(&lanes.mutex, NULL) != 0) {
+		for (i = 0; i < p; i++)
+			(smix)(&B[i * 128 * r], r, N, V, XY);
+		return;
+	}
+
+	/* Ask for helpers; whatever they don't get to, we do ourselves. */
+	scrypt_pool_start(&task, smix_lanes_worker, &lanes, nthreads - 1);
+	smix_lanes_run(&lanes, V, XY);
+	scrypt_pool_finish(&task);
+	pthread_mutex_destroy(&lanes.mutex);
+}
+#endif /* HAVE_PTHREAD */
+
+/**
+ * _crypto_scrypt(passwd, passwdlen, salt, saltlen, N, r, p, buf, buflen,
+ *     nthreads, smix, width, smix_wide, vflags):
+ * Perform the requested scrypt computation, using ${smix} as the smix routine
+ * and up to ${nthreads} threads for the p lanes.  If ${width} is greater than
+ * one, groups of ${width} lanes are handed to ${smix_wide} instead.  V is
+ * allocated as selected by the CRYPTO_SCRYPT_V_* ${vflags}.
  */
 static int
 _crypto_scrypt(const uint8_t * passwd, size_t passwdlen,
     const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t _r, uint32_t _p,
-    uint8_t * buf, size_t buflen,
-    void (*smix)(uint8_t *, size_t, uint64_t, void *, void *))
+    uint8_t * buf, size_t buflen, size_t nthreads,
+    void (*smix)(uint8_t *, size_t, uint64_t, void *, void *), size_t width,
+    void (*smix_wide)(uint8_t *, size_t, uint64_t, void *, void *), int vflags)
 {
-	void * B0, * V0, * XY0;
+	struct crypto_scrypt_vmem vmem;
+	void * B0, * XY0;
 	uint8_t * B;
 	uint32_t * V;
 	uint32_t * XY;
 	size_t r = _r, p = _p;
-	uint32_t i;
+	size_t i;
 
 	/* Sanity-check parameters. */
 #if SIZE_MAX > UINT32_MAX
@@ -88,7 +238,9 @@ _crypto_scrypt(const uint8_t * passwd, size_t passwdlen,
 #if SIZE_MAX / 256 <= UINT32_MAX
 	    (r > (SIZE_MAX - 64) / 256) ||
 #endif
-	    (N > SIZE_MAX / 128 / r)) {
+	    (N > SIZE_MAX / 128 / r) ||
+	    (128 * r * N > SIZE_MAX / width) ||
+	    (256 * r + 64 > SIZE_MAX / width)) {
 		errno = ENOMEM;
 		goto err0;
 	}
@@ -98,58 +250,50 @@ _crypto_scrypt(const uint8_t * passwd, size_t passwdlen,
 	if ((errno = posix_memalign(&B0, 64, 128 * r * p)) != 0)
 		goto err0;
 	B = (uint8_t *)(B0);
-	if ((errno = posix_memalign(&XY0, 64, 256 * r + 64)) != 0)
+	if ((errno = posix_memalign(&XY0, 64, (256 * r + 64) * width)) != 0)
 		goto err1;
 	XY = (uint32_t *)(XY0);
-#if !defined(MAP_ANON) || !defined(HAVE_MMAP)
-	if ((errno = posix_memalign(&V0, 64, 128 * r * N)) != 0)
-		goto err2;
-	V = (uint32_t *)(V0);
-#endif
 #else
 	if ((B0 = malloc(128 * r * p + 63)) == NULL)
 		goto err0;
 	B = (uint8_t *)(((uintptr_t)(B0) + 63) & ~ (uintptr_t)(63));
-	if ((XY0 = malloc(256 * r + 64 + 63)) == NULL)
+	if ((XY0 = malloc((256 * r + 64) * width + 63)) == NULL)
 		goto err1;
 	XY = (uint32_t *)(((uintptr_t)(XY0) + 63) & ~ (uintptr_t)(63));
-#if !defined(MAP_ANON) || !defined(HAVE_MMAP)
-	if ((V0 = malloc(128 * r * N + 63)) == NULL)
-		goto err2;
-	V = (uint32_t *)(((uintptr_t)(V0) + 63) & ~ (uintptr_t)(63));
 #endif
-#endif
-#if defined(MAP_ANON) && defined(HAVE_MMAP)
-	if ((V0 = mmap(NULL, 128 * r * N, PROT_READ | PROT_WRITE,
-#ifdef MAP_NOCORE
-	    MAP_ANON | MAP_PRIVATE | MAP_NOCORE,
-#else
-	    MAP_ANON | MAP_PRIVATE,
-#endif
-	    -1, 0)) == MAP_FAILED)
+	if ((V = crypto_scrypt_vmem_alloc(&vmem, 128 * r * N * width, vflags)) ==
+	    NULL)
 		goto err2;
-	V = (uint32_t *)(V0);
-#endif
 
 	/* 1: (B_0 ... B_{p-1}) <-- PBKDF2(P, S, 1, p * MFLen) */
 	PBKDF2_SHA256(passwd, passwdlen, salt, saltlen, 1, B, p * 128 * r);
 
 	/* 2: for i = 0 to p - 1 do */
-	for (i = 0; i < p; i++) {
-		/* 3: B_i <-- MF(B_i, N) */
-		(smix)(&B[i * 128 * r], r, N, V, XY);
+#ifdef HAVE_PTHREAD
+	if ((nthreads > 1) && (p > 1)) {
+		/* 3: B_i <-- MF(B_i, N), on several lanes at once */
+		smix_parallel(B, r, N, p, V, XY, nthreads, smix, width,
+		    smix_wide, vflags);
+	} else
+#endif
+	for (i = 0; i < p; ) {
+		if ((width > 1) && (p - i >= width)) {
+			/* 3: B_i <-- MF(B_i, N), ${width} lanes side by side */
+			(smix_wide)(&B[i * 128 * r], r, N, V, XY);
+			i += width;
+		} else {
+			/* 3: B_i <-- MF(B_i, N) */
+			(smix)(&B[i * 128 * r], r, N, V, XY);
+			i++;
+		}
 	}
 
 	/* 5: DK <-- PBKDF2(P, B, 1, dkLen) */
 	PBKDF2_SHA256(passwd, passwdlen, B, p * 128 * r, 1, buf, buflen);
 
 	/* Free memory. */
-#if defined(MAP_ANON) && defined(HAVE_MMAP)
-	if (munmap(V0, 128 * r * N))
+	if (crypto_scrypt_vmem_free(&vmem, 128 * r * N * width))
 		goto err2;
-#else
-	free(V0);
-#endif
 	free(XY0);
 	free(B0);
 
@@ -191,6 +335,26 @@ static struct scrypt_test {
 	}
 };
 
+#if defined(CPUSUPPORT_X86_AVX2) || defined(CPUSUPPORT_X86_AVX512F)
+static struct scrypt_test testcase_wide = {
+	.passwd = "pleaseletmein",
+	.salt = "SodiumChloride",
+	.N = 16,
+	.r = 8,
+	.p = 4,
+	.result = {
+		0xc2, 0x76, 0x38, 0xe3, 0xc1, 0xe7, 0xe1, 0x85,
+		0xeb, 0x3a, 0xb5, 0xb9, 0x96, 0x6f, 0xbe, 0x7d,
+		0xc0, 0xc0, 0xc8, 0x6d, 0x10, 0x6d, 0xbf, 0xe6,
+		0x6f, 0x70, 0x0e, 0x55, 0x39, 0x4d, 0x1a, 0x9d,
+		0x69, 0xea, 0xfd, 0xf5, 0x1f, 0x23, 0x3d, 0x3c,
+		0x53, 0xa0, 0x1b, 0x7b, 0x3e, 0x9b, 0x30, 0x63,
+		0x5c, 0x52, 0x4a, 0x81, 0xe1, 0x66, 0xa1, 0x54,
+		0x2c, 0xd3, 0x76, 0x73, 0x19, 0x18, 0xf4, 0x66,
+	}
+};
+#endif
+
 static int
 testsmix(void (*smix)(uint8_t *, size_t, uint64_t, void *, void *))
 {
@@ -200,13 +364,34 @@ testsmix(void (*smix)(uint8_t *, size_t, uint64_t, void *, void *))
 	if (_crypto_scrypt(
 	    (const uint8_t *)testcase.passwd, strlen(testcase.passwd),
 	    (const uint8_t *)testcase.salt, strlen(testcase.salt),
-	    testcase.N, testcase.r, testcase.p, hbuf, TESTLEN, smix))
+	    testcase.N, testcase.r, testcase.p, hbuf, TESTLEN, 1, smix,
+	    1, smix, 0))
 		return (-1);
 
 	/* Does it match? */
 	return (memcmp(testcase.result, hbuf, TESTLEN));
 }
 
+#if defined(CPUSUPPORT_X86_AVX2) || defined(CPUSUPPORT_X86_AVX512F)
+static int
+testsmix_wide(void (*smix_wide)(uint8_t *, size_t, uint64_t, void *, void *),
+    size_t width)
+{
+	uint8_t hbuf[TESTLEN];
+
+	/* Perform the computation; all p lanes go through smix_wide. */
+	if (_crypto_scrypt(
+	    (const uint8_t *)testcase_wide.passwd, strlen(testcase_wide.passwd),
+	    (const uint8_t *)testcase_wide.salt, strlen(testcase_wide.salt),
+	    testcase_wide.N, testcase_wide.r, testcase_wide.p, hbuf, TESTLEN, 1,
+	    smix_func, width, smix_wide, 0))
+		return (-1);
+
+	/* Does it match? */
+	return (memcmp(testcase_wide.result, hbuf, TESTLEN));
+}
+#endif
+
 static void
 selectsmix(void)
 {
@@ -217,6 +402,7 @@ selectsmix(void)
 		/* If SSE2ized smix works, use it. */
 		if (!testsmix(crypto_scrypt_smix_sse2)) {
 			smix_func = crypto_scrypt_smix_sse2;
+			smix_name = "sse2";
 			return;
 		}
 		warn0("Disabling broken SSE2 scrypt support - please report bug!");
@@ -226,6 +412,7 @@ selectsmix(void)
 	/* If generic smix works, use it. */
 	if (!testsmix(crypto_scrypt_smix)) {
 		smix_func = crypto_scrypt_smix;
+		smix_name = "generic";
 		return;
 	}
 	warn0("Generic scrypt code is broken - please report bug!");
@@ -234,12 +421,71 @@ selectsmix(void)
 	abort();
 }
 
+/* Called with smix_func already selected. */
+static void
+selectsmix_wide(void)
+{
+
+#ifdef CPUSUPPORT_X86_AVX512F
+	/* If we're running on an AVX-512 CPU, try four lanes at once. */
+	if (cpusupport_x86_avx512f()) {
+		/* If AVX-512 smix works, use it. */
+		if (!testsmix_wide(crypto_scrypt_smix_avx512, 4)) {
+			smix_wide_func = crypto_scrypt_smix_avx512;
+			smix_wide_width = 4;
+			return;
+		}
+		warn0("Disabling broken AVX-512 scrypt support - please report bug!");
+	}
+#endif
+
+#ifdef CPUSUPPORT_X86_AVX2
+	/* If we're running on an AVX2 CPU, try two lanes at once. */
+	if (cpusupport_x86_avx2()) {
+		/* If AVX2 smix works, use it. */
+		if (!testsmix_wide(crypto_scrypt_smix_avx2, 2)) {
+			smix_wide_func = crypto_scrypt_smix_avx2;
+			smix_wide_width = 2;
+			return;
+		}
+		warn0("Disabling broken AVX2 scrypt support - please report bug!");
+	}
+#endif
+
+	/* Otherwise lanes are computed one at a time. */
+	smix_wide_func = smix_func;
+	smix_wide_width = 1;
+}
+
+/**
+ * initsmix(wide):
+ * Select smix_func, and smix_wide_func as well if ${wide} is non-zero, unless
+ * that has already been done.  Safe to call from several threads at once.
+ */
+static void
+initsmix(int wide)
+{
+
+#ifdef HAVE_PTHREAD
+	pthread_once(&smix_once, selectsmix);
+	if (wide)
+		pthread_once(&smix_wide_once, selectsmix_wide);
+#else
+	if (smix_func == NULL)
+		selectsmix();
+	if (wide && (smix_wide_width == 0))
+		selectsmix_wide();
+#endif
+}
+
 /**
  * crypto_scrypt(passwd, passwdlen, salt, saltlen, N, r, p, buf, buflen):
  * Compute scrypt(passwd[0 .. passwdlen - 1], salt[0 .. saltlen - 1], N, r,
  * p, buflen) and write the result into buf.  The parameters r, p, and buflen
  * must satisfy r * p < 2^30 and buflen <= (2^32 - 1) * 32.  The parameter N
- * must be a power of 2 greater than 1.
+ * must be a power of 2 greater than 1.  The lanes are computed one at a time
+ * with the SSE2 or generic smix, so that V is only 128rN bytes; the multi-lane
+ * AVX2 and AVX-512 code is only used by crypto_scrypt_parallel.
  *
  * Return 0 on success; or -1 on error.
  */
@@ -249,9 +495,82 @@ crypto_scrypt(const uint8_t * passwd, size_t passwdlen,
     uint8_t * buf, size_t buflen)
 {
 
-	if (smix_func == NULL)
-		selectsmix();
+	initsmix(0);
+
+	return (_crypto_scrypt(passwd, passwdlen, salt, saltlen, N, _r, _p,
+	    buf, buflen, 1, smix_func, 1, smix_func, 0));
+}
+
+/**
+ * crypto_scrypt_parallel(passwd, passwdlen, salt, saltlen, N, r, p, buf,
+ *     buflen, maxthreads, maxmem, flags):
+ * Compute the same result as crypto_scrypt, but work on up to ${maxthreads}
+ * of the p lanes at once, each thread running several lanes side by side in
+ * SIMD registers when the CPU supports it.  The threads other than the
+ * calling one come from a pool shared by all callers, with at most one
+ * thread per online CPU.  Each lane in flight needs its own
+ * 128rN + 256r + 64 bytes of temporary storage, so the number of lanes is
+ * further limited to what fits in the memory budget given by
+ * memtouse(${maxmem}, 0.5); pass a ${maxmem} of 0 to only be limited by the
+ * available memory.  The CRYPTO_SCRYPT_V_* ${flags} select how that storage
+ * is allocated.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int
+crypto_scrypt_parallel(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t _r, uint32_t _p,
+    uint8_t * buf, size_t buflen, uint32_t maxthreads, size_t maxmem,
+    int flags)
+{
+	size_t nthreads = maxthreads;
+	size_t width;
+	size_t memlimit, lanemem, maxlanes;
+
+	initsmix(1);
+	width = smix_wide_width;
+
+#ifndef HAVE_PTHREAD
+	nthreads = 1;
+#endif
+	if (nthreads > _p)
+		nthreads = _p;
+#ifdef HAVE_PTHREAD
+	if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+#endif
+	if (width > _p)
+		width = 1;
+	if ((nthreads > 1) || (width > 1)) {
+		if (memtouse(maxmem, 0.5, &memlimit))
+			return (-1);
+		/* Overflow is caught by _crypto_scrypt's parameter checks. */
+		lanemem = 128 * (size_t)(_r) * (size_t)(N) + 256 * (size_t)(_r) + 64;
+		maxlanes = (lanemem > 0) ? memlimit / lanemem : 1;
+
+		/* Give up SIMD width before threads, then threads too. */
+		if (width > maxlanes)
+			width = 1;
+		if (nthreads > maxlanes / width)
+			nthreads = maxlanes / width;
+		if (nthreads < 1)
+			nthreads = 1;
+	}
 
 	return (_crypto_scrypt(passwd, passwdlen, salt, saltlen, N, _r, _p,
-	    buf, buflen, smix_func));
+	    buf, buflen, nthreads, smix_func, width, smix_wide_func, flags));
+}
+
+/**
+ * crypto_scrypt_backend(void):
+ * Return the name of the smix implementation used by crypto_scrypt, e.g.
+ * "sse2" or "generic".
+ */
+const char *
+crypto_scrypt_backend(void)
+{
+
+	initsmix(0);
+
+	return (smix_name);
 }
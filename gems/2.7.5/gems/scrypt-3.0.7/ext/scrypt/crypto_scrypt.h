@@ -32,16 +32,46 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "crypto_scrypt_vmem.h"
+
 /**
  * crypto_scrypt(passwd, passwdlen, salt, saltlen, N, r, p, buf, buflen):
  * Compute scrypt(passwd[0 .. passwdlen - 1], salt[0 .. saltlen - 1], N, r,
  * p, buflen) and write the result into buf.  The parameters r, p, and buflen
  * must satisfy r * p < 2^30 and buflen <= (2^32 - 1) * 32.  The parameter N
- * must be a power of 2 greater than 1.
+ * must be a power of 2 greater than 1.  The lanes are computed one at a time
+ * with the SSE2 or generic smix, so that V is only 128rN bytes; the multi-lane
+ * AVX2 and AVX-512 code is only used by crypto_scrypt_parallel.
  *
  * Return 0 on success; or -1 on error.
  */
 int crypto_scrypt(const uint8_t *, size_t, const uint8_t *, size_t, uint64_t,
     uint32_t, uint32_t, uint8_t *, size_t);
 
+/**
+ * crypto_scrypt_parallel(passwd, passwdlen, salt, saltlen, N, r, p, buf,
+ *     buflen, maxthreads, maxmem, flags):
+ * Compute the same result as crypto_scrypt, but work on up to ${maxthreads}
+ * of the p lanes at once, each thread running several lanes side by side in
+ * SIMD registers when the CPU supports it.  The threads other than the
+ * calling one come from a pool shared by all callers, with at most one
+ * thread per online CPU.  Each lane in flight needs its own
+ * 128rN + 256r + 64 bytes of temporary storage, so the number of lanes is
+ * further limited to what fits in the memory budget given by
+ * memtouse(${maxmem}, 0.5); pass a ${maxmem} of 0 to only be limited by the
+ * available memory.  The CRYPTO_SCRYPT_V_* ${flags} select how that storage
+ * is allocated.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int crypto_scrypt_parallel(const uint8_t *, size_t, const uint8_t *, size_t,
+    uint64_t, uint32_t, uint32_t, uint8_t *, size_t, uint32_t, size_t, int);
+
+/**
+ * crypto_scrypt_backend(void):
+ * Return the name of the smix implementation used by crypto_scrypt, e.g.
+ * "sse2" or "generic".
+ */
+const char * crypto_scrypt_backend(void);
+
 #endif /* !_CRYPTO_SCRYPT_H_ */
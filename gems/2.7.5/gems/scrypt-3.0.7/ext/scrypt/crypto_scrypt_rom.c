@@ -0,0 +1,483 @@
+#if defined(_POSIX_C_SOURCE) && (_POSIX_C_SOURCE < 200809L)
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L	/* mkstemp, fchmod and posix_fallocate. */
+#endif
+
+#include "scrypt_platform.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#if !defined(WINDOWS_OS)
+	#include <sys/mman.h>
+	#ifndef HAVE_MMAP
+		#define HAVE_MMAP 1
+	#endif
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crypto_scrypt_smix.h"
+#include "crypto_scrypt_vmem.h"
+#include "sha256.h"
+#include "sysendian.h"
+
+#include "crypto_scrypt_rom.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+ * File layout: a ROM_HEADERLEN byte header holding ROM_MAGIC, r (le32 at
+ * offset 16) and NROM (le64 at offset 24), followed by the blocks.
+ */
+#define ROM_MAGIC "scrypt-rom v1\n\0\0"
+#define ROM_MAGICLEN 16
+#define ROM_HEADERLEN 64
+
+/* Salt used to expand the seed into the first block. */
+#define ROM_SALT "scrypt-rom"
+
+struct crypto_scrypt_rom {
+	uint8_t * base;
+	size_t len;
+	int mapped;
+	uint32_t r;
+	uint64_t NROM;
+};
+
+/* Check r and NROM, and compute the file size for them. */
+static int
+rom_size(uint32_t _r, uint64_t NROM, size_t * len)
+{
+	size_t r = _r;
+
+	if ((r == 0) || (NROM < 2) || ((NROM & (NROM - 1)) != 0)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if ((r > (SIZE_MAX - 64) / 256) ||
+	    (NROM > (SIZE_MAX - ROM_HEADERLEN) / 128 / r)) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	*len = ROM_HEADERLEN + 128 * r * NROM;
+
+	return (0);
+}
+
+#ifdef HAVE_MMAP
+/*
+ * Make the file ${fd} ${len} bytes long.  The blocks are allocated as well
+ * where the file system can, so that running out of space is reported here
+ * rather than by a SIGBUS when the mapping is written.
+ */
+static int
+rom_extend(int fd, size_t len)
+{
+	int rc;
+
+	if (((off_t)len < 0) || ((uintmax_t)(off_t)len != (uintmax_t)len)) {
+		errno = EFBIG;
+		return (-1);
+	}
+	if (ftruncate(fd, (off_t)len))
+		return (-1);
+	rc = posix_fallocate(fd, 0, (off_t)len);
+	if ((rc != 0) && (rc != EINVAL) && (rc != EOPNOTSUPP)) {
+		errno = rc;
+		return (-1);
+	}
+
+	return (0);
+}
+#else
+/* Write all ${len} bytes of ${buf} to ${fd}. */
+static int
+rom_write(int fd, const uint8_t * buf, size_t len)
+{
+	ssize_t lenwrit;
+
+	while (len > 0) {
+		if ((lenwrit = write(fd, buf, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		buf += lenwrit;
+		len -= (size_t)lenwrit;
+	}
+
+	return (0);
+}
+
+/* Read all ${len} bytes of ${buf} from ${fd}. */
+static int
+rom_read(int fd, uint8_t * buf, size_t len)
+{
+	ssize_t lenread;
+
+	while (len > 0) {
+		if ((lenread = read(fd, buf, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		if (lenread == 0) {
+			errno = EINVAL;
+			return (-1);
+		}
+		buf += lenread;
+		len -= (size_t)lenread;
+	}
+
+	return (0);
+}
+#endif
+
+/**
+ * crypto_scrypt_rom_generate(path, seed, seedlen, r, NROM):
+ * Derive a table of ${NROM} blocks of 128${r} bytes from ${seed} and store
+ * it in the file ${path}, replacing it atomically if it exists.  The same
+ * seed and parameters always give the same table.  ${NROM} must be a power
+ * of 2 greater than 1.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int
+crypto_scrypt_rom_generate(const char * path, const uint8_t * seed,
+    size_t seedlen, uint32_t r, uint64_t NROM)
+{
+	uint8_t * buf;
+	void * XY0;
+	uint32_t * XY;
+	uint8_t * B;
+	char * tmp;
+	size_t len, tmplen;
+	int fd, saved;
+
+	/* Check the parameters, and allocate the first block and XY. */
+	if (rom_size(r, NROM, &len))
+		goto err0;
+	if ((B = malloc(128 * (size_t)r)) == NULL)
+		goto err0;
+#ifdef HAVE_POSIX_MEMALIGN
+	if ((errno = posix_memalign(&XY0, 64, 256 * (size_t)r + 64)) != 0)
+		goto err1;
+	XY = (uint32_t *)(XY0);
+#else
+	if ((XY0 = malloc(256 * (size_t)r + 64 + 63)) == NULL)
+		goto err1;
+	XY = (uint32_t *)(((uintptr_t)(XY0) + 63) & ~ (uintptr_t)(63));
+#endif
+
+	/* Create a file of our own next to ${path}. */
+	tmplen = strlen(path) + 8;
+	if ((tmp = malloc(tmplen)) == NULL)
+		goto err2;
+	snprintf(tmp, tmplen, "%s.XXXXXX", path);
+	if ((fd = mkstemp(tmp)) == -1)
+		goto err3;
+	if (fchmod(fd, 0644))
+		goto err4;
+
+#ifdef HAVE_MMAP
+	/* Size it and compute the table straight into its pages. */
+	if (rom_extend(fd, len))
+		goto err4;
+	if ((buf = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+	    0)) == MAP_FAILED)
+		goto err4;
+#else
+	if ((buf = malloc(len)) == NULL)
+		goto err4;
+#endif
+
+	/* Header. */
+	memset(buf, 0, ROM_HEADERLEN);
+	memcpy(buf, ROM_MAGIC, ROM_MAGICLEN);
+	le32enc(&buf[16], r);
+	le64enc(&buf[24], NROM);
+
+	/* Blocks. */
+	PBKDF2_SHA256(seed, seedlen, (const uint8_t *)ROM_SALT,
+	    strlen(ROM_SALT), 1, B, 128 * (size_t)r);
+	crypto_scrypt_smix_rom_fill(B, r, &buf[ROM_HEADERLEN], NROM, XY);
+
+#ifdef HAVE_MMAP
+	/* The pages are in the page cache; the kernel writes them back. */
+	if (munmap(buf, len))
+		goto err4;
+#else
+	if (rom_write(fd, buf, len)) {
+		saved = errno;
+		free(buf);
+		errno = saved;
+		goto err4;
+	}
+	free(buf);
+#endif
+
+	/* Move it into place. */
+	if (close(fd))
+		goto err5;
+	if (rename(tmp, path))
+		goto err5;
+
+	/* Clean up. */
+	free(tmp);
+	free(XY0);
+	free(B);
+
+	/* Success! */
+	return (0);
+
+err4:
+	saved = errno;
+	close(fd);
+	errno = saved;
+err5:
+	saved = errno;
+	unlink(tmp);
+	errno = saved;
+err3:
+	free(tmp);
+err2:
+	free(XY0);
+err1:
+	free(B);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * crypto_scrypt_rom_open(path):
+ * Map the table stored in ${path} by crypto_scrypt_rom_generate read-only.
+ * Processes which open the same file share its pages.
+ *
+ * Return NULL on error.
+ */
+struct crypto_scrypt_rom *
+crypto_scrypt_rom_open(const char * path)
+{
+	struct crypto_scrypt_rom * rom;
+	uint8_t header[ROM_HEADERLEN];
+	struct stat sb;
+	size_t len;
+	ssize_t lenread;
+	int fd, saved;
+
+	if ((rom = malloc(sizeof(struct crypto_scrypt_rom))) == NULL)
+		goto err0;
+	if ((fd = open(path, O_RDONLY | O_BINARY)) == -1)
+		goto err1;
+
+	/* Check the header against the size of the file. */
+	if (fstat(fd, &sb))
+		goto err2;
+	do {
+		lenread = read(fd, header, ROM_HEADERLEN);
+	} while ((lenread == -1) && (errno == EINTR));
+	if (lenread == -1)
+		goto err2;
+	if ((lenread != ROM_HEADERLEN) ||
+	    (memcmp(header, ROM_MAGIC, ROM_MAGICLEN) != 0)) {
+		errno = EINVAL;
+		goto err2;
+	}
+	rom->r = le32dec(&header[16]);
+	rom->NROM = le64dec(&header[24]);
+	if (rom_size(rom->r, rom->NROM, &len))
+		goto err2;
+	if ((sb.st_size < 0) || ((uintmax_t)sb.st_size != (uintmax_t)len)) {
+		errno = EINVAL;
+		goto err2;
+	}
+	rom->len = len;
+
+#ifdef HAVE_MMAP
+	/* Map it; the pages are shared through the page cache. */
+	if ((rom->base = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0)) ==
+	    MAP_FAILED)
+		goto err2;
+	rom->mapped = 1;
+#ifdef POSIX_MADV_RANDOM
+	/* Blocks are read in no particular order. */
+	posix_madvise(rom->base, len, POSIX_MADV_RANDOM);
+#endif
+#else
+	/* Read it into memory of our own. */
+	if ((rom->base = malloc(len)) == NULL)
+		goto err2;
+	memcpy(rom->base, header, ROM_HEADERLEN);
+	if (rom_read(fd, &rom->base[ROM_HEADERLEN], len - ROM_HEADERLEN)) {
+		saved = errno;
+		free(rom->base);
+		errno = saved;
+		goto err2;
+	}
+	rom->mapped = 0;
+#endif
+	close(fd);
+
+	/* Success! */
+	return (rom);
+
+err2:
+	saved = errno;
+	close(fd);
+	errno = saved;
+err1:
+	free(rom);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * crypto_scrypt_rom_r(rom), crypto_scrypt_rom_nrom(rom):
+ * Return the block size parameter r and the number of blocks of ${rom}.
+ */
+uint32_t
+crypto_scrypt_rom_r(const struct crypto_scrypt_rom * rom)
+{
+
+	return (rom->r);
+}
+
+uint64_t
+crypto_scrypt_rom_nrom(const struct crypto_scrypt_rom * rom)
+{
+
+	return (rom->NROM);
+}
+
+/**
+ * crypto_scrypt_rom_close(rom):
+ * Unmap ${rom} and free it.
+ */
+void
+crypto_scrypt_rom_close(struct crypto_scrypt_rom * rom)
+{
+
+	if (rom == NULL)
+		return;
+
+#ifdef HAVE_MMAP
+	if (rom->mapped)
+		munmap(rom->base, rom->len);
+	else
+#endif
+		free(rom->base);
+	free(rom);
+}
+
+/**
+ * crypto_scrypt_rom(rom, passwd, passwdlen, salt, saltlen, N, r, p, buf,
+ *     buflen, vflags):
+ * Compute scrypt(passwd[0 .. passwdlen - 1], salt[0 .. saltlen - 1], N, r,
+ * p, buflen) with every second step of the second SMix loop reading from
+ * ${rom} instead of V, and write the result into buf.  Only 128rN bytes of
+ * V are needed, however large ${rom} is; they are allocated as selected by
+ * the CRYPTO_SCRYPT_V_* ${vflags}.  The parameter r must be the one ${rom}
+ * was generated with; the other parameters are as for crypto_scrypt.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int
+crypto_scrypt_rom(const struct crypto_scrypt_rom * rom,
+    const uint8_t * passwd, size_t passwdlen, const uint8_t * salt,
+    size_t saltlen, uint64_t N, uint32_t _r, uint32_t _p, uint8_t * buf,
+    size_t buflen, int vflags)
+{
+	struct crypto_scrypt_vmem vmem;
+	void * B0, * XY0;
+	uint8_t * B;
+	uint32_t * V;
+	uint32_t * XY;
+	size_t r = _r, p = _p;
+	size_t i;
+
+	/* Sanity-check parameters. */
+	if (_r != rom->r) {
+		errno = EINVAL;
+		goto err0;
+	}
+#if SIZE_MAX > UINT32_MAX
+	if (buflen > (((uint64_t)(1) << 32) - 1) * 32) {
+		errno = EFBIG;
+		goto err0;
+	}
+#endif
+	if ((uint64_t)(r) * (uint64_t)(p) >= (1 << 30)) {
+		errno = EFBIG;
+		goto err0;
+	}
+	if (((N & (N - 1)) != 0) || (N < 2)) {
+		errno = EINVAL;
+		goto err0;
+	}
+	if ((r > SIZE_MAX / 128 / p) ||
+#if SIZE_MAX / 256 <= UINT32_MAX
+	    (r > (SIZE_MAX - 64) / 256) ||
+#endif
+	    (N > SIZE_MAX / 128 / r)) {
+		errno = ENOMEM;
+		goto err0;
+	}
+
+	/* Allocate memory. */
+#ifdef HAVE_POSIX_MEMALIGN
+	if ((errno = posix_memalign(&B0, 64, 128 * r * p)) != 0)
+		goto err0;
+	B = (uint8_t *)(B0);
+	if ((errno = posix_memalign(&XY0, 64, 256 * r + 64)) != 0)
+		goto err1;
+	XY = (uint32_t *)(XY0);
+#else
+	if ((B0 = malloc(128 * r * p + 63)) == NULL)
+		goto err0;
+	B = (uint8_t *)(((uintptr_t)(B0) + 63) & ~ (uintptr_t)(63));
+	if ((XY0 = malloc(256 * r + 64 + 63)) == NULL)
+		goto err1;
+	XY = (uint32_t *)(((uintptr_t)(XY0) + 63) & ~ (uintptr_t)(63));
+#endif
+	if ((V = crypto_scrypt_vmem_alloc(&vmem, 128 * r * N, vflags)) == NULL)
+		goto err2;
+
+	/* 1: (B_0 ... B_{p-1}) <-- PBKDF2(P, S, 1, p * MFLen) */
+	PBKDF2_SHA256(passwd, passwdlen, salt, saltlen, 1, B, p * 128 * r);
+
+	/* 2: for i = 0 to p - 1 do */
+	for (i = 0; i < p; i++) {
+		/* 3: B_i <-- MF(B_i, N), with help from the ROM */
+		crypto_scrypt_smix_rom(&B[i * 128 * r], r, N, V, XY,
+		    &rom->base[ROM_HEADERLEN], rom->NROM);
+	}
+
+	/* 5: DK <-- PBKDF2(P, B, 1, dkLen) */
+	PBKDF2_SHA256(passwd, passwdlen, B, p * 128 * r, 1, buf, buflen);
+
+	/* Free memory. */
+	if (crypto_scrypt_vmem_free(&vmem, 128 * r * N))
+		goto err2;
+	free(XY0);
+	free(B0);
+
+	/* Success! */
+	return (0);
+
+err2:
+	free(XY0);
+err1:
+	free(B0);
+err0:
+	/* Failure! */
+	return (-1);
+}
@@ -0,0 +1,60 @@
+#ifndef _CRYPTO_SCRYPT_ROM_H_
+#define _CRYPTO_SCRYPT_ROM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Opaque read-only table, shared with other processes using the same file. */
+struct crypto_scrypt_rom;
+
+/**
+ * crypto_scrypt_rom_generate(path, seed, seedlen, r, NROM):
+ * Derive a table of ${NROM} blocks of 128${r} bytes from ${seed} and store
+ * it in the file ${path}, replacing it atomically if it exists.  The same
+ * seed and parameters always give the same table.  ${NROM} must be a power
+ * of 2 greater than 1.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int crypto_scrypt_rom_generate(const char *, const uint8_t *, size_t,
+    uint32_t, uint64_t);
+
+/**
+ * crypto_scrypt_rom_open(path):
+ * Map the table stored in ${path} by crypto_scrypt_rom_generate read-only.
+ * Processes which open the same file share its pages.
+ *
+ * Return NULL on error.
+ */
+struct crypto_scrypt_rom * crypto_scrypt_rom_open(const char *);
+
+/**
+ * crypto_scrypt_rom_r(rom), crypto_scrypt_rom_nrom(rom):
+ * Return the block size parameter r and the number of blocks of ${rom}.
+ */
+uint32_t crypto_scrypt_rom_r(const struct crypto_scrypt_rom *);
+uint64_t crypto_scrypt_rom_nrom(const struct crypto_scrypt_rom *);
+
+/**
+ * crypto_scrypt_rom_close(rom):
+ * Unmap ${rom} and free it.
+ */
+void crypto_scrypt_rom_close(struct crypto_scrypt_rom *);
+
+/**
+ * crypto_scrypt_rom(rom, passwd, passwdlen, salt, saltlen, N, r, p, buf,
+ *     buflen, vflags):
+ * Compute scrypt(passwd[0 .. passwdlen - 1], salt[0 .. saltlen - 1], N, r,
+ * p, buflen) with every second step of the second SMix loop reading from
+ * ${rom} instead of V, and write the result into buf.  Only 128rN bytes of
+ * V are needed, however large ${rom} is; they are allocated as selected by
+ * the CRYPTO_SCRYPT_V_* ${vflags}.  The parameter r must be the one ${rom}
+ * was generated with; the other parameters are as for crypto_scrypt.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int crypto_scrypt_rom(const struct crypto_scrypt_rom *, const uint8_t *,
+    size_t, const uint8_t *, size_t, uint64_t, uint32_t, uint32_t, uint8_t *,
+    size_t, int);
+
+#endif /* !_CRYPTO_SCRYPT_ROM_H_ */
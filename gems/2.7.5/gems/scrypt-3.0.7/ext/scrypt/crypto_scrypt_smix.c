@@ -35,6 +35,7 @@
 
 static void blkcpy(void *, const void *, size_t);
 static void blkxor(void *, const void *, size_t);
+static void blkxor_le(uint32_t *, const uint8_t *, size_t);
 static void salsa20_8(uint32_t[16]);
 static void blockmix_salsa8(const uint32_t *, uint32_t *, uint32_t *, size_t);
 static uint64_t integerify(const void *, size_t);
@@ -63,6 +64,19 @@ blkxor(void * dest, const void * src, size_t len)
 		D[i] ^= S[i];
 }
 
+/**
+ * blkxor_le(dest, src, len):
+ * XOR the ${len} little-endian words at ${src} into ${dest}.
+ */
+static void
+blkxor_le(uint32_t * dest, const uint8_t * src, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		dest[i] ^= le32dec(&src[4 * i]);
+}
+
 /**
  * salsa20_8(B):
  * Apply the salsa20/8 core to the provided block.
@@ -212,3 +226,105 @@ crypto_scrypt_smix(uint8_t * B, size_t r, uint64_t N, void * _V, void * XY)
 	for (k = 0; k < 32 * r; k++)
 		le32enc(&B[4 * k], X[k]);
 }
+
+/**
+ * crypto_scrypt_smix_rom(B, r, N, V, XY, ROM, NROM):
+ * Compute B = SMix_r(B, N) as crypto_scrypt_smix does, except that every
+ * second step of the second loop reads block Integerify(X) mod NROM of the
+ * read-only table ${ROM} instead of a block of V.  ${ROM} holds NROM blocks
+ * of 128r bytes, stored as little-endian words; NROM must be a power of 2.
+ * The other arguments are as for crypto_scrypt_smix.
+ */
+void
+crypto_scrypt_smix_rom(uint8_t * B, size_t r, uint64_t N, void * _V,
+    void * XY, const uint8_t * ROM, uint64_t NROM)
+{
+	uint32_t * X = XY;
+	uint32_t * Y = (void *)((uint8_t *)(XY) + 128 * r);
+	uint32_t * Z = (void *)((uint8_t *)(XY) + 256 * r);
+	uint32_t * V = _V;
+	uint64_t i;
+	uint64_t j;
+	size_t k;
+
+	/* 1: X <-- B */
+	for (k = 0; k < 32 * r; k++)
+		X[k] = le32dec(&B[4 * k]);
+
+	/* 2: for i = 0 to N - 1 do */
+	for (i = 0; i < N; i += 2) {
+		/* 3: V_i <-- X */
+		blkcpy(&V[i * (32 * r)], X, 128 * r);
+
+		/* 4: X <-- H(X) */
+		blockmix_salsa8(X, Y, Z, r);
+
+		/* 3: V_i <-- X */
+		blkcpy(&V[(i + 1) * (32 * r)], Y, 128 * r);
+
+		/* 4: X <-- H(X) */
+		blockmix_salsa8(Y, X, Z, r);
+	}
+
+	/* 6: for i = 0 to N - 1 do */
+	for (i = 0; i < N; i += 2) {
+		/* 7: j <-- Integerify(X) mod N */
+		j = integerify(X, r) & (N - 1);
+
+		/* 8: X <-- H(X \xor V_j) */
+		blkxor(X, &V[j * (32 * r)], 128 * r);
+		blockmix_salsa8(X, Y, Z, r);
+
+		/* 7: j <-- Integerify(X) mod NROM */
+		j = integerify(Y, r) & (NROM - 1);
+
+		/* 8: X <-- H(X \xor ROM_j) */
+		blkxor_le(Y, &ROM[j * (128 * r)], 32 * r);
+		blockmix_salsa8(Y, X, Z, r);
+	}
+
+	/* 10: B' <-- X */
+	for (k = 0; k < 32 * r; k++)
+		le32enc(&B[4 * k], X[k]);
+}
+
+/**
+ * crypto_scrypt_smix_rom_fill(B, r, ROM, NROM, XY):
+ * Fill ${ROM} with NROM blocks of 128r bytes derived from the 128r bytes at
+ * ${B}.  Each block is BlockMix of the previous one XORed with an earlier
+ * block chosen by Integerify, so that a block can't be recomputed cheaply
+ * on its own.  The temporary storage XY must be 256r + 64 bytes in length
+ * and aligned to a multiple of 64 bytes.
+ */
+void
+crypto_scrypt_smix_rom_fill(const uint8_t * B, size_t r, uint8_t * ROM,
+    uint64_t NROM, void * XY)
+{
+	uint32_t * X = XY;
+	uint32_t * Y = (void *)((uint8_t *)(XY) + 128 * r);
+	uint32_t * Z = (void *)((uint8_t *)(XY) + 256 * r);
+	uint32_t * T;
+	uint64_t i;
+	uint64_t j;
+	size_t k;
+
+	/* X <-- B */
+	for (k = 0; k < 32 * r; k++)
+		X[k] = le32dec(&B[4 * k]);
+
+	for (i = 0; i < NROM; i++) {
+		/* X <-- X \xor ROM_j, for some j < i */
+		if (i > 0) {
+			j = integerify(X, r) % i;
+			blkxor_le(X, &ROM[j * (128 * r)], 32 * r);
+		}
+
+		/* ROM_i <-- H(X) */
+		blockmix_salsa8(X, Y, Z, r);
+		T = X;
+		X = Y;
+		Y = T;
+		for (k = 0; k < 32 * r; k++)
+			le32enc(&ROM[i * (128 * r) + 4 * k], X[k]);
+	}
+}
@@ -11,4 +11,26 @@
  */
 void crypto_scrypt_smix(uint8_t *, size_t, uint64_t, void *, void *);
 
+/**
+ * crypto_scrypt_smix_rom(B, r, N, V, XY, ROM, NROM):
+ * Compute B = SMix_r(B, N) as crypto_scrypt_smix does, except that every
+ * second step of the second loop reads block Integerify(X) mod NROM of the
+ * read-only table ${ROM} instead of a block of V.  ${ROM} holds NROM blocks
+ * of 128r bytes, stored as little-endian words; NROM must be a power of 2.
+ * The other arguments are as for crypto_scrypt_smix.
+ */
+void crypto_scrypt_smix_rom(uint8_t *, size_t, uint64_t, void *, void *,
+    const uint8_t *, uint64_t);
+
+/**
+ * crypto_scrypt_smix_rom_fill(B, r, ROM, NROM, XY):
+ * Fill ${ROM} with NROM blocks of 128r bytes derived from the 128r bytes at
+ * ${B}.  Each block is BlockMix of the previous one XORed with an earlier
+ * block chosen by Integerify, so that a block can't be recomputed cheaply
+ * on its own.  The temporary storage XY must be 256r + 64 bytes in length
+ * and aligned to a multiple of 64 bytes.
+ */
+void crypto_scrypt_smix_rom_fill(const uint8_t *, size_t, uint8_t *, uint64_t,
+    void *);
+
 #endif /* !_CRYPTO_SCRYPT_SMIX_H_ */
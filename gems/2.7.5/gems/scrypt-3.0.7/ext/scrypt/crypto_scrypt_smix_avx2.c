@@ -0,0 +1,303 @@
+/*-
+ * Copyright 2009 Colin Percival
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file was originally written by Colin Percival as part of the Tarsnap
+ * online backup system.
+ */
+#include "cpusupport.h"
+#ifdef CPUSUPPORT_X86_AVX2
+
+/* Only this file is built for AVX2; the rest of the library is not. */
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), \
+    apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#include "sysendian.h"
+
+#include "crypto_scrypt_smix_avx2.h"
+
+/* Number of independent blocks processed side by side. */
+#define LANES 2
+
+static void blkcpy(void *, const void *, size_t);
+static void blkxor(void *, const void *, size_t);
+static void blkxor_gather(__m256i *, const uint8_t *, const uint64_t *,
+    size_t);
+static void salsa20_8(__m256i[4]);
+static void blockmix_salsa8(const __m256i *, __m256i *, __m256i *, size_t);
+static uint64_t integerify(const void *, size_t, size_t);
+
+static void
+blkcpy(void * dest, const void * src, size_t len)
+{
+	__m256i * D = dest;
+	const __m256i * S = src;
+	size_t L = len / 32;
+	size_t i;
+
+	for (i = 0; i < L; i++)
+		D[i] = S[i];
+}
+
+static void
+blkxor(void * dest, const void * src, size_t len)
+{
+	__m256i * D = dest;
+	const __m256i * S = src;
+	size_t L = len / 32;
+	size_t i;
+
+	for (i = 0; i < L; i++)
+		D[i] = _mm256_xor_si256(D[i], S[i]);
+}
+
+/**
+ * blkxor_gather(D, V, j, r):
+ * XOR into the interleaved blocks D the entries V_{j[0]} of the first lane
+ * and V_{j[1]} of the second lane of the interleaved array V.
+ */
+static void
+blkxor_gather(__m256i * D, const uint8_t * V, const uint64_t * j, size_t r)
+{
+	const uint8_t * V0 = &V[j[0] * 128 * r * LANES];
+	const uint8_t * V1 = &V[j[1] * 128 * r * LANES + 16];
+	__m256i T;
+	size_t i;
+
+	for (i = 0; i < 8 * r; i++) {
+		T = _mm256_castsi128_si256(
+		    _mm_load_si128((const __m128i *)&V0[i * 32]));
+		T = _mm256_inserti128_si256(T,
+		    _mm_load_si128((const __m128i *)&V1[i * 32]), 1);
+		D[i] = _mm256_xor_si256(D[i], T);
+	}
+}
+
+/**
+ * salsa20_8(B):
+ * Apply the salsa20/8 core to the two blocks held in the halves of B.
+ */
+static void
+salsa20_8(__m256i B[4])
+{
+	__m256i X0, X1, X2, X3;
+	__m256i T;
+	size_t i;
+
+	X0 = B[0];
+	X1 = B[1];
+	X2 = B[2];
+	X3 = B[3];
+
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on "columns". */
+		T = _mm256_add_epi32(X0, X3);
+		X1 = _mm256_xor_si256(X1, _mm256_slli_epi32(T, 7));
+		X1 = _mm256_xor_si256(X1, _mm256_srli_epi32(T, 25));
+		T = _mm256_add_epi32(X1, X0);
+		X2 = _mm256_xor_si256(X2, _mm256_slli_epi32(T, 9));
+		X2 = _mm256_xor_si256(X2, _mm256_srli_epi32(T, 23));
+		T = _mm256_add_epi32(X2, X1);
+		X3 = _mm256_xor_si256(X3, _mm256_slli_epi32(T, 13));
+		X3 = _mm256_xor_si256(X3, _mm256_srli_epi32(T, 19));
+		T = _mm256_add_epi32(X3, X2);
+		X0 = _mm256_xor_si256(X0, _mm256_slli_epi32(T, 18));
+		X0 = _mm256_xor_si256(X0, _mm256_srli_epi32(T, 14));
+
+		/* Rearrange data. */
+		X1 = _mm256_shuffle_epi32(X1, 0x93);
+		X2 = _mm256_shuffle_epi32(X2, 0x4E);
+		X3 = _mm256_shuffle_epi32(X3, 0x39);
+
+		/* Operate on "rows". */
+		T = _mm256_add_epi32(X0, X1);
+		X3 = _mm256_xor_si256(X3, _mm256_slli_epi32(T, 7));
+		X3 = _mm256_xor_si256(X3, _mm256_srli_epi32(T, 25));
+		T = _mm256_add_epi32(X3, X0);
+		X2 = _mm256_xor_si256(X2, _mm256_slli_epi32(T, 9));
+		X2 = _mm256_xor_si256(X2, _mm256_srli_epi32(T, 23));
+		T = _mm256_add_epi32(X2, X3);
+		X1 = _mm256_xor_si256(X1, _mm256_slli_epi32(T, 13));
+		X1 = _mm256_xor_si256(X1, _mm256_srli_epi32(T, 19));
+		T = _mm256_add_epi32(X1, X2);
+		X0 = _mm256_xor_si256(X0, _mm256_slli_epi32(T, 18));
+		X0 = _mm256_xor_si256(X0, _mm256_srli_epi32(T, 14));
+
+		/* Rearrange data. */
+		X1 = _mm256_shuffle_epi32(X1, 0x39);
+		X2 = _mm256_shuffle_epi32(X2, 0x4E);
+		X3 = _mm256_shuffle_epi32(X3, 0x93);
+	}
+
+	B[0] = _mm256_add_epi32(B[0], X0);
+	B[1] = _mm256_add_epi32(B[1], X1);
+	B[2] = _mm256_add_epi32(B[2], X2);
+	B[3] = _mm256_add_epi32(B[3], X3);
+}
+
+/**
+ * blockmix_salsa8(Bin, Bout, X, r):
+ * Compute Bout = BlockMix_{salsa20/8, r}(Bin) for both lanes.  The input Bin
+ * must be 2 * 128r bytes in length; the output Bout must also be the same
+ * size.  The temporary space X must be 2 * 64 bytes.
+ */
+static void
+blockmix_salsa8(const __m256i * Bin, __m256i * Bout, __m256i * X, size_t r)
+{
+	size_t i;
+
+	/* 1: X <-- B_{2r - 1} */
+	blkcpy(X, &Bin[8 * r - 4], 64 * LANES);
+
+	/* 2: for i = 0 to 2r - 1 do */
+	for (i = 0; i < r; i++) {
+		/* 3: X <-- H(X \xor B_i) */
+		blkxor(X, &Bin[i * 8], 64 * LANES);
+		salsa20_8(X);
+
+		/* 4: Y_i <-- X */
+		/* 6: B' <-- (Y_0, Y_2 ... Y_{2r-2}, Y_1, Y_3 ... Y_{2r-1}) */
+		blkcpy(&Bout[i * 4], X, 64 * LANES);
+
+		/* 3: X <-- H(X \xor B_i) */
+		blkxor(X, &Bin[i * 8 + 4], 64 * LANES);
+		salsa20_8(X);
+
+		/* 4: Y_i <-- X */
+		/* 6: B' <-- (Y_0, Y_2 ... Y_{2r-2}, Y_1, Y_3 ... Y_{2r-1}) */
+		blkcpy(&Bout[(r + i) * 4], X, 64 * LANES);
+	}
+}
+
+/**
+ * integerify(B, r, lane):
+ * Return the result of parsing B_{2r-1} of the given lane as a little-endian
+ * integer.  Note that B's layout is permuted and interleaved compared to the
+ * generic implementation: word w of a lane's block lives in row w / 4.
+ */
+static uint64_t
+integerify(const void * B, size_t r, size_t lane)
+{
+	const uint32_t * X = (const void *)((uintptr_t)(B) +
+	    (2 * r - 1) * 64 * LANES);
+
+	return (((uint64_t)(X[3 * 4 * LANES + lane * 4 + 1]) << 32) +
+	    X[lane * 4]);
+}
+
+/**
+ * crypto_scrypt_smix_avx2(B, r, N, V, XY):
+ * Compute B_i = SMix_r(B_i, N) for the two consecutive 128r-byte blocks
+ * B_0 and B_1 starting at B.  The temporary storage V must be 2 * 128rN bytes
+ * in length; the temporary storage XY must be 2 * (256r + 64) bytes in
+ * length.  The value N must be a power of 2 greater than 1.  The arrays B, V,
+ * and XY must be aligned to a multiple of 64 bytes.
+ *
+ * Use AVX2 instructions, one 128-bit half of each register per block.
+ */
+void
+crypto_scrypt_smix_avx2(uint8_t * B, size_t r, uint64_t N, void * V, void * XY)
+{
+	__m256i * X = XY;
+	__m256i * Y = (void *)((uintptr_t)(XY) + 128 * r * LANES);
+	__m256i * Z = (void *)((uintptr_t)(XY) + 256 * r * LANES);
+	uint32_t * X32 = (void *)X;
+	uint64_t i, j[LANES];
+	size_t k, l, w;
+
+	/* 1: X <-- B */
+	for (l = 0; l < LANES; l++) {
+		for (k = 0; k < 2 * r; k++) {
+			for (w = 0; w < 16; w++) {
+				X32[(k * 4 + w / 4) * 4 * LANES + l * 4 + w % 4] =
+				    le32dec(&B[l * 128 * r +
+				    (k * 16 + (w * 5 % 16)) * 4]);
+			}
+		}
+	}
+
+	/* 2: for i = 0 to N - 1 do */
+	for (i = 0; i < N; i += 2) {
+		/* 3: V_i <-- X */
+		blkcpy((void *)((uintptr_t)(V) + i * 128 * r * LANES), X,
+		    128 * r * LANES);
+
+		/* 4: X <-- H(X) */
+		blockmix_salsa8(X, Y, Z, r);
+
+		/* 3: V_i <-- X */
+		blkcpy((void *)((uintptr_t)(V) + (i + 1) * 128 * r * LANES),
+		    Y, 128 * r * LANES);
+
+		/* 4: X <-- H(X) */
+		blockmix_salsa8(Y, X, Z, r);
+	}
+
+	/* 6: for i = 0 to N - 1 do */
+	for (i = 0; i < N; i += 2) {
+		/* 7: j <-- Integerify(X) mod N */
+		for (l = 0; l < LANES; l++)
+			j[l] = integerify(X, r, l) & (N - 1);
+
+		/* 8: X <-- H(X \xor V_j) */
+		blkxor_gather(X, V, j, r);
+		blockmix_salsa8(X, Y, Z, r);
+
+		/* 7: j <-- Integerify(X) mod N */
+		for (l = 0; l < LANES; l++)
+			j[l] = integerify(Y, r, l) & (N - 1);
+
+		/* 8: X <-- H(X \xor V_j) */
+		blkxor_gather(Y, V, j, r);
+		blockmix_salsa8(Y, X, Z, r);
+	}
+
+	/* 10: B' <-- X */
+	for (l = 0; l < LANES; l++) {
+		for (k = 0; k < 2 * r; k++) {
+			for (w = 0; w < 16; w++) {
+				le32enc(&B[l * 128 * r +
+				    (k * 16 + (w * 5 % 16)) * 4],
+				    X32[(k * 4 + w / 4) * 4 * LANES + l * 4 +
+				    w % 4]);
+			}
+		}
+	}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif /* CPUSUPPORT_X86_AVX2 */
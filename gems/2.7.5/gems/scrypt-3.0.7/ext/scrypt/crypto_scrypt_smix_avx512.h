@@ -0,0 +1,16 @@
+#ifndef _CRYPTO_SCRYPT_SMIX_AVX512_H_
+#define _CRYPTO_SCRYPT_SMIX_AVX512_H_
+
+/**
+ * crypto_scrypt_smix_avx512(B, r, N, V, XY):
+ * Compute B_i = SMix_r(B_i, N) for the four consecutive 128r-byte blocks
+ * B_0 ... B_3 starting at B.  The temporary storage V must be 4 * 128rN bytes
+ * in length; the temporary storage XY must be 4 * (256r + 64) bytes in
+ * length.  The value N must be a power of 2 greater than 1.  The arrays B, V,
+ * and XY must be aligned to a multiple of 64 bytes.
+ *
+ * Use AVX-512F instructions, one 128-bit quarter of each register per block.
+ */
+void crypto_scrypt_smix_avx512(uint8_t *, size_t, uint64_t, void *, void *);
+
+#endif /* !_CRYPTO_SCRYPT_SMIX_AVX512_H_ */
@@ -0,0 +1,310 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* MAP_ANONYMOUS, MAP_HUGETLB, and madvise. */
+#endif
+
+#include <sys/types.h>
+#if !defined(WINDOWS_OS)
+	#include <sys/mman.h>
+	#ifndef HAVE_MMAP
+		#define HAVE_MMAP 1
+	#endif
+	#include <pthread.h>
+	#ifndef HAVE_PTHREAD
+		#define HAVE_PTHREAD 1
+	#endif
+#endif
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "insecure_memzero.h"
+
+#include "crypto_scrypt_vmem.h"
+
+#if !defined(MAP_ANON) && defined(MAP_ANONYMOUS)
+#define MAP_ANON MAP_ANONYMOUS
+#endif
+
+/* Size of a transparent huge page on the platforms which have them. */
+#define HUGEPAGE_SIZE ((size_t)(2 * 1024 * 1024))
+
+/* Kinds of allocation, for crypto_scrypt_vmem_free. */
+#define VMEM_MALLOC 0
+#define VMEM_MMAP 1
+#define VMEM_ARENA 2
+
+#if defined(MAP_ANON) && defined(HAVE_MMAP)
+/**
+ * vmem_prefault(buf, len):
+ * Write to every page of ${buf} so that computing on it takes no faults.
+ */
+static void
+vmem_prefault(uint8_t * buf, size_t len)
+{
+	volatile uint8_t * p = buf;
+	long pagesize;
+	size_t i;
+
+#ifdef MADV_POPULATE_WRITE
+	/* Let the kernel do it in one go if it can. */
+	if (madvise(buf, len, MADV_POPULATE_WRITE) == 0)
+		return;
+#endif
+	if ((pagesize = sysconf(_SC_PAGESIZE)) <= 0)
+		pagesize = 4096;
+	for (i = 0; i < len; i += (size_t)pagesize)
+		p[i] = 0;
+}
+
+/**
+ * vmem_map_hugepages(len, mflags, flags, maplen):
+ * Map ${len} bytes backed by huge pages if possible, pre-faulted if ${flags}
+ * asks for it, and store the mapped length in ${maplen}.  Return NULL if
+ * huge pages are not available at all.
+ */
+static void *
+vmem_map_hugepages(size_t len, int mflags, int flags, size_t * maplen)
+{
+	uint8_t * buf;
+	size_t hlen, lead;
+
+	/* Round up to whole huge pages. */
+	if (len > SIZE_MAX - 2 * HUGEPAGE_SIZE)
+		return (NULL);
+	hlen = (len + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+
+#ifdef MAP_HUGETLB
+	/* Use the reserved hugetlbfs pool first, if the admin set one up. */
+#ifdef MAP_POPULATE
+	if (flags & CRYPTO_SCRYPT_V_PREFAULT)
+		mflags |= MAP_POPULATE;
+#endif
+	if ((buf = mmap(NULL, hlen, PROT_READ | PROT_WRITE,
+	    mflags | MAP_HUGETLB, -1, 0)) != MAP_FAILED) {
+		*maplen = hlen;
+		return (buf);
+	}
+#ifdef MAP_POPULATE
+	mflags &= ~MAP_POPULATE;
+#endif
+#endif
+
+#ifdef MADV_HUGEPAGE
+	/*
+	 * Otherwise ask for transparent huge pages.  These are only used for
+	 * aligned 2 MiB extents, so map a spare one and trim the ends.
+	 */
+	if ((buf = mmap(NULL, hlen + HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+	    mflags, -1, 0)) == MAP_FAILED)
+		return (NULL);
+	lead = (HUGEPAGE_SIZE - ((uintptr_t)buf & (HUGEPAGE_SIZE - 1))) &
+	    (HUGEPAGE_SIZE - 1);
+	if (lead > 0)
+		munmap(buf, lead);
+	munmap(buf + lead + hlen, HUGEPAGE_SIZE - lead);
+	buf += lead;
+	if (madvise(buf, hlen, MADV_HUGEPAGE)) {
+		munmap(buf, hlen);
+		return (NULL);
+	}
+	if (flags & CRYPTO_SCRYPT_V_PREFAULT)
+		vmem_prefault(buf, hlen);
+	*maplen = hlen;
+	return (buf);
+#else
+	(void)lead;
+	return (NULL);
+#endif
+}
+
+/**
+ * vmem_map(len, flags, maplen):
+ * Map ${len} bytes of anonymous memory as selected by ${flags} and store the
+ * mapped length in ${maplen}.  Return NULL on error.
+ */
+static void *
+vmem_map(size_t len, int flags, size_t * maplen)
+{
+	uint8_t * buf;
+#ifdef MAP_NOCORE
+	int mflags = MAP_ANON | MAP_PRIVATE | MAP_NOCORE;
+#else
+	int mflags = MAP_ANON | MAP_PRIVATE;
+#endif
+
+	if ((flags & CRYPTO_SCRYPT_V_HUGEPAGES) &&
+	    ((buf = vmem_map_hugepages(len, mflags, flags, maplen)) != NULL))
+		return (buf);
+
+#ifdef MAP_POPULATE
+	if (flags & CRYPTO_SCRYPT_V_PREFAULT)
+		mflags |= MAP_POPULATE;
+#endif
+	if ((buf = mmap(NULL, len, PROT_READ | PROT_WRITE, mflags, -1, 0)) ==
+	    MAP_FAILED)
+		return (NULL);
+#ifndef MAP_POPULATE
+	if (flags & CRYPTO_SCRYPT_V_PREFAULT)
+		vmem_prefault(buf, len);
+#endif
+	*maplen = len;
+	return (buf);
+}
+#endif
+
+#if defined(MAP_ANON) && defined(HAVE_MMAP) && defined(HAVE_PTHREAD)
+#define HAVE_ARENA 1
+
+/* A thread's V arena, kept mapped between calls. */
+struct vmem_arena {
+	void * base;
+	size_t len;
+	int busy;
+};
+
+static pthread_key_t arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+static int arena_ok = 0;
+
+static void
+arena_destroy(void * cookie)
+{
+	struct vmem_arena * arena = cookie;
+
+	/* The contents were zeroed when the last call finished. */
+	if (arena->base != NULL)
+		munmap(arena->base, arena->len);
+	free(arena);
+}
+
+static void
+arena_init(void)
+{
+
+	arena_ok = (pthread_key_create(&arena_key, arena_destroy) == 0);
+}
+
+/**
+ * arena_get(create):
+ * Return the calling thread's arena, creating it if ${create} is non-zero.
+ * Return NULL if there is none.
+ */
+static struct vmem_arena *
+arena_get(int create)
+{
+	struct vmem_arena * arena;
+
+	if (pthread_once(&arena_once, arena_init) || !arena_ok)
+		return (NULL);
+	if (((arena = pthread_getspecific(arena_key)) != NULL) || !create)
+		return (arena);
+	if ((arena = calloc(1, sizeof(struct vmem_arena))) == NULL)
+		return (NULL);
+	if (pthread_setspecific(arena_key, arena)) {
+		free(arena);
+		return (NULL);
+	}
+	return (arena);
+}
+#endif
+
+/**
+ * crypto_scrypt_vmem_alloc(vmem, len, flags):
+ * Allocate ${len} bytes aligned to a multiple of 64 bytes for use as the V
+ * array of scrypt, as selected by ${flags}, and describe the allocation in
+ * ${vmem}.  With CRYPTO_SCRYPT_V_ARENA the memory of the calling thread's
+ * arena is reused when it is large enough.  Huge pages and pre-faulting are
+ * requests; if the system can't honour them, ordinary pages are used.
+ * Return a pointer to the memory, or NULL on error.
+ */
+void *
+crypto_scrypt_vmem_alloc(struct crypto_scrypt_vmem * vmem, size_t len,
+    int flags)
+{
+	void * buf;
+#ifdef HAVE_ARENA
+	struct vmem_arena * arena;
+
+	if ((flags & CRYPTO_SCRYPT_V_ARENA) &&
+	    ((arena = arena_get(1)) != NULL) && !arena->busy) {
+		/* Grow the arena if this call needs more than the last. */
+		if (arena->len < len) {
+			if (arena->base != NULL)
+				munmap(arena->base, arena->len);
+			arena->base = NULL;
+			arena->len = 0;
+			if ((arena->base = vmem_map(len, flags, &arena->len)) ==
+			    NULL)
+				return (NULL);
+		}
+		arena->busy = 1;
+		vmem->base = arena->base;
+		vmem->len = arena->len;
+		vmem->kind = VMEM_ARENA;
+		return (arena->base);
+	}
+#endif
+
+#if defined(MAP_ANON) && defined(HAVE_MMAP)
+	if ((buf = vmem_map(len, flags, &vmem->len)) == NULL)
+		return (NULL);
+	vmem->base = buf;
+	vmem->kind = VMEM_MMAP;
+	return (buf);
+#else
+	(void)flags;
+	if ((buf = malloc(len + 63)) == NULL)
+		return (NULL);
+	vmem->base = buf;
+	vmem->len = len;
+	vmem->kind = VMEM_MALLOC;
+	return ((void *)(((uintptr_t)(buf) + 63) & ~ (uintptr_t)(63)));
+#endif
+}
+
+/**
+ * crypto_scrypt_vmem_free(vmem, used):
+ * Release the V array described by ${vmem}, of which the first ${used} bytes
+ * have been written to.  Arena memory is zeroed and kept for the next call.
+ * Return 0 on success; or -1 on error.
+ */
+int
+crypto_scrypt_vmem_free(struct crypto_scrypt_vmem * vmem, size_t used)
+{
+
+	switch (vmem->kind) {
+#ifdef HAVE_ARENA
+	case VMEM_ARENA:
+		insecure_memzero(vmem->base, used);
+		arena_get(0)->busy = 0;
+		return (0);
+#endif
+#if defined(MAP_ANON) && defined(HAVE_MMAP)
+	case VMEM_MMAP:
+		return (munmap(vmem->base, vmem->len) ? -1 : 0);
+#endif
+	default:
+		(void)used;
+		free(vmem->base);
+		return (0);
+	}
+}
+
+/**
+ * crypto_scrypt_release_arena(void):
+ * Return the calling thread's V arena, if any, to the operating system.
+ */
+void
+crypto_scrypt_release_arena(void)
+{
+#ifdef HAVE_ARENA
+	struct vmem_arena * arena;
+
+	if (((arena = arena_get(0)) == NULL) || arena->busy ||
+	    (arena->base == NULL))
+		return;
+	munmap(arena->base, arena->len);
+	arena->base = NULL;
+	arena->len = 0;
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef _CRYPTO_SCRYPT_VMEM_H_
+#define _CRYPTO_SCRYPT_VMEM_H_
+
+#include <stddef.h>
+
+/* Flags selecting how the V array is allocated. */
+#define CRYPTO_SCRYPT_V_HUGEPAGES	0x1	/* Back V with 2 MiB pages. */
+#define CRYPTO_SCRYPT_V_PREFAULT	0x2	/* Fault V in at allocation. */
+#define CRYPTO_SCRYPT_V_ARENA		0x4	/* Keep V per thread. */
+
+/* An allocated V array, as returned by crypto_scrypt_vmem_alloc. */
+struct crypto_scrypt_vmem {
+	void * base;	/* Start of the allocation. */
+	size_t len;	/* Size of the allocation. */
+	int kind;	/* How to release it. */
+};
+
+/**
+ * crypto_scrypt_vmem_alloc(vmem, len, flags):
+ * Allocate ${len} bytes aligned to a multiple of 64 bytes for use as the V
+ * array of scrypt, as selected by ${flags}, and describe the allocation in
+ * ${vmem}.  With CRYPTO_SCRYPT_V_ARENA the memory of the calling thread's
+ * arena is reused when it is large enough.  Huge pages and pre-faulting are
+ * requests; if the system can't honour them, ordinary pages are used.
+ * Return a pointer to the memory, or NULL on error.
+ */
+void * crypto_scrypt_vmem_alloc(struct crypto_scrypt_vmem *, size_t, int);
+
+/**
+ * crypto_scrypt_vmem_free(vmem, used):
+ * Release the V array described by ${vmem}, of which the first ${used} bytes
+ * have been written to.  Arena memory is zeroed and kept for the next call.
+ * Return 0 on success; or -1 on error.
+ */
+int crypto_scrypt_vmem_free(struct crypto_scrypt_vmem *, size_t);
+
+/**
+ * crypto_scrypt_release_arena(void):
+ * Return the calling thread's V arena, if any, to the operating system.
+ */
+void crypto_scrypt_release_arena(void);
+
+#endif /* !_CRYPTO_SCRYPT_VMEM_H_ */
@@ -46,11 +46,10 @@
 #include <errno.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <unistd.h>
-
-#ifdef DEBUG
 #include <stdio.h>
-#endif
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "memlimit.h"
 
@@ -191,6 +190,159 @@ memlimit_rlimit(size_t * memlimit)
 	return (0);
 }
 
+#ifdef __linux__
+#define HAVE_CGROUP 1
+
+/* Where the cgroup hierarchies are mounted, and where ours are listed. */
+#ifndef CGROUP_MOUNT
+#define CGROUP_MOUNT "/sys/fs/cgroup"
+#endif
+#ifndef CGROUP_SELF
+#define CGROUP_SELF "/proc/self/cgroup"
+#endif
+
+/* Longest cgroup path we look at. */
+#define CGROUP_PATHLEN 4096
+
+/* Read a cgroup file holding a number of bytes, or "max" for no limit. */
+static int
+cgroup_read(const char * dir, const char * name, uint64_t * val)
+{
+	char path[CGROUP_PATHLEN + 64];
+	char buf[32];
+	char * end;
+	FILE * f;
+	int rc = 1;
+
+	if ((size_t)snprintf(path, sizeof(path), "%s/%s", dir, name) >=
+	    sizeof(path))
+		return (1);
+	if ((f = fopen(path, "r")) == NULL)
+		return (1);
+	if (fgets(buf, sizeof(buf), f) != NULL) {
+		if (strncmp(buf, "max", 3) == 0) {
+			*val = (uint64_t)(-1);
+			rc = 0;
+		} else {
+			errno = 0;
+			*val = strtoull(buf, &end, 10);
+			if ((end != buf) && (errno == 0))
+				rc = 0;
+		}
+	}
+	fclose(f);
+
+	return (rc);
+}
+
+/**
+ * cgroup_hierarchy(mount, path, maxname, usagename, avail):
+ * Lower ${avail} to the memory left under the limit ${maxname}, less the
+ * usage ${usagename}, of the cgroup ${path} in the hierarchy mounted at
+ * ${mount} and of each of its ancestors.  In a container the mount point is
+ * usually our own cgroup already, so paths which don't exist are skipped.
+ */
+static void
+cgroup_hierarchy(const char * mount, const char * path, const char * maxname,
+    const char * usagename, uint64_t * avail)
+{
+	char dir[CGROUP_PATHLEN];
+	size_t rootlen = strlen(mount);
+	uint64_t max, usage;
+	char * slash;
+
+	if ((size_t)snprintf(dir, sizeof(dir), "%s%s", mount, path) >=
+	    sizeof(dir))
+		return;
+
+	for (;;) {
+		if ((cgroup_read(dir, maxname, &max) == 0) &&
+		    (max != (uint64_t)(-1))) {
+			if (cgroup_read(dir, usagename, &usage))
+				usage = 0;
+			max = (usage < max) ? max - usage : 0;
+			if (max < *avail)
+				*avail = max;
+		}
+
+		/* Move to the parent, stopping at the mount point. */
+		if (((slash = strrchr(dir, '/')) == NULL) ||
+		    ((size_t)(slash - dir) < rootlen))
+			break;
+		*slash = '\0';
+	}
+}
+
+/* Is ${name} in the comma-separated list ${list}? */
+static int
+cgroup_has_controller(const char * list, const char * name)
+{
+	size_t len = strlen(name);
+	const char * p;
+
+	for (p = list; p != NULL; p = strchr(p, ',')) {
+		if (*p == ',')
+			p++;
+		if ((strncmp(p, name, len) == 0) &&
+		    ((p[len] == ',') || (p[len] == '\0')))
+			return (1);
+	}
+	return (0);
+}
+
+static int
+memlimit_cgroup(size_t * memlimit)
+{
+	char line[CGROUP_PATHLEN];
+	char * controllers, * path;
+	uint64_t avail = (uint64_t)(-1);
+	FILE * f;
+
+	/* Not being in any cgroup means there's no limit from them. */
+	if ((f = fopen(CGROUP_SELF, "r")) == NULL)
+		goto done;
+
+	/* Each line is hierarchy-ID:controller-list:cgroup-path. */
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		if ((controllers = strchr(line, ':')) == NULL)
+			continue;
+		controllers++;
+		if ((path = strchr(controllers, ':')) == NULL)
+			continue;
+		*path++ = '\0';
+
+		if (controllers[0] == '\0') {
+			/* cgroup v2, on its own or next to v1 ("hybrid"). */
+			cgroup_hierarchy(CGROUP_MOUNT, path, "memory.max",
+			    "memory.current", &avail);
+			cgroup_hierarchy(CGROUP_MOUNT "/unified", path,
+			    "memory.max", "memory.current", &avail);
+		} else if (cgroup_has_controller(controllers, "memory")) {
+			/* cgroup v1 memory controller. */
+			cgroup_hierarchy(CGROUP_MOUNT "/memory", path,
+			    "memory.limit_in_bytes", "memory.usage_in_bytes",
+			    &avail);
+		}
+	}
+	fclose(f);
+
+done:
+	/* Return the value, but clamp to SIZE_MAX if necessary. */
+#if UINT64_MAX > SIZE_MAX
+	if (avail > SIZE_MAX)
+		*memlimit = SIZE_MAX;
+	else
+		*memlimit = avail;
+#else
+	*memlimit = avail;
+#endif
+
+	/* Success! */
+	return (0);
+}
+#endif /* __linux__ */
+
 #ifdef _SC_PHYS_PAGES
 
 /* Some systems define _SC_PAGESIZE instead of _SC_PAGE_SIZE. */
@@ -241,7 +393,7 @@ int
 memtouse(size_t maxmem, double maxmemfrac, size_t * memlimit)
 {
 	size_t sysctl_memlimit, sysinfo_memlimit, rlimit_memlimit;
-	size_t sysconf_memlimit;
+	size_t sysconf_memlimit, cgroup_memlimit;
 	size_t memlimit_min;
 	size_t memavail;
 
@@ -266,11 +418,17 @@ memtouse(size_t maxmem, double maxmemfrac, size_t * memlimit)
 #else
 	sysconf_memlimit = (size_t)(-1);
 #endif
+#ifdef HAVE_CGROUP
+	if (memlimit_cgroup(&cgroup_memlimit))
+		return (1);
+#else
+	cgroup_memlimit = (size_t)(-1);
+#endif
 
 #ifdef DEBUG
-	fprintf(stderr, "Memory limits are %zu %zu %zu %zu\n",
+	fprintf(stderr, "Memory limits are %zu %zu %zu %zu %zu\n",
 	    sysctl_memlimit, sysinfo_memlimit, rlimit_memlimit,
-	    sysconf_memlimit);
+	    sysconf_memlimit, cgroup_memlimit);
 #endif
 
 	/* Find the smallest of them. */
@@ -283,6 +441,8 @@ memtouse(size_t maxmem, double maxmemfrac, size_t * memlimit)
 		memlimit_min = rlimit_memlimit;
 	if (memlimit_min > sysconf_memlimit)
 		memlimit_min = sysconf_memlimit;
+	if (memlimit_min > cgroup_memlimit)
+		memlimit_min = cgroup_memlimit;
 
 	/* Only use the specified fraction of the available memory. */
 	if ((maxmemfrac > 0.5) || (maxmemfrac == 0.0))
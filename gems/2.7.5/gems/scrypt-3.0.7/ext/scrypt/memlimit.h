@@ -35,7 +35,8 @@
  * memtouse(maxmem, maxmemfrac, memlimit):
  * Examine the system and return via memlimit the amount of RAM which should
  * be used -- the specified fraction of the available RAM, but no more than
- * maxmem, and no less than 1MiB.
+ * maxmem, and no less than 1MiB.  On Linux the RAM left under the memory
+ * limits of our cgroups (v1 or v2) counts as the available RAM if it is less.
  */
 int memtouse(size_t, double, size_t *);
 
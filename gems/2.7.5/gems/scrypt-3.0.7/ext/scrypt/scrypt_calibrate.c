@@ -7,24 +7,169 @@
  *
  */
 
+#if defined(_POSIX_C_SOURCE) && (_POSIX_C_SOURCE < 200809L)
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L	/* mkstemp and fchmod. */
+#endif
+
 #include "scrypt_platform.h"
 
+#include <sys/stat.h>
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "crypto_scrypt.h"
+#include "crypto_scrypt_rom.h"
 #include "memlimit.h"
 #include "scryptenc_cpuperf.h"
 #include "sysendian.h"
 
 #include "scrypt_calibrate.h"
 
+/* First field of a calibration cache entry; bump if the format changes. */
+#define CACHE_VERSION "scrypt-cpuperf 1"
+
+/* Write a description of the CPU into buf. */
+static void
+cpumodel(char * buf, size_t buflen)
+{
+#ifdef __linux__
+	FILE * f;
+	char line[256];
+#endif
+	char * s;
+
+	snprintf(buf, buflen, "unknown");
+
+#ifdef __linux__
+	if ((f = fopen("/proc/cpuinfo", "r")) != NULL) {
+		while (fgets(line, sizeof(line), f) != NULL) {
+			if (strncmp(line, "model name", 10) &&
+			    strncmp(line, "Processor", 9))
+				continue;
+			if ((s = strchr(line, ':')) == NULL)
+				continue;
+			for (s++; *s == ' '; s++)
+				continue;
+			s[strcspn(s, "\n")] = '\0';
+			snprintf(buf, buflen, "%s", s);
+			break;
+		}
+		fclose(f);
+	}
+#endif
+
+	/* Tabs separate the fields of a cache entry. */
+	for (s = buf; *s != '\0'; s++) {
+		if (*s == '\t')
+			*s = ' ';
+	}
+}
 
+/* Look up the salsa20/8 speed stored under ${key} in ${cachefile}. */
 static int
-pickparams(size_t maxmem, double maxmemfrac, double maxtime, int * logN, uint32_t * r, uint32_t * p)
+cache_read(const char * cachefile, const char * key, double * opps)
+{
+	FILE * f;
+	char line[512];
+	size_t keylen = strlen(key);
+	char * end;
+	int found = 0;
+
+	if ((f = fopen(cachefile, "r")) == NULL)
+		return (0);
+	if ((fgets(line, sizeof(line), f) != NULL) &&
+	    (strncmp(line, key, keylen) == 0) && (line[keylen] == '\t')) {
+		*opps = strtod(&line[keylen + 1], &end);
+		if ((end != &line[keylen + 1]) && (*end == '\n') &&
+		    (*opps > 0))
+			found = 1;
+	}
+	fclose(f);
+
+	return (found);
+}
+
+/*
+ * Replace the contents of ${cachefile}.  This is done by renaming a unique
+ * temporary file in the same directory into place, so that concurrent
+ * readers never see a partial entry and concurrent writers, in this process
+ * or others, never share a temporary file; failures are ignored as the cache
+ * is only an optimization.
+ */
+static void
+cache_write(const char * cachefile, const char * key, double opps)
+{
+	FILE * f;
+	char * tmp;
+	size_t tmplen = strlen(cachefile) + 8;
+	int fd;
+	int ok;
+
+	if ((tmp = malloc(tmplen)) == NULL)
+		return;
+	snprintf(tmp, tmplen, "%s.XXXXXX", cachefile);
+
+	if ((fd = mkstemp(tmp)) == -1)
+		goto done;
+	/* mkstemp makes it private, but the speed is no secret. */
+	fchmod(fd, 0644);
+	if ((f = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		unlink(tmp);
+		goto done;
+	}
+	ok = (fprintf(f, "%s\t%.17g\n", key, opps) > 0);
+	if (fclose(f))
+		ok = 0;
+	if (!ok || rename(tmp, cachefile))
+		unlink(tmp);
+
+done:
+	free(tmp);
+}
+
+/*
+ * Estimate the salsa20/8 speed as scryptenc_cpuperf does, but if
+ * ${cachefile} is not NULL, reuse the value stored there as long as it was
+ * measured on the same CPU model with the same smix code.
+ */
+static int
+cpuperf(const char * cachefile, double * opps)
+{
+	char model[192];
+	char key[256];
+	int rc;
+
+	if (cachefile == NULL)
+		return (scryptenc_cpuperf(opps));
+
+	cpumodel(model, sizeof(model));
+	snprintf(key, sizeof(key), "%s\t%s\t%s", CACHE_VERSION,
+	    crypto_scrypt_backend(), model);
+	if (cache_read(cachefile, key, opps)) {
+#ifdef DEBUG
+		fprintf(stderr, "Using %f salsa20/8 cores per second from %s\n",
+				*opps, cachefile);
+#endif
+		return (0);
+	}
+
+	if ((rc = scryptenc_cpuperf(opps)) != 0)
+		return (rc);
+	cache_write(cachefile, key, *opps);
+
+	return (0);
+}
+
+static int
+pickparams(size_t maxmem, double maxmemfrac, double maxtime, const char * cachefile, const struct crypto_scrypt_rom * rom, int * logN, uint32_t * r, uint32_t * p)
 {
 	size_t memlimit;
 	double opps;
@@ -37,7 +182,11 @@ pickparams(size_t maxmem, double maxmemfrac, double maxtime, int * logN, uint32_
 		return (1);
 
 	/* Figure out how fast the CPU is. */
-	if ((rc = scryptenc_cpuperf(&opps)) != 0)
+	if (rom != NULL)
+		rc = scryptenc_cpuperf_rom(rom, &opps);
+	else
+		rc = cpuperf(cachefile, &opps);
+	if (rc != 0)
 		return (rc);
 	opslimit = opps * maxtime;
 
@@ -45,8 +194,8 @@ pickparams(size_t maxmem, double maxmemfrac, double maxtime, int * logN, uint32_
 	if (opslimit < 32768)
 		opslimit = 32768;
 
-	/* Fix r = 8 for now. */
-	*r = 8;
+	/* Fix r = 8 for now, unless the ROM was made for another r. */
+	*r = (rom != NULL) ? crypto_scrypt_rom_r(rom) : 8;
 
 	/*
 	 * The memory limit requires that 128Nr <= memlimit, while the CPU
@@ -91,12 +240,30 @@ pickparams(size_t maxmem, double maxmemfrac, double maxtime, int * logN, uint32_
 
 int
 calibrate(size_t maxmem, double maxmemfrac, double maxtime, uint64_t * n, uint32_t * r, uint32_t * p)
+{
+	return calibrate_cached(maxmem, maxmemfrac, maxtime, NULL, n, r, p);
+}
+
+int
+calibrate_cached(size_t maxmem, double maxmemfrac, double maxtime, const char * cachefile, uint64_t * n, uint32_t * r, uint32_t * p)
 {
 	int logN = 0;
-	int result = pickparams( maxmem, maxmemfrac, maxtime, & logN, r, p );
+	int result = pickparams( maxmem, maxmemfrac, maxtime, cachefile, NULL, & logN, r, p );
 	if (result == 0)
 	{
 		*n = (uint64_t)(1) << logN;
 	}
 	return result;
-}
\ No newline at end of file
+}
+
+int
+calibrate_rom(const struct crypto_scrypt_rom * rom, size_t maxmem, double maxmemfrac, double maxtime, uint64_t * n, uint32_t * r, uint32_t * p)
+{
+	int logN = 0;
+	int result = pickparams( maxmem, maxmemfrac, maxtime, NULL, rom, & logN, r, p );
+	if (result == 0)
+	{
+		*n = (uint64_t)(1) << logN;
+	}
+	return result;
+}
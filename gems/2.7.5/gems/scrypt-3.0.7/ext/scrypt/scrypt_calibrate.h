@@ -14,6 +14,20 @@
 
 int calibrate( size_t maxmem, double maxmemfrac, double maxtime, uint64_t * n, uint32_t * r, uint32_t * p );
 
+/*
+ * As calibrate, but if cachefile is not NULL the measured CPU speed is kept
+ * there and reused until the CPU model or the smix code in use changes.
+ */
+int calibrate_cached( size_t maxmem, double maxmemfrac, double maxtime, const char * cachefile, uint64_t * n, uint32_t * r, uint32_t * p );
+
+struct crypto_scrypt_rom;
+
+/*
+ * As calibrate, but for crypto_scrypt_rom with the given ROM: the memory
+ * limit only covers the per-call V, and the speed is measured with the ROM.
+ */
+int calibrate_rom( const struct crypto_scrypt_rom * rom, size_t maxmem, double maxmemfrac, double maxtime, uint64_t * n, uint32_t * r, uint32_t * p );
+
 #endif
 
 
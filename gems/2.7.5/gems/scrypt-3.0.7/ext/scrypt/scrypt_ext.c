@@ -1,6 +1,8 @@
 #include "scrypt_ext.h"
 #include "scrypt_calibrate.h"
 #include "crypto_scrypt.h"
+#include "crypto_scrypt_rom.h"
+#include "memlimit.h"
 
 
 typedef struct {
@@ -10,7 +12,17 @@ typedef struct {
 } Calibration;
 
 
-RBFFI_EXPORT int sc_calibrate(size_t maxmem, double maxmemfrac, double maxtime, Calibration *result)
+RBFFI_EXPORT int sc_calibrate(size_t maxmem, double maxmemfrac, double maxtime, const char *cachefile, Calibration *result)
 {
-    return calibrate(maxmem, maxmemfrac, maxtime, &result->n, &result->r, &result->p);    // 0 == success
+    return calibrate_cached(maxmem, maxmemfrac, maxtime, cachefile, &result->n, &result->r, &result->p);    // 0 == success
+}
+
+RBFFI_EXPORT int sc_calibrate_rom(const struct crypto_scrypt_rom *rom, size_t maxmem, double maxmemfrac, double maxtime, Calibration *result)
+{
+    return calibrate_rom(rom, maxmem, maxmemfrac, maxtime, &result->n, &result->r, &result->p);    // 0 == success
+}
+
+RBFFI_EXPORT int sc_memlimit(size_t maxmem, double maxmemfrac, size_t *result)
+{
+    return memtouse(maxmem, maxmemfrac, result);    // 0 == success
 }
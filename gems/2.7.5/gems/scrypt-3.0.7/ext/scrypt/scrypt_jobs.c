@@ -0,0 +1,429 @@
+#if defined(_POSIX_C_SOURCE) && (_POSIX_C_SOURCE < 199506L)
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199506L	/* pthread_sigmask. */
+#endif
+
+#include "scrypt_platform.h"
+
+#include <sys/types.h>
+#if !defined(WINDOWS_OS)
+	#include <fcntl.h>
+	#include <pthread.h>
+	#include <signal.h>
+	#ifndef HAVE_PTHREAD
+		#define HAVE_PTHREAD 1
+	#endif
+#endif
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crypto_scrypt.h"
+#include "insecure_memzero.h"
+
+#include "scrypt_jobs.h"
+
+#ifdef HAVE_PTHREAD
+/* Defaults for scrypt_jobs_init. */
+#define JOBS_THREADS 2
+#define JOBS_CAPACITY 64
+
+/* Upper bound on the number of background threads. */
+#define JOBS_MAXTHREADS 64
+
+/* Job states. */
+#define JOB_QUEUED 0
+#define JOB_RUNNING 1
+#define JOB_DONE 2
+
+struct scrypt_job {
+	uint8_t * passwd;
+	size_t passwdlen;
+	uint8_t * salt;
+	size_t saltlen;
+	uint64_t N;
+	uint32_t r;
+	uint32_t p;
+	uint8_t * buf;
+	size_t buflen;
+	int flags;
+	int state;
+	int abandoned;
+	int rc;
+	int err;
+	int fds[2];
+};
+
+/* Bounded queue of submitted jobs, and the threads working on it. */
+static pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_cond = PTHREAD_COND_INITIALIZER;
+static struct scrypt_job ** jobs_queue = NULL;
+static size_t jobs_capacity = JOBS_CAPACITY;
+static size_t jobs_head = 0;
+static size_t jobs_len = 0;
+static size_t jobs_nthreads = JOBS_THREADS;
+static size_t jobs_started = 0;
+static int jobs_atfork = 0;
+
+static void
+job_destroy(struct scrypt_job * job)
+{
+
+	/* The password, salt, and output live right after the job. */
+	insecure_memzero(job->passwd, job->passwdlen + job->saltlen +
+	    job->buflen);
+	if (job->fds[0] != -1)
+		close(job->fds[0]);
+	close(job->fds[1]);
+	free(job);
+}
+
+/**
+ * jobs_worker(cookie):
+ * Thread entry point: run queued jobs until the process exits.
+ */
+static void *
+jobs_worker(void * cookie)
+{
+	struct scrypt_job * job;
+	int rc, err, abandoned;
+	ssize_t len;
+
+	(void)cookie;
+
+	for (;;) {
+		/* Wait for a job. */
+		pthread_mutex_lock(&jobs_mutex);
+		while (jobs_len == 0)
+			pthread_cond_wait(&jobs_cond, &jobs_mutex);
+		job = jobs_queue[jobs_head];
+		jobs_head = (jobs_head + 1) % jobs_capacity;
+		jobs_len--;
+		job->state = JOB_RUNNING;
+		pthread_mutex_unlock(&jobs_mutex);
+
+		/* Run it. */
+		if (job->flags)
+			rc = crypto_scrypt_parallel(job->passwd, job->passwdlen,
+			    job->salt, job->saltlen, job->N, job->r, job->p,
+			    job->buf, job->buflen, 1, 0, job->flags);
+		else
+			rc = crypto_scrypt(job->passwd, job->passwdlen,
+			    job->salt, job->saltlen, job->N, job->r, job->p,
+			    job->buf, job->buflen);
+		err = errno;
+
+		/*
+		 * Record the outcome and wake up the waiter.  This is done with
+		 * the lock held so that the job can't be freed under us; the
+		 * pipe is empty, so the write doesn't block.  If the caller has
+		 * already closed the read end the write fails with EPIPE, which
+		 * is harmless: SIGPIPE is blocked in this thread.
+		 */
+		pthread_mutex_lock(&jobs_mutex);
+		job->rc = rc;
+		job->err = err;
+		job->state = JOB_DONE;
+		if ((abandoned = job->abandoned) == 0) {
+			do {
+				len = write(job->fds[1], "", 1);
+			} while ((len == -1) && (errno == EINTR));
+		}
+		pthread_mutex_unlock(&jobs_mutex);
+
+		/* Nobody is waiting for it any more. */
+		if (abandoned)
+			job_destroy(job);
+	}
+
+	/* NOTREACHED */
+	return (NULL);
+}
+
+/**
+ * jobs_atfork_child(void):
+ * The threads don't exist in a forked child; start afresh there.  Jobs which
+ * were submitted before the fork never finish in the child.
+ */
+static void
+jobs_atfork_child(void)
+{
+
+	pthread_mutex_init(&jobs_mutex, NULL);
+	pthread_cond_init(&jobs_cond, NULL);
+	jobs_queue = NULL;
+	jobs_head = 0;
+	jobs_len = 0;
+	jobs_started = 0;
+}
+
+/* Start the threads if needed; called with jobs_mutex held. */
+static int
+jobs_start(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	sigset_t all, old;
+
+	if (jobs_started > 0)
+		return (0);
+
+	if (!jobs_atfork) {
+		if (pthread_atfork(NULL, NULL, jobs_atfork_child))
+			return (-1);
+		jobs_atfork = 1;
+	}
+	if ((jobs_queue == NULL) && ((jobs_queue =
+	    calloc(jobs_capacity, sizeof(struct scrypt_job *))) == NULL))
+		return (-1);
+
+	if ((errno = pthread_attr_init(&attr)) != 0)
+		return (-1);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	/* The threads inherit our signal mask; leave signals to the caller. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	while (jobs_started < jobs_nthreads) {
+		if ((errno = pthread_create(&thread, &attr, jobs_worker,
+		    NULL)) != 0)
+			break;
+		jobs_started++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+
+	/* We can make do with fewer threads, but not with none. */
+	return ((jobs_started > 0) ? 0 : -1);
+}
+
+/**
+ * scrypt_jobs_init(nthreads, capacity):
+ * Set the number of background threads and the number of jobs which may wait
+ * for one of them, and start the threads if they are not running yet.  The
+ * settings only have an effect when the threads are started.
+ *
+ * Return 0 on success; or -1 on error, including if no thread could be
+ * started.
+ */
+int
+scrypt_jobs_init(size_t nthreads, size_t capacity)
+{
+	int rc;
+
+	if ((nthreads < 1) || (nthreads > JOBS_MAXTHREADS) || (capacity < 1)) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	pthread_mutex_lock(&jobs_mutex);
+	if (jobs_started == 0) {
+		free(jobs_queue);
+		jobs_queue = NULL;
+		jobs_nthreads = nthreads;
+		jobs_capacity = capacity;
+	}
+	rc = jobs_start();
+	pthread_mutex_unlock(&jobs_mutex);
+
+	return (rc);
+}
+
+/**
+ * scrypt_job_submit(passwd, passwdlen, salt, saltlen, N, r, p, buflen,
+ *     flags):
+ * Queue the computation of crypto_scrypt(passwd, passwdlen, salt, saltlen,
+ * N, r, p, buf, buflen), with V allocated as selected by the CRYPTO_SCRYPT_V_*
+ * ${flags}, and return it without waiting.  The password and salt are copied.
+ * Return NULL on error; errno is EAGAIN if the queue is full.
+ */
+struct scrypt_job *
+scrypt_job_submit(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    size_t buflen, int flags)
+{
+	struct scrypt_job * job;
+	size_t i;
+
+	/* Allocate the job, with room for its inputs and output. */
+	if ((passwdlen > SIZE_MAX / 4) || (saltlen > SIZE_MAX / 4) ||
+	    (buflen > SIZE_MAX / 4)) {
+		errno = ENOMEM;
+		goto err0;
+	}
+	if ((job = malloc(sizeof(struct scrypt_job) + passwdlen + saltlen +
+	    buflen)) == NULL)
+		goto err0;
+	job->passwd = (uint8_t *)&job[1];
+	job->passwdlen = passwdlen;
+	job->salt = &job->passwd[passwdlen];
+	job->saltlen = saltlen;
+	job->buf = &job->salt[saltlen];
+	job->buflen = buflen;
+	memcpy(job->passwd, passwd, passwdlen);
+	memcpy(job->salt, salt, saltlen);
+	job->N = N;
+	job->r = r;
+	job->p = p;
+	job->flags = flags;
+	job->state = JOB_QUEUED;
+	job->abandoned = 0;
+	job->rc = -1;
+	job->err = 0;
+
+	/* Create the pipe used to announce that the job has finished. */
+	if (pipe(job->fds))
+		goto err1;
+	for (i = 0; i < 2; i++) {
+		if (fcntl(job->fds[i], F_SETFD, FD_CLOEXEC) == -1)
+			goto err2;
+	}
+
+	/* Queue it, unless the queue is full. */
+	pthread_mutex_lock(&jobs_mutex);
+	if (jobs_start())
+		goto err3;
+	if (jobs_len == jobs_capacity) {
+		errno = EAGAIN;
+		goto err3;
+	}
+	jobs_queue[(jobs_head + jobs_len) % jobs_capacity] = job;
+	jobs_len++;
+	pthread_cond_signal(&jobs_cond);
+	pthread_mutex_unlock(&jobs_mutex);
+
+	/* Success! */
+	return (job);
+
+err3:
+	pthread_mutex_unlock(&jobs_mutex);
+err2:
+	i = errno;
+	close(job->fds[0]);
+	close(job->fds[1]);
+	errno = i;
+err1:
+	insecure_memzero(job->passwd, passwdlen + saltlen);
+	free(job);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * scrypt_job_fd(job):
+ * Return a descriptor which becomes readable once ${job} has finished.  The
+ * descriptor is handed over to the caller, who must close it; scrypt_job_free
+ * does not.  Only the first call returns it; later calls return -1.
+ */
+int
+scrypt_job_fd(struct scrypt_job * job)
+{
+	int fd;
+
+	fd = job->fds[0];
+	job->fds[0] = -1;
+	return (fd);
+}
+
+/**
+ * scrypt_job_result(job, buf, buflen):
+ * If ${job} has finished, copy its buflen bytes of output to ${buf} and
+ * return 0, or return -1 with errno set as by crypto_scrypt if it failed.
+ * If it has not finished yet, return -1 with errno set to EAGAIN.
+ */
+int
+scrypt_job_result(struct scrypt_job * job, uint8_t * buf, size_t buflen)
+{
+	int state;
+
+	pthread_mutex_lock(&jobs_mutex);
+	state = job->state;
+	pthread_mutex_unlock(&jobs_mutex);
+
+	if (state != JOB_DONE) {
+		errno = EAGAIN;
+		return (-1);
+	}
+	if (job->rc) {
+		errno = job->err;
+		return (-1);
+	}
+	if (buflen > job->buflen) {
+		errno = EINVAL;
+		return (-1);
+	}
+	memcpy(buf, job->buf, buflen);
+	return (0);
+}
+
+/**
+ * scrypt_job_free(job):
+ * Release ${job}, zeroing its copy of the password, salt, and output.  A job
+ * which has not finished is freed by its thread once it has.
+ */
+void
+scrypt_job_free(struct scrypt_job * job)
+{
+	int state;
+
+	if (job == NULL)
+		return;
+
+	pthread_mutex_lock(&jobs_mutex);
+	if ((state = job->state) != JOB_DONE)
+		job->abandoned = 1;
+	pthread_mutex_unlock(&jobs_mutex);
+
+	if (state == JOB_DONE)
+		job_destroy(job);
+}
+#else
+/* Without threads, submitting fails and there are no jobs to act on. */
+int
+scrypt_jobs_init(size_t nthreads, size_t capacity)
+{
+
+	(void)nthreads;
+	(void)capacity;
+	return (0);
+}
+
+struct scrypt_job *
+scrypt_job_submit(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    size_t buflen, int flags)
+{
+
+	(void)passwd; (void)passwdlen; (void)salt; (void)saltlen;
+	(void)N; (void)r; (void)p; (void)buflen; (void)flags;
+	errno = ENOSYS;
+	return (NULL);
+}
+
+int
+scrypt_job_fd(struct scrypt_job * job)
+{
+
+	(void)job;
+	return (-1);
+}
+
+int
+scrypt_job_result(struct scrypt_job * job, uint8_t * buf, size_t buflen)
+{
+
+	(void)job; (void)buf; (void)buflen;
+	errno = ENOSYS;
+	return (-1);
+}
+
+void
+scrypt_job_free(struct scrypt_job * job)
+{
+
+	(void)job;
+}
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,55 @@
+#ifndef _SCRYPT_JOBS_H_
+#define _SCRYPT_JOBS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Opaque scrypt computation running on the background threads. */
+struct scrypt_job;
+
+/**
+ * scrypt_jobs_init(nthreads, capacity):
+ * Set the number of background threads and the number of jobs which may wait
+ * for one of them, and start the threads if they are not running yet.  The
+ * settings only have an effect when the threads are started.
+ *
+ * Return 0 on success; or -1 on error, including if no thread could be
+ * started.
+ */
+int scrypt_jobs_init(size_t, size_t);
+
+/**
+ * scrypt_job_submit(passwd, passwdlen, salt, saltlen, N, r, p, buflen,
+ *     flags):
+ * Queue the computation of crypto_scrypt(passwd, passwdlen, salt, saltlen,
+ * N, r, p, buf, buflen), with V allocated as selected by the CRYPTO_SCRYPT_V_*
+ * ${flags}, and return it without waiting.  The password and salt are copied.
+ * Return NULL on error; errno is EAGAIN if the queue is full.
+ */
+struct scrypt_job * scrypt_job_submit(const uint8_t *, size_t,
+    const uint8_t *, size_t, uint64_t, uint32_t, uint32_t, size_t, int);
+
+/**
+ * scrypt_job_fd(job):
+ * Return a descriptor which becomes readable once ${job} has finished.  The
+ * descriptor is handed over to the caller, who must close it; scrypt_job_free
+ * does not.  Only the first call returns it; later calls return -1.
+ */
+int scrypt_job_fd(struct scrypt_job *);
+
+/**
+ * scrypt_job_result(job, buf, buflen):
+ * If ${job} has finished, copy its buflen bytes of output to ${buf} and
+ * return 0, or return -1 with errno set as by crypto_scrypt if it failed.
+ * If it has not finished yet, return -1 with errno set to EAGAIN.
+ */
+int scrypt_job_result(struct scrypt_job *, uint8_t *, size_t);
+
+/**
+ * scrypt_job_free(job):
+ * Release ${job}, zeroing its copy of the password, salt, and output.  A job
+ * which has not finished is freed by its thread once it has.
+ */
+void scrypt_job_free(struct scrypt_job *);
+
+#endif /* !_SCRYPT_JOBS_H_ */
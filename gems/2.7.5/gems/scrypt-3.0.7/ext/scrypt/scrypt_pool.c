@@ -0,0 +1,213 @@
+#if defined(_POSIX_C_SOURCE) && (_POSIX_C_SOURCE < 199506L)
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199506L	/* pthread_sigmask. */
+#endif
+
+#include "scrypt_platform.h"
+
+#include <sys/types.h>
+#if !defined(WINDOWS_OS)
+	#include <pthread.h>
+	#include <signal.h>
+	#ifndef HAVE_PTHREAD
+		#define HAVE_PTHREAD 1
+	#endif
+#endif
+#include <stddef.h>
+#include <unistd.h>
+
+#include "scrypt_pool.h"
+
+#ifdef HAVE_PTHREAD
+/* Upper bound on the number of threads in the pool. */
+#define POOL_MAXTHREADS 64
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static struct scrypt_pool_task * pool_tasks = NULL;
+static size_t pool_pending = 0;
+static size_t pool_nthreads = 0;
+static size_t pool_free = 0;
+static size_t pool_maxthreads = 0;
+static int pool_atfork = 0;
+
+/* Remove ${task} from the list of tasks waiting for helpers. */
+static void
+pool_unlink(struct scrypt_pool_task * task)
+{
+	struct scrypt_pool_task ** tp;
+
+	for (tp = &pool_tasks; *tp != NULL; tp = &(*tp)->next) {
+		if (*tp == task) {
+			*tp = task->next;
+			break;
+		}
+	}
+}
+
+/**
+ * pool_worker(cookie):
+ * Thread entry point: help with tasks until the process exits.
+ */
+static void *
+pool_worker(void * cookie)
+{
+	struct scrypt_pool_task * task;
+
+	(void)cookie;
+
+	pthread_mutex_lock(&pool_mutex);
+	for (;;) {
+		/* Wait for a task which still wants help. */
+		while ((task = pool_tasks) == NULL)
+			pthread_cond_wait(&pool_work, &pool_mutex);
+		if (--task->pending == 0)
+			pool_tasks = task->next;
+		pool_pending--;
+		task->running++;
+		pool_free--;
+		pthread_mutex_unlock(&pool_mutex);
+
+		task->func(task->cookie);
+
+		pthread_mutex_lock(&pool_mutex);
+		pool_free++;
+		if (--task->running == 0)
+			pthread_cond_broadcast(&pool_done);
+	}
+
+	/* NOTREACHED */
+	return (NULL);
+}
+
+/**
+ * pool_atfork_child(void):
+ * The threads don't exist in a forked child; start afresh there.
+ */
+static void
+pool_atfork_child(void)
+{
+
+	pthread_mutex_init(&pool_mutex, NULL);
+	pthread_cond_init(&pool_work, NULL);
+	pthread_cond_init(&pool_done, NULL);
+	pool_tasks = NULL;
+	pool_pending = 0;
+	pool_nthreads = 0;
+	pool_free = 0;
+}
+
+/* Start threads until each pending request has one; called with the lock. */
+static void
+pool_grow(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	sigset_t all, old;
+	long ncpus;
+
+	if (pool_maxthreads == 0) {
+		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		pool_maxthreads = (ncpus > 0) ? (size_t)ncpus : 1;
+		if (pool_maxthreads > POOL_MAXTHREADS)
+			pool_maxthreads = POOL_MAXTHREADS;
+	}
+	if ((pool_free >= pool_pending) || (pool_nthreads >= pool_maxthreads))
+		return;
+
+	if (!pool_atfork) {
+		if (pthread_atfork(NULL, NULL, pool_atfork_child))
+			return;
+		pool_atfork = 1;
+	}
+	if (pthread_attr_init(&attr))
+		return;
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	/* The threads inherit our signal mask; leave signals to the caller. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	while ((pool_free < pool_pending) && (pool_nthreads < pool_maxthreads)) {
+		if (pthread_create(&thread, &attr, pool_worker, NULL))
+			break;
+		pool_nthreads++;
+		pool_free++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+}
+
+/**
+ * scrypt_pool_start(task, func, cookie, nhelpers):
+ * Ask for up to ${nhelpers} of the pool's threads to call ${func}(${cookie})
+ * as they become free, and return without waiting.  The calling thread is
+ * expected to work alongside them, so ${func} has to claim its work from
+ * ${cookie} until none is left rather than assume any helper runs at all.
+ */
+void
+scrypt_pool_start(struct scrypt_pool_task * task, void (*func)(void *),
+    void * cookie, size_t nhelpers)
+{
+	struct scrypt_pool_task ** tp;
+
+	task->func = func;
+	task->cookie = cookie;
+	task->pending = nhelpers;
+	task->running = 0;
+	task->next = NULL;
+	if (nhelpers == 0)
+		return;
+
+	/* Queue it behind the tasks of other callers. */
+	pthread_mutex_lock(&pool_mutex);
+	for (tp = &pool_tasks; *tp != NULL; tp = &(*tp)->next)
+		continue;
+	*tp = task;
+	pool_pending += nhelpers;
+	pool_grow();
+	pthread_cond_broadcast(&pool_work);
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+/**
+ * scrypt_pool_finish(task):
+ * Withdraw the requests of ${task} which no thread has taken up yet, and
+ * wait for the calls to ${func} which have started to return.
+ */
+void
+scrypt_pool_finish(struct scrypt_pool_task * task)
+{
+
+	pthread_mutex_lock(&pool_mutex);
+	if (task->pending > 0) {
+		pool_unlink(task);
+		pool_pending -= task->pending;
+		task->pending = 0;
+	}
+	while (task->running > 0)
+		pthread_cond_wait(&pool_done, &pool_mutex);
+	pthread_mutex_unlock(&pool_mutex);
+}
+#else
+/* Without threads there is never any help; the caller does all the work. */
+void
+scrypt_pool_start(struct scrypt_pool_task * task, void (*func)(void *),
+    void * cookie, size_t nhelpers)
+{
+
+	(void)nhelpers;
+	task->func = func;
+	task->cookie = cookie;
+	task->pending = 0;
+	task->running = 0;
+	task->next = NULL;
+}
+
+void
+scrypt_pool_finish(struct scrypt_pool_task * task)
+{
+
+	(void)task;
+}
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,39 @@
+#ifndef _SCRYPT_POOL_H_
+#define _SCRYPT_POOL_H_
+
+#include <stddef.h>
+
+/*
+ * Threads helping with the work of one call, e.g. the p lanes of a
+ * derivation or a batch of passwords to verify.  The threads belong to a
+ * pool shared by all callers, which has at most one thread per online CPU;
+ * they are started when first needed and live until the process exits.
+ */
+
+/* A request for help; the caller provides it, the contents are private. */
+struct scrypt_pool_task {
+	void (*func)(void *);
+	void * cookie;
+	size_t pending;		/* Helpers asked for which haven't started. */
+	size_t running;		/* Helpers inside func. */
+	struct scrypt_pool_task * next;
+};
+
+/**
+ * scrypt_pool_start(task, func, cookie, nhelpers):
+ * Ask for up to ${nhelpers} of the pool's threads to call ${func}(${cookie})
+ * as they become free, and return without waiting.  The calling thread is
+ * expected to work alongside them, so ${func} has to claim its work from
+ * ${cookie} until none is left rather than assume any helper runs at all.
+ */
+void scrypt_pool_start(struct scrypt_pool_task *, void (*)(void *), void *,
+    size_t);
+
+/**
+ * scrypt_pool_finish(task):
+ * Withdraw the requests of ${task} which no thread has taken up yet, and
+ * wait for the calls to ${func} which have started to return.
+ */
+void scrypt_pool_finish(struct scrypt_pool_task *);
+
+#endif /* !_SCRYPT_POOL_H_ */
@@ -0,0 +1,194 @@
+#include "scrypt_platform.h"
+
+#include <sys/types.h>
+#if !defined(WINDOWS_OS)
+	#include <pthread.h>
+	#ifndef HAVE_PTHREAD
+		#define HAVE_PTHREAD 1
+	#endif
+#endif
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crypto_scrypt.h"
+#include "insecure_memzero.h"
+#include "memlimit.h"
+#include "scrypt_pool.h"
+
+#include "scrypt_verify.h"
+
+/* Compare two buffers without branching on their contents. */
+static int
+verify_equal(const uint8_t * a, const uint8_t * b, size_t len)
+{
+	uint8_t diff = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		diff |= a[i] ^ b[i];
+
+	return (diff == 0);
+}
+
+/* Add without overflowing; SIZE_MAX stands for "too much". */
+static size_t
+verify_add(size_t a, size_t b)
+{
+
+	return ((a > SIZE_MAX - b) ? SIZE_MAX : a + b);
+}
+
+/* Memory crypto_scrypt allocates for ${item}. */
+static size_t
+verify_need(const struct scrypt_verify * item)
+{
+	size_t r = item->r, p = item->p;
+
+	/* Parameters which crypto_scrypt rejects without allocating. */
+	if ((r == 0) || (p == 0) || (r > SIZE_MAX / 128 / p) ||
+	    (r > (SIZE_MAX - 64) / 256) || (item->N > SIZE_MAX / 128 / r))
+		return (0);
+
+	return (verify_add(verify_add(128 * r * p, 256 * r + 64),
+	    128 * r * (size_t)item->N));
+}
+
+/* Compute ${item} and record the outcome. */
+static void
+verify_one(struct scrypt_verify * item)
+{
+	uint8_t * buf;
+
+	if ((buf = malloc(item->hashlen ? item->hashlen : 1)) == NULL) {
+		item->result = -1;
+		return;
+	}
+	if (crypto_scrypt(item->passwd, item->passwdlen, item->salt,
+	    item->saltlen, item->N, item->r, item->p, buf, item->hashlen))
+		item->result = -1;
+	else
+		item->result = verify_equal(buf, item->hash, item->hashlen);
+	insecure_memzero(buf, item->hashlen);
+	free(buf);
+}
+
+#ifdef HAVE_PTHREAD
+/* Memory used by the items being computed by all callers. */
+static pthread_mutex_t verify_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t verify_cond = PTHREAD_COND_INITIALIZER;
+static size_t verify_inuse = 0;
+static size_t verify_running = 0;
+
+struct verify_batch {
+	struct scrypt_verify * items;
+	size_t nitems;
+	size_t next;
+	size_t budget;
+};
+
+/**
+ * verify_worker(cookie):
+ * Claim items of the batch ${cookie} one at a time, waiting while the memory
+ * budget is exhausted, until none are left.
+ */
+static void
+verify_worker(void * cookie)
+{
+	struct verify_batch * batch = cookie;
+	struct scrypt_verify * item;
+	size_t need;
+
+	for (;;) {
+		pthread_mutex_lock(&verify_mutex);
+		if (batch->next == batch->nitems) {
+			pthread_mutex_unlock(&verify_mutex);
+			break;
+		}
+		item = &batch->items[batch->next++];
+		need = verify_need(item);
+
+		/* Wait until it fits, or until nothing else is running. */
+		while ((verify_running > 0) &&
+		    ((need > batch->budget) ||
+		    (verify_inuse > batch->budget - need)))
+			pthread_cond_wait(&verify_cond, &verify_mutex);
+		verify_inuse += need;
+		verify_running++;
+		pthread_mutex_unlock(&verify_mutex);
+
+		verify_one(item);
+
+		pthread_mutex_lock(&verify_mutex);
+		verify_inuse -= need;
+		verify_running--;
+		pthread_cond_broadcast(&verify_cond);
+		pthread_mutex_unlock(&verify_mutex);
+	}
+}
+
+/**
+ * scrypt_verify_many(items, nitems, maxthreads, maxmem, maxmemfrac):
+ * For each of the ${nitems} ${items}, compute crypto_scrypt(passwd,
+ * passwdlen, salt, saltlen, N, r, p, buf, hashlen) and compare buf with hash
+ * in constant time, storing the outcome in result.  Up to ${maxthreads}
+ * items are computed at once (0 means one per online CPU), as long as the
+ * memory they need together stays within memtouse(${maxmem}, ${maxmemfrac});
+ * this budget is shared by all concurrent calls.  An item which needs more
+ * than the whole budget is computed on its own.  The calling thread is
+ * helped by threads of the scrypt_pool, so other calls may get fewer.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int
+scrypt_verify_many(struct scrypt_verify * items, size_t nitems,
+    uint32_t maxthreads, size_t maxmem, double maxmemfrac)
+{
+	struct verify_batch batch;
+	struct scrypt_pool_task task;
+	size_t nthreads;
+
+	/* Figure out how much memory we may use. */
+	if (memtouse(maxmem, maxmemfrac, &batch.budget))
+		return (-1);
+	batch.items = items;
+	batch.nitems = nitems;
+	batch.next = 0;
+
+	/*
+	 * Ask the pool for a helper per item beyond our own, up to the limit
+	 * we were given; the pool never has more than one thread per CPU, so
+	 * 0 ("one per CPU") asks for as many as there are items.
+	 */
+	nthreads = (maxthreads == 0) ? nitems : maxthreads;
+	if (nthreads > nitems)
+		nthreads = nitems;
+
+	/* Whatever help doesn't come, we do ourselves. */
+	scrypt_pool_start(&task, verify_worker, &batch,
+	    (nthreads > 0) ? nthreads - 1 : 0);
+	verify_worker(&batch);
+	scrypt_pool_finish(&task);
+
+	/* Success! */
+	return (0);
+}
+#else
+/* Without threads, the items are computed one after another. */
+int
+scrypt_verify_many(struct scrypt_verify * items, size_t nitems,
+    uint32_t maxthreads, size_t maxmem, double maxmemfrac)
+{
+	size_t i;
+
+	(void)maxthreads;
+	(void)maxmem;
+	(void)maxmemfrac;
+
+	for (i = 0; i < nitems; i++)
+		verify_one(&items[i]);
+
+	return (0);
+}
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,37 @@
+#ifndef _SCRYPT_VERIFY_H_
+#define _SCRYPT_VERIFY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* One password to check against an scrypt hash. */
+struct scrypt_verify {
+	const uint8_t * passwd;
+	size_t passwdlen;
+	const uint8_t * salt;
+	size_t saltlen;
+	uint64_t N;
+	uint32_t r;
+	uint32_t p;
+	const uint8_t * hash;
+	size_t hashlen;
+	int result;	/* 1 if it matches, 0 if not, -1 on error. */
+};
+
+/**
+ * scrypt_verify_many(items, nitems, maxthreads, maxmem, maxmemfrac):
+ * For each of the ${nitems} ${items}, compute crypto_scrypt(passwd,
+ * passwdlen, salt, saltlen, N, r, p, buf, hashlen) and compare buf with hash
+ * in constant time, storing the outcome in result.  Up to ${maxthreads}
+ * items are computed at once (0 means one per online CPU), as long as the
+ * memory they need together stays within memtouse(${maxmem}, ${maxmemfrac});
+ * this budget is shared by all concurrent calls.  An item which needs more
+ * than the whole budget is computed on its own.  The calling thread is
+ * helped by threads of the scrypt_pool, so other calls may get fewer.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int scrypt_verify_many(struct scrypt_verify *, size_t, uint32_t, size_t,
+    double);
+
+#endif /* !_SCRYPT_VERIFY_H_ */
@@ -35,6 +35,7 @@
 #include <time.h>
 
 #include "crypto_scrypt.h"
+#include "crypto_scrypt_rom.h"
 
 #include "scryptenc_cpuperf.h"
 
@@ -128,32 +129,36 @@ getclockdiff(struct timespec * st, double * diffd)
 	return (0);
 }
 
-/**
- * scryptenc_cpuperf(opps):
- * Estimate the number of salsa20/8 cores which can be executed per second,
- * and return the value via opps.
+/*
+ * Each sample runs for at least CPUPERF_MINTIME seconds (or one clock tick,
+ * if that is longer), and the median of CPUPERF_SAMPLES samples is used so
+ * that a few samples slowed down by other processes do not skew the result.
  */
-int
-scryptenc_cpuperf(double * opps)
-{
-	struct timespec st;
-	double resd, diffd;
-	uint64_t i = 0;
+#define CPUPERF_SAMPLES 5
+#define CPUPERF_MINTIME 0.001
 
-	/* Get the clock resolution. */
-	if (getclockres(&resd))
-		return (2);
+/*
+ * Something to time: a function which does a small computation and returns
+ * via ${ncores} how many salsa20/8 cores that took, or returns nonzero if it
+ * failed.  With ${tiny} set it should do as little work as it can.
+ */
+typedef int (*cpuperf_func)(void *, int, uint64_t *);
 
-#ifdef DEBUG
-	fprintf(stderr, "Clock resolution is %f\n", resd);
-#endif
+/* Time ${func} for at least ${mintime} seconds. */
+static int
+cpuperf_sample(cpuperf_func func, void * cookie, double mintime,
+    double * opps)
+{
+	struct timespec st;
+	double diffd;
+	uint64_t i = 0, ncores;
 
 	/* Loop until the clock ticks. */
 	if (getclocktime(&st))
 		return (2);
 	do {
 		/* Do an scrypt. */
-		if (crypto_scrypt(NULL, 0, NULL, 0, 16, 1, 1, NULL, 0))
+		if (func(cookie, 1, &ncores))
 			return (3);
 
 		/* Has the clock ticked? */
@@ -163,21 +168,19 @@ scryptenc_cpuperf(double * opps)
 			break;
 	} while (1);
 
-	/* Count how many scrypts we can do before the next tick. */
+	/* Count how many salsa20/8 cores we can do in ${mintime}. */
 	if (getclocktime(&st))
 		return (2);
 	do {
 		/* Do an scrypt. */
-		if (crypto_scrypt(NULL, 0, NULL, 0, 128, 1, 1, NULL, 0))
+		if (func(cookie, 0, &ncores))
 			return (3);
-
-		/* We invoked the salsa20/8 core 512 times. */
-		i += 512;
+		i += ncores;
 
 		/* Check if we have looped for long enough. */
 		if (getclockdiff(&st, &diffd))
 			return (2);
-		if (diffd > resd)
+		if (diffd > mintime)
 			break;
 	} while (1);
 
@@ -190,3 +193,91 @@ scryptenc_cpuperf(double * opps)
 	*opps = i / diffd;
 	return (0);
 }
+
+/* Take the median of several samples of ${func}. */
+static int
+cpuperf(cpuperf_func func, void * cookie, double * opps)
+{
+	double samples[CPUPERF_SAMPLES];
+	double resd, x;
+	size_t i, j;
+	int rc;
+
+	/* Get the clock resolution. */
+	if (getclockres(&resd))
+		return (2);
+
+#ifdef DEBUG
+	fprintf(stderr, "Clock resolution is %f\n", resd);
+#endif
+
+	/* Take the samples, keeping them sorted. */
+	for (i = 0; i < CPUPERF_SAMPLES; i++) {
+		if ((rc = cpuperf_sample(func, cookie,
+		    (resd > CPUPERF_MINTIME) ? resd : CPUPERF_MINTIME, &x)) != 0)
+			return (rc);
+		for (j = i; j > 0 && samples[j - 1] > x; j--)
+			samples[j] = samples[j - 1];
+		samples[j] = x;
+	}
+
+	/* Use the median. */
+	*opps = samples[CPUPERF_SAMPLES / 2];
+	return (0);
+}
+
+/* Plain scrypt with N = 128 (or 16), r = 1, p = 1. */
+static int
+cpuperf_scrypt(void * cookie, int tiny, uint64_t * ncores)
+{
+
+	(void)cookie;
+
+	if (crypto_scrypt(NULL, 0, NULL, 0, tiny ? 16 : 128, 1, 1, NULL, 0))
+		return (-1);
+
+	/* We invoked the salsa20/8 core 4Nr times. */
+	*ncores = tiny ? 64 : 512;
+	return (0);
+}
+
+/* ROM-assisted scrypt with N = 128 (or 16), the ROM's r, and p = 1. */
+static int
+cpuperf_rom(void * cookie, int tiny, uint64_t * ncores)
+{
+	const struct crypto_scrypt_rom * rom = cookie;
+	uint32_t r = crypto_scrypt_rom_r(rom);
+
+	if (crypto_scrypt_rom(rom, NULL, 0, NULL, 0, tiny ? 16 : 128, r, 1,
+	    NULL, 0, 0))
+		return (-1);
+
+	/* We invoked the salsa20/8 core 4Nr times. */
+	*ncores = (uint64_t)(tiny ? 16 : 128) * 4 * r;
+	return (0);
+}
+
+/**
+ * scryptenc_cpuperf(opps):
+ * Estimate the number of salsa20/8 cores which can be executed per second,
+ * and return the value via opps.
+ */
+int
+scryptenc_cpuperf(double * opps)
+{
+
+	return (cpuperf(cpuperf_scrypt, NULL, opps));
+}
+
+/**
+ * scryptenc_cpuperf_rom(rom, opps):
+ * Estimate the number of salsa20/8 cores which can be executed per second
+ * by crypto_scrypt_rom with ${rom}, including the time spent waiting for
+ * blocks of the ROM, and return the value via opps.
+ */
+int
+scryptenc_cpuperf_rom(const struct crypto_scrypt_rom * rom, double * opps)
+{
+
+	return (cpuperf(cpuperf_rom, (void *)(uintptr_t)rom, opps));
+}
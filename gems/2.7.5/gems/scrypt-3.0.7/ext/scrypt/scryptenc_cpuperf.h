@@ -36,4 +36,14 @@
  */
 int scryptenc_cpuperf(double *);
 
+struct crypto_scrypt_rom;
+
+/**
+ * scryptenc_cpuperf_rom(rom, opps):
+ * Estimate the number of salsa20/8 cores which can be executed per second
+ * by crypto_scrypt_rom with ${rom}, including the time spent waiting for
+ * blocks of the ROM, and return the value via opps.
+ */
+int scryptenc_cpuperf_rom(const struct crypto_scrypt_rom *, double *);
+
 #endif /* !_SCRYPTENC_CPUPERF_H_ */
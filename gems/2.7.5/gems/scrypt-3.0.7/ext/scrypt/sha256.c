@@ -1,12 +1,37 @@
+#include <sys/types.h>
+#if !defined(WINDOWS_OS)
+	#include <pthread.h>
+	#ifndef HAVE_PTHREAD
+		#define HAVE_PTHREAD 1
+	#endif
+#endif
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "cpusupport.h"
 #include "insecure_memzero.h"
+#include "sha256_shani.h"
 #include "sysendian.h"
+#include "warnp.h"
 
 #include "sha256.h"
 
+#ifdef CPUSUPPORT_X86_SHANI
+#define HWACCEL
+
+/* Which compression function to use; chosen on first use. */
+static enum {
+	HW_SOFTWARE = 0,
+	HW_X86_SHANI,
+	HW_UNSET
+} hwaccel = HW_UNSET;
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t hwaccel_once = PTHREAD_ONCE_INIT;
+#endif
+#endif
+
 /*
  * Encode a length len/4 vector of (uint32_t) into a length len vector of
  * (uint8_t) in big-endian form.  Assumes len is a multiple of 4.
@@ -94,7 +119,7 @@ static const uint32_t K[64] = {
  * the 512-bit input block to produce a new state.
  */
 static void
-SHA256_Transform(uint32_t state[static restrict 8],
+SHA256_Transform_sw(uint32_t state[static restrict 8],
     const uint8_t block[static restrict 64],
     uint32_t W[static restrict 64], uint32_t S[static restrict 8])
 {
@@ -150,6 +175,81 @@ SHA256_Transform(uint32_t state[static restrict 8],
 		state[i] += S[i];
 }
 
+#ifdef HWACCEL
+/* Pick the compression function, trusting hardware only if it agrees. */
+static void
+hwaccel_init(void)
+{
+	uint32_t W[64];
+	uint32_t S[8];
+	uint32_t state_sw[8];
+	uint32_t state_hw[8];
+	uint8_t block[64];
+	size_t i;
+
+	/* Assume that we're not going to use hardware. */
+	hwaccel = HW_SOFTWARE;
+
+	/* Any state and block will do for the comparison. */
+	for (i = 0; i < 64; i++)
+		block[i] = (uint8_t)(i * 37 + 11);
+	memcpy(state_sw, K, 32);
+	memcpy(state_hw, K, 32);
+	SHA256_Transform_sw(state_sw, block, W, S);
+
+#ifdef CPUSUPPORT_X86_SHANI
+	/* If we're running on a CPU with the SHA extensions, try those. */
+	if (cpusupport_x86_shani()) {
+		SHA256_Transform_shani(state_hw, block);
+		if (memcmp(state_sw, state_hw, 32) == 0) {
+			hwaccel = HW_X86_SHANI;
+			return;
+		}
+		warn0("Disabling broken SHA-NI SHA256 support - please report bug!");
+	}
+#endif
+}
+
+/*
+ * Choose the compression function, once for all threads.  Every context goes
+ * through SHA256_Init, so that is where this is done rather than for every
+ * block.
+ */
+static void
+hwaccel_select(void)
+{
+
+#ifdef HAVE_PTHREAD
+	pthread_once(&hwaccel_once, hwaccel_init);
+#else
+	if (hwaccel == HW_UNSET)
+		hwaccel_init();
+#endif
+}
+#endif
+
+/*
+ * SHA256 block compression function, using the hardware where it has been
+ * found to work.  W and S are only used by the software implementation.
+ */
+static void
+SHA256_Transform(uint32_t state[static restrict 8],
+    const uint8_t block[static restrict 64],
+    uint32_t W[static restrict 64], uint32_t S[static restrict 8])
+{
+
+#ifdef HWACCEL
+#ifdef CPUSUPPORT_X86_SHANI
+	if (hwaccel == HW_X86_SHANI) {
+		SHA256_Transform_shani(state, block);
+		return;
+	}
+#endif
+#endif
+
+	SHA256_Transform_sw(state, block, W, S);
+}
+
 static const uint8_t PAD[64] = {
 	0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -200,6 +300,10 @@ void
 SHA256_Init(SHA256_CTX * ctx)
 {
 
+#ifdef HWACCEL
+	hwaccel_select();
+#endif
+
 	/* Zero bits processed so far. */
 	ctx->count = 0;
 
@@ -470,6 +574,10 @@ PBKDF2_SHA256(const uint8_t * passwd, size_t passwdlen, const uint8_t * salt,
 	uint8_t ivec[4];
 	uint8_t U[32];
 	uint8_t T[32];
+	uint8_t Ublock[64];
+	uint32_t istate[8];
+	uint32_t ostate[8];
+	uint32_t T32[8];
 	uint64_t j;
 	int k;
 	size_t clen;
@@ -485,6 +593,14 @@ PBKDF2_SHA256(const uint8_t * passwd, size_t passwdlen, const uint8_t * salt,
 	memcpy(&PShctx, &Phctx, sizeof(HMAC_SHA256_CTX));
 	_HMAC_SHA256_Update(&PShctx, salt, saltlen, tmp32);
 
+	/*
+	 * For j >= 2 both the inner and the outer hash of U_j take a single
+	 * block after the key pad: 32 bytes of data and padding for a total
+	 * of 96 bytes.  The padding never changes, so prepare it once.
+	 */
+	memcpy(&Ublock[32], PAD, 24);
+	be64enc(&Ublock[56], (64 + 32) * 8);
+
 	/* Iterate through the blocks. */
 	for (i = 0; i * 32 < dkLen; i++) {
 		/* Generate INT(i + 1). */
@@ -496,18 +612,23 @@ PBKDF2_SHA256(const uint8_t * passwd, size_t passwdlen, const uint8_t * salt,
 		_HMAC_SHA256_Final(U, &hctx, tmp32, tmp8);
 
 		/* T_i = U_1 ... */
-		memcpy(T, U, 32);
+		memcpy(Ublock, U, 32);
+		be32dec_vect(T32, U, 32);
 
 		for (j = 2; j <= c; j++) {
-			/* Compute U_j. */
-			memcpy(&hctx, &Phctx, sizeof(HMAC_SHA256_CTX));
-			_HMAC_SHA256_Update(&hctx, U, 32, tmp32);
-			_HMAC_SHA256_Final(U, &hctx, tmp32, tmp8);
+			/* Compute U_j from the saved post-pad states. */
+			memcpy(istate, Phctx.ictx.state, 32);
+			SHA256_Transform(istate, Ublock, &tmp32[0], &tmp32[64]);
+			be32enc_vect(Ublock, istate, 32);
+			memcpy(ostate, Phctx.octx.state, 32);
+			SHA256_Transform(ostate, Ublock, &tmp32[0], &tmp32[64]);
+			be32enc_vect(Ublock, ostate, 32);
 
 			/* ... xor U_j ... */
-			for (k = 0; k < 32; k++)
-				T[k] ^= U[k];
+			for (k = 0; k < 8; k++)
+				T32[k] ^= ostate[k];
 		}
+		be32enc_vect(T, T32, 32);
 
 		/* Copy as many bytes as necessary into buf. */
 		clen = dkLen - i * 32;
@@ -524,4 +645,8 @@ PBKDF2_SHA256(const uint8_t * passwd, size_t passwdlen, const uint8_t * salt,
 	insecure_memzero(tmp8, 96);
 	insecure_memzero(U, 32);
 	insecure_memzero(T, 32);
+	insecure_memzero(Ublock, 64);
+	insecure_memzero(istate, 32);
+	insecure_memzero(ostate, 32);
+	insecure_memzero(T32, 32);
 }
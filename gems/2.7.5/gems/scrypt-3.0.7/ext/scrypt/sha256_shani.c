@@ -0,0 +1,104 @@
+#include "cpusupport.h"
+#ifdef CPUSUPPORT_X86_SHANI
+
+/* Only this file is built for the SHA extensions; the rest is not. */
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sha,sse4.1"))), \
+    apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sha,sse4.1")
+#endif
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#include "sha256_shani.h"
+
+/* SHA256 round constants. */
+static const uint32_t Krnd[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/**
+ * SHA256_Transform_shani(state, block):
+ * Compute the SHA256 block compression function, transforming ${state} using
+ * the data in ${block}.  This implementation uses x86 SHA extensions, and
+ * should only be used if CPUSUPPORT_X86_SHANI is defined and
+ * cpusupport_x86_shani() returns nonzero.
+ */
+void
+SHA256_Transform_shani(uint32_t state[8], const uint8_t block[64])
+{
+	/* Byte-swap each 32-bit word of a big-endian block. */
+	const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+	    0x0405060700010203ULL);
+	__m128i STATE0, STATE1, ABEF_SAVE, CDGH_SAVE;
+	__m128i M[4];
+	__m128i MSG, T;
+	int i;
+
+	/* Rearrange the state as the instructions want it: ABEF and CDGH. */
+	T = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]),
+	    0xB1);
+	STATE1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]),
+	    0x1B);
+	STATE0 = _mm_alignr_epi8(T, STATE1, 8);
+	STATE1 = _mm_blend_epi16(STATE1, T, 0xF0);
+	ABEF_SAVE = STATE0;
+	CDGH_SAVE = STATE1;
+
+	/* Four rounds at a time, four message words at a time. */
+	for (i = 0; i < 16; i++) {
+		if (i < 4) {
+			/* W[4i .. 4i + 3] come straight from the block. */
+			M[i] = _mm_shuffle_epi8(
+			    _mm_loadu_si128((const __m128i *)&block[i * 16]),
+			    MASK);
+		} else {
+			/* W[t] = s1(W[t-2]) + W[t-7] + s0(W[t-15]) + W[t-16] */
+			T = _mm_sha256msg1_epu32(M[i % 4], M[(i + 1) % 4]);
+			T = _mm_add_epi32(T,
+			    _mm_alignr_epi8(M[(i + 3) % 4], M[(i + 2) % 4], 4));
+			M[i % 4] = _mm_sha256msg2_epu32(T, M[(i + 3) % 4]);
+		}
+		MSG = _mm_add_epi32(M[i % 4],
+		    _mm_loadu_si128((const __m128i *)&Krnd[i * 4]));
+		STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+		MSG = _mm_shuffle_epi32(MSG, 0x0E);
+		STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+	}
+
+	/* Mix local working variables into global state. */
+	STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+	STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+
+	/* Put the state back in ABCD and EFGH order. */
+	T = _mm_shuffle_epi32(STATE0, 0x1B);
+	STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);
+	_mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(T, STATE1, 0xF0));
+	_mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(STATE1, T, 8));
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif /* CPUSUPPORT_X86_SHANI */
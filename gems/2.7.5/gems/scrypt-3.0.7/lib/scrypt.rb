@@ -7,4 +7,6 @@ require 'scrypt/scrypt_ext'
 require 'scrypt/security_utils'
 
 require 'scrypt/engine'
+require 'scrypt/job'
 require 'scrypt/password'
+require 'scrypt/rom'
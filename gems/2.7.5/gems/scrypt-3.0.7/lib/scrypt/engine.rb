@@ -8,14 +8,66 @@ module SCrypt
     # rubocop:disable Style/SymbolArray
     # Bind the external functions
     attach_function :sc_calibrate,
-                    [:size_t, :double, :double, :pointer],
+                    [:size_t, :double, :double, :string, :pointer],
                     :int,
                     blocking: true
 
+    attach_function :sc_memlimit,
+                    [:size_t, :double, :pointer],
+                    :int
+
     attach_function :crypto_scrypt,
                     [:pointer, :size_t, :pointer, :size_t, :uint64, :uint32, :uint32, :pointer, :size_t],
                     :int,
                     blocking: true # todo
+
+    attach_function :crypto_scrypt_parallel,
+                    [:pointer, :size_t, :pointer, :size_t, :uint64, :uint32, :uint32, :pointer, :size_t, :uint32, :size_t, :int],
+                    :int,
+                    blocking: true
+
+    attach_function :crypto_scrypt_release_arena, [], :void
+
+    attach_function :crypto_scrypt_rom_generate,
+                    [:string, :pointer, :size_t, :uint32, :uint64],
+                    :int,
+                    blocking: true
+    attach_function :crypto_scrypt_rom_open, [:string], :pointer
+    attach_function :crypto_scrypt_rom_r, [:pointer], :uint32
+    attach_function :crypto_scrypt_rom_nrom, [:pointer], :uint64
+    attach_function :crypto_scrypt_rom_close, [:pointer], :void
+    attach_function :crypto_scrypt_rom,
+                    [:pointer, :pointer, :size_t, :pointer, :size_t, :uint64, :uint32, :uint32, :pointer, :size_t, :int],
+                    :int,
+                    blocking: true
+    attach_function :sc_calibrate_rom,
+                    [:pointer, :size_t, :double, :double, :pointer],
+                    :int,
+                    blocking: true
+
+    attach_function :scrypt_verify_many,
+                    [:pointer, :size_t, :uint32, :size_t, :double],
+                    :int,
+                    blocking: true
+
+    attach_function :pbkdf2_sha256,
+                    :PBKDF2_SHA256,
+                    [:pointer, :size_t, :pointer, :size_t, :uint64, :pointer, :size_t],
+                    :void,
+                    blocking: true
+
+    attach_function :scrypt_jobs_init, [:size_t, :size_t], :int
+    attach_function :scrypt_job_submit,
+                    [:pointer, :size_t, :pointer, :size_t, :uint64, :uint32, :uint32, :size_t, :int],
+                    :pointer
+    attach_function :scrypt_job_fd, [:pointer], :int
+    attach_function :scrypt_job_result, [:pointer, :pointer, :size_t], :int
+    attach_function :scrypt_job_free, [:pointer], :void
+
+    # How crypto_scrypt_parallel allocates V (CRYPTO_SCRYPT_V_* in crypto_scrypt_vmem.h)
+    V_HUGEPAGES = 0x1
+    V_PREFAULT = 0x2
+    V_ARENA = 0x4
     # rubocop:enable
   end
 
@@ -27,6 +79,16 @@ module SCrypt
       max_mem: 16 * 1024 * 1024,
       max_memfrac: 0.5,
       max_time: 0.2,
+      max_threads: 1,
+      huge_pages: false,
+      prefault: false,
+      arena: false,
+      async_threads: 2,
+      async_queue: 64,
+      calibration_cache: nil,
+      verify_threads: 0,
+      verify_max_mem: 0,
+      rom_max_mem: 2 * 1024 * 1024,
       cost: nil
     }
     # rubocop:enable
@@ -37,23 +99,136 @@ module SCrypt
               :p, :uint32
     end
 
+    class VerifyItem < FFI::Struct
+      layout  :passwd, :pointer,
+              :passwdlen, :size_t,
+              :salt, :pointer,
+              :saltlen, :size_t,
+              :n, :uint64,
+              :r, :uint32,
+              :p, :uint32,
+              :hash, :pointer,
+              :hashlen, :size_t,
+              :result, :int
+    end
+
     class << self
       def scrypt(secret, salt, *args)
-        if args.length == 2
-          # args is [cost_string, key_len]
-          n, r, p = args[0].split('$').map { |x| x.to_i(16) }
-          key_len = args[1]
+        __sc_crypt(secret, salt, *__sc_args(args))
+      end
 
-          __sc_crypt(secret, salt, n, r, p, key_len)
-        elsif args.length == 4
-          # args is [n, r, p, key_len]
-          n, r, p = args[0, 3]
-          key_len = args[3]
+      # Computes PBKDF2 with HMAC-SHA256 as the PRF, as used for example by
+      # Ethereum keystores, and returns +key_len+ bytes of output.
+      #
+      # Example:
+      #
+      #   SCrypt::Engine.pbkdf2_sha256('password', 'salt', 262_144, 32)
+      #
+      def pbkdf2_sha256(secret, salt, iterations, key_len)
+        raise ArgumentError, 'iterations must be at least 1' if iterations < 1
+        raise ArgumentError, 'invalid key length' if key_len.negative? || key_len > 32 * 0xffffffff
 
-          __sc_crypt(secret, salt, n, r, p, key_len)
-        else
-          raise ArgumentError, 'invalid number of arguments (4 or 6)'
+        secret = secret.to_s
+        result = __sc_buffer(key_len)
+        SCrypt::Ext.pbkdf2_sha256(secret, secret.bytesize, salt, salt.bytesize, iterations, result, key_len)
+        result
+      end
+
+      # Starts the same computation as SCrypt::Engine.scrypt on a background native
+      # thread and returns an SCrypt::Job for it straight away.
+      #
+      # At most <tt>DEFAULTS[:async_queue]</tt> jobs wait for one of the
+      # <tt>DEFAULTS[:async_threads]</tt> threads; beyond that SCrypt::Errors::QueueFull
+      # is raised. Both are read when the first job is submitted.
+      def scrypt_async(secret, salt, *args)
+        n, r, p, key_len = __sc_args(args)
+
+        ret_val = SCrypt::Ext.scrypt_jobs_init(DEFAULTS[:async_threads], DEFAULTS[:async_queue])
+        raise "scrypt error #{FFI.errno}" unless ret_val.zero?
+
+        job = SCrypt::Ext.scrypt_job_submit(
+          secret, secret.bytesize, salt, salt.bytesize,
+          n, r, p,
+          key_len, __sc_vflags
+        )
+        if job.null?
+          raise Errors::QueueFull, 'too many scrypt jobs waiting' if FFI.errno == Errno::EAGAIN::Errno
+
+          raise "scrypt error #{FFI.errno}"
+        end
+
+        Job.new(job, key_len)
+      end
+
+      # Computes scrypt with the read-only table +rom+ (an SCrypt::ROM) standing in for
+      # half of the reads from V, so a computation needs only 128 * r * n bytes of its
+      # own however large the table is. The arguments are otherwise as for
+      # SCrypt::Engine.scrypt, and r must be the one the table was generated with;
+      # SCrypt::Engine.calibrate_rom gives a suitable cost.
+      def scrypt_rom(secret, salt, rom, *args)
+        n, r, p, key_len = __sc_args(args)
+        raise ArgumentError, "the ROM was generated with r = #{rom.r}" unless r == rom.r
+
+        result = __sc_buffer(key_len)
+        ret_val = SCrypt::Ext.crypto_scrypt_rom(
+          rom, secret, secret.bytesize, salt, salt.bytesize,
+          n, r, p,
+          result, key_len, __sc_vflags
+        )
+
+        raise "scrypt error #{ret_val}" unless ret_val.zero?
+
+        result
+      end
+
+      # Like SCrypt::Engine.calibrate, but for SCrypt::Engine.scrypt_rom with +rom+:
+      # the speed is measured with the table, and <tt>:rom_max_mem</tt> rather than
+      # <tt>:max_mem</tt> limits the memory of each computation on top of the table.
+      def calibrate_rom(rom, options = {})
+        options = DEFAULTS.merge(options)
+        calibration = Calibration.new
+        ret_val = SCrypt::Ext.sc_calibrate_rom(rom, options[:rom_max_mem], options[:max_memfrac],
+                                               options[:max_time], calibration)
+
+        raise "calibration error #{ret_val}" unless ret_val.zero?
+
+        '%x$%x$%x$' % [calibration[:n], calibration[:r], calibration[:p]]
+      end
+
+      # Checks each secret against its hash (a String or SCrypt::Password) and returns
+      # an array of booleans in the same order, as SCrypt::Password#== would.
+      #
+      # The derivations run on the calling thread and up to <tt>:verify_threads</tt> - 1
+      # threads (0 for one per CPU) of the native pool crypto_scrypt_parallel uses, while the memory they need together stays within
+      # SCrypt::Engine.memory_limit(:max_mem => options[:verify_max_mem]), and the
+      # digests are compared in constant time without going back to Ruby in between.
+      # Old-style hashes with a 40-character salt are checked one at a time.
+      #
+      # Example:
+      #
+      #   SCrypt::Engine.verify_many([['my secret', hash], ['not my secret', hash]])
+      #   # => [true, false]
+      def verify_many(pairs, options = {})
+        options = DEFAULTS.merge(options)
+        results = Array.new(pairs.size, false)
+        batch = []
+
+        pairs.each_with_index do |(secret, hash), i|
+          raise Errors::InvalidSecret, 'invalid secret' unless valid_secret?(secret)
+
+          password = hash.is_a?(Password) ? hash : Password.new(hash)
+          if password.salt.length == 40
+            results[i] = (password == secret)
+          elsif password.digest.match?(/\A(?:[0-9a-f]{2})+\z/)
+            # Anything else can't be produced by SCrypt::Engine.hash_secret
+            batch << [i, secret.to_s, password]
+          end
         end
+
+        __sc_verify_many(batch, options).each_with_index do |match, j|
+          results[batch[j][0]] = match
+        end
+        results
       end
 
       # Given a secret and a valid salt (see SCrypt::Engine.generate_salt) calculates an scrypt password hash.
@@ -112,15 +287,18 @@ module SCrypt
       # <tt>:max_time</tt> specifies the maximum number of seconds the computation should take.
       # <tt>:max_mem</tt> specifies the maximum number of bytes the computation should take. A value of 0 specifies no upper limit. The minimum is always 1 MB.
       # <tt>:max_memfrac</tt> specifies the maximum memory in a fraction of available resources to use. Any value equal to 0 or greater than 0.5 will result in 0.5 being used.
+      # <tt>:calibration_cache</tt> names a file in which the measured CPU speed is kept, so later calls (also from other processes) only measure again when the CPU model or the scrypt code in use changes.
       #
       # Example:
       #
       #   # should take less than 200ms
       #   SCrypt::Engine.calibrate(:max_time => 0.2)
       #
+      # The memory the cost may use is given by SCrypt::Engine.memory_limit for the same options.
       def calibrate(options = {})
         options = DEFAULTS.merge(options)
-        '%x$%x$%x$' % __sc_calibrate(options[:max_mem], options[:max_memfrac], options[:max_time])
+        '%x$%x$%x$' % __sc_calibrate(options[:max_mem], options[:max_memfrac], options[:max_time],
+                                     options[:calibration_cache])
       end
 
       # Calls SCrypt::Engine.calibrate and saves the cost string for future calls to
@@ -129,6 +307,28 @@ module SCrypt
         DEFAULTS[:cost] = calibrate(options)
       end
 
+      # Returns the number of bytes SCrypt::Engine.calibrate lets a computation use with the
+      # given options: <tt>:max_memfrac</tt> of the available memory, but no more than
+      # <tt>:max_mem</tt>. On Linux the memory left under the limits of the process's
+      # cgroups (v1 or v2) counts as available when it is less than the RAM, so that
+      # calibrating inside a container doesn't size the cost for the host.
+      #
+      # Example:
+      #
+      #   SCrypt::Engine.memory_limit(:max_mem => 0)
+      #   # => 268435456
+      #
+      def memory_limit(options = {})
+        options = DEFAULTS.merge(options)
+        FFI::MemoryPointer.new(:size_t) do |limit|
+          ret_val = SCrypt::Ext.sc_memlimit(options[:max_mem], options[:max_memfrac], limit)
+
+          raise "memory limit error #{ret_val}" unless ret_val.zero?
+
+          return limit.read(:size_t)
+        end
+      end
+
       # Computes the memory use of the given +cost+
       def memory_use(cost)
         n, r, p = cost.split('$').map { |i| i.to_i(16) }
@@ -140,34 +340,112 @@ module SCrypt
         salt[/^[0-9a-z]+\$[0-9a-z]+\$[0-9a-z]+\$/]
       end
 
+      # Returns the memory kept by the calling thread for <tt>DEFAULTS[:arena]</tt>
+      # to the operating system. It is allocated again by the next computation.
+      def release_arena
+        SCrypt::Ext.crypto_scrypt_release_arena
+        nil
+      end
+
       private
 
-      def __sc_calibrate(max_mem, max_memfrac, max_time)
+      def __sc_args(args)
+        if args.length == 2
+          # args is [cost_string, key_len]
+          n, r, p = args[0].split('$').map { |x| x.to_i(16) }
+          [n, r, p, args[1]]
+        elsif args.length == 4
+          # args is [n, r, p, key_len]
+          args
+        else
+          raise ArgumentError, 'invalid number of arguments (4 or 6)'
+        end
+      end
+
+      def __sc_calibrate(max_mem, max_memfrac, max_time, cache = nil)
         result = nil
 
         calibration = Calibration.new
-        ret_val = SCrypt::Ext.sc_calibrate(max_mem, max_memfrac, max_time, calibration)
+        ret_val = SCrypt::Ext.sc_calibrate(max_mem, max_memfrac, max_time, cache&.to_s, calibration)
 
         raise "calibration error #{result}" unless ret_val.zero?
 
         [calibration[:n], calibration[:r], calibration[:p]]
       end
 
-      def __sc_crypt(secret, salt, n, r, p, key_len)
-        result = nil
+      def __sc_verify_many(batch, options)
+        return [] if batch.empty?
 
-        FFI::MemoryPointer.new(:char, key_len) do |buffer|
-          ret_val = SCrypt::Ext.crypto_scrypt(
-            secret, secret.bytesize, salt, salt.bytesize,
-            n, r, p,
-            buffer, key_len
-          )
+        buffers = []
+        buffer = lambda do |str|
+          buffers << FFI::MemoryPointer.new(:uint8, [str.bytesize, 1].max).put_bytes(0, str)
+          buffers.last
+        end
 
-          raise "scrypt error #{ret_val}" unless ret_val.zero?
+        items = FFI::MemoryPointer.new(VerifyItem, batch.size)
+        batch.each_with_index do |(_, secret, password), j|
+          n, r, p = password.cost.split('$').map { |x| x.to_i(16) }
+          salt = [password.salt.sub(/^(00)+/, '')].pack('H*')
+          digest = [password.digest].pack('H*')
 
-          result = buffer.read_string(key_len)
+          item = VerifyItem.new(items + (j * VerifyItem.size))
+          item[:passwd] = buffer.call(secret)
+          item[:passwdlen] = secret.bytesize
+          item[:salt] = buffer.call(salt)
+          item[:saltlen] = salt.bytesize
+          item[:n] = n
+          item[:r] = r
+          item[:p] = p
+          item[:hash] = buffer.call(digest)
+          item[:hashlen] = digest.bytesize
         end
 
+        ret_val = SCrypt::Ext.scrypt_verify_many(items, batch.size, options[:verify_threads].to_i,
+                                                 options[:verify_max_mem], options[:max_memfrac])
+        raise "scrypt error #{ret_val}" unless ret_val.zero?
+
+        Array.new(batch.size) { |j| VerifyItem.new(items + (j * VerifyItem.size))[:result] == 1 }
+      ensure
+        buffers&.each(&:clear)
+      end
+
+      def __sc_vflags
+        flags = 0
+        flags |= SCrypt::Ext::V_HUGEPAGES if DEFAULTS[:huge_pages]
+        flags |= SCrypt::Ext::V_PREFAULT if DEFAULTS[:prefault]
+        flags |= SCrypt::Ext::V_ARENA if DEFAULTS[:arena]
+        flags
+      end
+
+      # A new binary String of +len+ bytes for native code to write into. Strings are
+      # passed to :pointer arguments as they are, so the secret, the salt and this
+      # buffer reach the KDF without any intermediate native copies.
+      def __sc_buffer(len)
+        ("\0" * len).force_encoding(Encoding::BINARY)
+      end
+
+      def __sc_crypt(secret, salt, n, r, p, key_len)
+        max_threads = DEFAULTS[:max_threads].to_i
+        vflags = __sc_vflags
+        result = __sc_buffer(key_len)
+
+        ret_val = if (max_threads > 1 && p > 1) || vflags.nonzero?
+                    SCrypt::Ext.crypto_scrypt_parallel(
+                      secret, secret.bytesize, salt, salt.bytesize,
+                      n, r, p,
+                      result, key_len,
+                      [max_threads, 1].max, DEFAULTS[:max_mem], vflags
+                    )
+                  else
+                    SCrypt::Ext.crypto_scrypt(
+                      secret, secret.bytesize, salt, salt.bytesize,
+                      n, r, p,
+                      result, key_len
+                    )
+                  end
+
+        raise "scrypt error #{ret_val}" unless ret_val.zero?
+
         result
       end
     end
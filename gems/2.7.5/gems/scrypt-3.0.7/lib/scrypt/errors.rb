@@ -10,5 +10,8 @@ module SCrypt
 
     # The secret parameter provided is invalid.
     class InvalidSecret < StandardError; end
+
+    # Too many asynchronous computations are already waiting.
+    class QueueFull     < StandardError; end
   end
 end
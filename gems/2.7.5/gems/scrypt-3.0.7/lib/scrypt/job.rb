@@ -0,0 +1,64 @@
+# frozen_string_literal: true
+
+require 'io/wait'
+
+module SCrypt
+  # A computation started by SCrypt::Engine.scrypt_async on a background native thread.
+  #
+  # Its #to_io becomes readable once the computation has finished, so it can be
+  # waited on with IO.select or a fiber scheduler instead of tying up a thread.
+  #
+  # Example:
+  #
+  #   job = SCrypt::Engine.scrypt_async('my secret', salt, '4000$8$4$', 32)
+  #   job.to_io.wait_readable
+  #   job.value #=> the derived key
+  #
+  class Job
+    # The length in bytes of the derived key.
+    attr_reader :key_len
+
+    def initialize(pointer, key_len)
+      @pointer = FFI::AutoPointer.new(pointer, SCrypt::Ext.method(:scrypt_job_free))
+      @key_len = key_len
+      # The descriptor is handed over to us, so the IO closes it.
+      @io = IO.for_fd(SCrypt::Ext.scrypt_job_fd(@pointer), autoclose: true)
+      @value = nil
+    end
+
+    # An IO which becomes readable when the computation has finished. It is closed
+    # once #value has returned, so stop waiting on it by then.
+    def to_io
+      @io
+    end
+
+    # Returns true if the computation has finished.
+    def done?
+      !@value.nil? || !@io.wait_readable(0).nil?
+    end
+
+    # Waits for the computation and returns the derived key.
+    def value
+      return @value if @value
+
+      @io.wait_readable
+      value = ("\0" * @key_len).force_encoding(Encoding::BINARY)
+      ret_val = SCrypt::Ext.scrypt_job_result(@pointer, value, @key_len)
+
+      raise "scrypt error #{FFI.errno}" unless ret_val.zero?
+
+      @value = value
+      release
+      @value
+    end
+
+    private
+
+    # Closes the IO and zeroes and frees the native job straight away rather than
+    # when they are collected.
+    def release
+      @io.close
+      @pointer.free
+    end
+  end
+end
@@ -0,0 +1,70 @@
+# frozen_string_literal: true
+
+module SCrypt
+  # A large read-only table for SCrypt::Engine.scrypt_rom, stored in a file.
+  #
+  # The file is mapped rather than read, so every process on a host that opens the
+  # same file shares one copy of it in the page cache. A computation then needs only
+  # its own small V, while an attacker without the table has to recompute it.
+  #
+  # Example:
+  #
+  #   SCrypt::ROM.generate('/var/lib/myapp/scrypt.rom', seed, 1024 * 1024 * 1024)
+  #   rom = SCrypt::ROM.new('/var/lib/myapp/scrypt.rom')
+  #   cost = SCrypt::Engine.calibrate_rom(rom)
+  #   SCrypt::Engine.scrypt_rom('my secret', salt, rom, cost, 32)
+  #
+  class ROM
+    # The file the table was mapped from.
+    attr_reader :path
+
+    # The block size parameter the table was generated with.
+    attr_reader :r
+
+    # The size of the table in bytes.
+    attr_reader :size
+
+    # Derives a table of about +size+ bytes (rounded down to a power of two number
+    # of blocks) from +seed+ and stores it in +path+. The same seed, size and +r+
+    # always give the same table, so keep the seed: hashes computed with the table
+    # can't be checked without it.
+    def self.generate(path, seed, size, r = 8)
+      blocks = size / (128 * r)
+      raise ArgumentError, 'ROM size too small' if blocks < 2
+
+      nrom = 1 << (blocks.bit_length - 1)
+      seed = seed.to_s
+      ret_val = SCrypt::Ext.crypto_scrypt_rom_generate(path.to_s, seed, seed.bytesize, r, nrom)
+      raise SystemCallError.new(path.to_s, FFI.errno) unless ret_val.zero?
+
+      new(path)
+    end
+
+    # Maps the table stored in +path+ by SCrypt::ROM.generate.
+    def initialize(path)
+      @path = path.to_s
+      pointer = SCrypt::Ext.crypto_scrypt_rom_open(@path)
+      raise SystemCallError.new(@path, FFI.errno) if pointer.null?
+
+      @pointer = FFI::AutoPointer.new(pointer, SCrypt::Ext.method(:crypto_scrypt_rom_close))
+      @r = SCrypt::Ext.crypto_scrypt_rom_r(@pointer)
+      @size = SCrypt::Ext.crypto_scrypt_rom_nrom(@pointer) * 128 * @r
+    end
+
+    # Unmaps the table straight away rather than when it is collected. Closing it
+    # again does nothing.
+    def close
+      return if @pointer.nil?
+
+      @pointer.free
+      @pointer = nil
+    end
+
+    # The native table, for passing to SCrypt::Ext.
+    def to_ptr
+      raise IOError, 'closed ROM' if @pointer.nil?
+
+      @pointer
+    end
+  end
+end
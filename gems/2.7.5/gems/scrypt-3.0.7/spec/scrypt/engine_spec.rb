@@ -1,12 +1,43 @@
 # frozen_string_literal: true
 
 require File.expand_path(File.join(File.dirname(__FILE__), '..', 'spec_helper'))
+require 'fileutils'
+require 'tmpdir'
 
 describe 'The SCrypt engine' do
   it 'should calculate a valid cost factor' do
     first = SCrypt::Engine.calibrate(max_time: 0.2)
     expect(SCrypt::Engine.valid_cost?(first)).to equal(true)
   end
+
+  it 'should calibrate within the memory limit it reports' do
+    limit = SCrypt::Engine.memory_limit(max_mem: 4 * 1024 * 1024)
+    expect(limit).to be_between(1024 * 1024, 4 * 1024 * 1024)
+    cost = SCrypt::Engine.calibrate(max_mem: 4 * 1024 * 1024, max_time: 0.05)
+    n, r, = cost.split('$').map { |i| i.to_i(16) }
+    expect(128 * r * n).to be_between(0, limit)
+  end
+
+  it 'should reuse the CPU speed kept in a calibration cache' do
+    Dir.mktmpdir do |dir|
+      cache = File.join(dir, 'calibration')
+      first = SCrypt::Engine.calibrate(max_time: 0.05, calibration_cache: cache)
+      expect(File.exist?(cache)).to equal(true)
+      expect(SCrypt::Engine.calibrate(max_time: 0.05, calibration_cache: cache)).to eq(first)
+
+      # A very slow CPU according to the cache gets the smallest cost
+      File.write(cache, File.read(cache).sub(/\t[^\t]*\n\z/, "\t1\n"))
+      expect(SCrypt::Engine.calibrate(max_time: 0.05, calibration_cache: cache)).to eq('400$8$1$')
+    end
+  end
+
+  it 'should verify many passwords at once' do
+    password = SCrypt::Password.create('s3cr3t', cost: '400$8$2$')
+    other = SCrypt::Password.create('other', cost: '400$8$1$', key_len: 64)
+    old = '400$8$d$173a8189751c095a29b933789560b73bf17b2e01$9bf66d74bd6f3ebcf99da3b379b689b89db1cb07'
+    pairs = [['s3cr3t', password], ['s3cr3t', other.to_s], ['my secret', old], ['other', other], ['', password]]
+    expect(SCrypt::Engine.verify_many(pairs, verify_threads: 2)).to eq([true, false, true, true, false])
+  end
 end
 
 describe 'Generating SCrypt salts' do
@@ -63,7 +94,64 @@ describe 'Generating SCrypt hashes' do
   end
 end
 
+describe 'ROM-assisted scrypt' do
+  before :each do
+    @dir = Dir.mktmpdir
+    @rom = SCrypt::ROM.generate(File.join(@dir, 'rom'), 'seed', 1024 * 1024)
+  end
+
+  after :each do
+    @rom.close
+    FileUtils.rm_rf(@dir)
+  end
+
+  it 'should depend on the secret, the salt and the table' do
+    other = SCrypt::ROM.generate(File.join(@dir, 'other'), 'other seed', 1024 * 1024)
+    key = SCrypt::Engine.scrypt_rom('password', 'NaCl', @rom, 1024, 8, 1, 64)
+    expect(@rom.size).to eq(1024 * 1024)
+    expect(key).to eq(SCrypt::Engine.scrypt_rom('password', 'NaCl', @rom, '400$8$1$', 64))
+    expect(key).not_to eq(SCrypt::Engine.scrypt_rom('password', 'NaCl', other, 1024, 8, 1, 64))
+    expect(key).not_to eq(SCrypt::Engine.scrypt('password', 'NaCl', 1024, 8, 1, 64))
+    expect(key).not_to eq(SCrypt::Engine.scrypt_rom('password', 'NaCm', @rom, 1024, 8, 1, 64))
+    other.close
+  end
+
+  it 'should get the same table from the same seed' do
+    key = SCrypt::Engine.scrypt_rom('password', 'NaCl', @rom, 16, 8, 1, 32)
+    again = SCrypt::ROM.generate(File.join(@dir, 'again'), 'seed', 1024 * 1024)
+    expect(SCrypt::Engine.scrypt_rom('password', 'NaCl', again, 16, 8, 1, 32)).to eq(key)
+    again.close
+  end
+
+  it 'should calibrate for the table' do
+    cost = SCrypt::Engine.calibrate_rom(@rom, max_time: 0.05)
+    expect(SCrypt::Engine.valid_cost?(cost)).to equal(true)
+    expect(cost.split('$')[1]).to eq('8')
+    expect(-> { SCrypt::Engine.scrypt_rom('password', 'NaCl', @rom, 16, 4, 1, 32) }).to raise_error(ArgumentError)
+  end
+
+  it 'should generate the table in place and close it once' do
+    key = SCrypt::Engine.scrypt_rom('password', 'NaCl', @rom, 16, 8, 1, 32)
+    expect(key.unpack1('H*')).to eq('64dde9bb054cd01c50d3ebea2d426c73d0783e8a08b5445b6193cac1dca06ddd')
+    expect(Dir.children(@dir)).to eq(['rom'])
+    expect(File.size(File.join(@dir, 'rom'))).to eq(64 + 1024 * 1024)
+    @rom.close
+    @rom.close
+    expect(-> { SCrypt::Engine.scrypt_rom('password', 'NaCl', @rom, 16, 8, 1, 32) }).to raise_error(IOError)
+  end
+end
+
 describe 'SCrypt test vectors' do
+  it 'should return each key as a new binary string' do
+    first = SCrypt::Engine.scrypt('password', 'NaCl', 16, 1, 1, 16)
+    second = SCrypt::Engine.scrypt('password', 'NaCl', 16, 1, 1, 16)
+    expect(first.encoding).to eq(Encoding::BINARY)
+    expect(first.bytesize).to eq(16)
+    expect(first).to eq(SCrypt::Engine.scrypt('password', 'NaCl', 16, 1, 1, 64)[0, 16])
+    expect(first).to eq(second)
+    expect(first.equal?(second)).to equal(false)
+  end
+
   it 'should match results of SCrypt function' do
     expect(SCrypt::Engine.scrypt('', '', 16, 1, 1, 64).unpack('H*').first).to eq('77d6576238657b203b19ca42c18a0497f16b4844e3074ae8dfdffa3fede21442fcd0069ded0948f8326a753a0fc81f17e8d3e0fb2e0d3628cf35e20c38d18906')
     expect(SCrypt::Engine.scrypt('password', 'NaCl', 1024, 8, 16, 64).unpack('H*').first).to eq('fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b3731622eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640')
@@ -72,6 +160,54 @@ describe 'SCrypt test vectors' do
     #   expect(SCrypt::Engine.scrypt('pleaseletmein', 'SodiumChloride', 1048576, 8, 1, 64).unpack('H*').first).to eq('2101cb9b6a511aaeaddbbe09cf70f881ec568d574a2ffd4dabe5ee9820adaa478e56fd8f4ba5d09ffa1c6d927c40f4c337304049e8a952fbcbf45c6fa77a41a4')
   end
 
+  it 'should match the same results when computing p lanes on several threads' do
+    SCrypt::Engine::DEFAULTS[:max_threads] = 4
+    expect(SCrypt::Engine.scrypt('password', 'NaCl', 1024, 8, 16, 64).unpack('H*').first).to eq('fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b3731622eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640')
+    expect(SCrypt::Engine.scrypt('', '', 16, 1, 1, 64).unpack('H*').first).to eq('77d6576238657b203b19ca42c18a0497f16b4844e3074ae8dfdffa3fede21442fcd0069ded0948f8326a753a0fc81f17e8d3e0fb2e0d3628cf35e20c38d18906')
+  ensure
+    SCrypt::Engine::DEFAULTS[:max_threads] = 1
+  end
+
+  it 'should match the same results when several callers share the lane threads' do
+    SCrypt::Engine::DEFAULTS[:max_threads] = 4
+    threads = Array.new(4) { Thread.new { SCrypt::Engine.scrypt('password', 'NaCl', 1024, 8, 16, 64).unpack('H*').first } }
+    expect(threads.map(&:value).uniq).to eq(['fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b3731622eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640'])
+  ensure
+    SCrypt::Engine::DEFAULTS[:max_threads] = 1
+  end
+
+  it 'should match the same results with huge pages, pre-faulting and a reused V arena' do
+    SCrypt::Engine::DEFAULTS.merge!(huge_pages: true, prefault: true, arena: true)
+    2.times do
+      expect(SCrypt::Engine.scrypt('password', 'NaCl', 1024, 8, 16, 64).unpack('H*').first).to eq('fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b3731622eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640')
+      expect(SCrypt::Engine.scrypt('', '', 16, 1, 1, 64).unpack('H*').first).to eq('77d6576238657b203b19ca42c18a0497f16b4844e3074ae8dfdffa3fede21442fcd0069ded0948f8326a753a0fc81f17e8d3e0fb2e0d3628cf35e20c38d18906')
+    end
+  ensure
+    SCrypt::Engine.release_arena
+    SCrypt::Engine::DEFAULTS.merge!(huge_pages: false, prefault: false, arena: false)
+  end
+
+  it 'should match the same results when computed in the background' do
+    jobs = [SCrypt::Engine.scrypt_async('password', 'NaCl', 1024, 8, 16, 64), SCrypt::Engine.scrypt_async('', '', '10$1$1$', 64)]
+    expect(jobs.first.to_io).to be_kind_of(IO)
+    expect(jobs.first.value.unpack('H*').first).to eq('fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b3731622eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640')
+    expect(jobs.last.value.unpack('H*').first).to eq('77d6576238657b203b19ca42c18a0497f16b4844e3074ae8dfdffa3fede21442fcd0069ded0948f8326a753a0fc81f17e8d3e0fb2e0d3628cf35e20c38d18906')
+    expect(jobs.all?(&:done?)).to be(true)
+    expect(jobs.map(&:to_io).all?(&:closed?)).to be(true)
+  end
+
+  it 'should raise if the background threads cannot be set up' do
+    SCrypt::Engine::DEFAULTS[:async_threads] = 0
+    expect { SCrypt::Engine.scrypt_async('', '', '10$1$1$', 64) }.to raise_error(RuntimeError)
+  ensure
+    SCrypt::Engine::DEFAULTS[:async_threads] = 2
+  end
+
+  it 'should match the PBKDF2-HMAC-SHA256 results of RFC 7914' do
+    expect(SCrypt::Engine.pbkdf2_sha256('passwd', 'salt', 1, 64).unpack('H*').first).to eq('55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783')
+    expect(SCrypt::Engine.pbkdf2_sha256('Password', 'NaCl', 80_000, 64).unpack('H*').first).to eq('4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56a1d425a1225833549adb841b51c9b3176a272bdebba1d078478f62b397f33c8d')
+  end
+
   it 'should match equivalent results sent through hash_secret() function' do
     expect(SCrypt::Engine.hash_secret('', '10$1$1$0000000000000000', 64)).to match(/\$77d6576238657b203b19ca42c18a0497f16b4844e3074ae8dfdffa3fede21442fcd0069ded0948f8326a753a0fc81f17e8d3e0fb2e0d3628cf35e20c38d18906$/)
     expect(SCrypt::Engine.hash_secret('password', '400$8$10$000000004e61436c', 64)).to match(/\$fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b3731622eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640$/)